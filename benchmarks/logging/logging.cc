@@ -0,0 +1,253 @@
+/*
+  Cost of LOGx calls for the different logging modes.
+
+  Every call is timed separately, so besides the throughput (items_per_second) a benchmark reports
+  p50_ns, p99_ns and p99.9_ns latency of a call, computed over the calls of all producer threads. The latency includes
+  the overhead of reading the clock twice. The console logger writes to stdout which is redirected to
+  /dev/null, the results are printed to stderr.
+
+  Usage: logging_benchmark [--benchmark_filter=<regex>] [--benchmark_out=<file> --benchmark_out_format=json]
+*/
+#include <benchmark/benchmark.h>
+
+#include "console_logger.hh"
+
+#include <common/logging/async_logger.hh>
+#include <common/logging/deferred_log.hh>
+#include <common/logging/file_logger.hh>
+#include <common/logging/log.hh>
+#include <common/logging/system_logger.hh>
+
+#include <syslog.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+const char *const cDomain = "benchmark";
+const char *const cLogFile = "/tmp/logging_benchmark.log";
+// samples beyond the limit only count for the throughput
+constexpr std::size_t cMaxSamples = 1 << 20;
+
+using Clock = std::chrono::steady_clock;
+
+/* samples of the threads of a run, merged to compute the percentiles once the last thread is done */
+struct RunSamples
+{
+    std::mutex mutex;
+    std::vector<uint32_t> samples;
+    int threads{0};
+};
+
+RunSamples &runSamples()
+{
+    static RunSamples samples;
+    return samples;
+}
+
+/* logger which drops everything, shows the cost of Log itself */
+class NullLogger final : public LoggerInterface
+{
+public:
+    void log(LogLevel, const LogContext &, const char *) override
+    {
+    }
+};
+
+int maxThreads()
+{
+    return static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+}
+
+double percentile(std::vector<uint32_t> &samples, double fraction)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    const std::size_t index = std::min(samples.size() - 1, static_cast<std::size_t>(samples.size() * fraction));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+template <typename Call>
+void measure(benchmark::State &state, Call call)
+{
+    std::vector<uint32_t> samples;
+    samples.reserve(std::min(cMaxSamples, static_cast<std::size_t>(state.max_iterations)));
+    int i = 0;
+    for (auto _ : state)
+    {
+        const Clock::time_point begin = Clock::now();
+        call(i++);
+        const Clock::time_point end = Clock::now();
+        if (samples.size() < cMaxSamples)
+        {
+            samples.push_back(static_cast<uint32_t>(
+                std::min<int64_t>(UINT32_MAX, std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count())));
+        }
+    }
+    state.SetItemsProcessed(state.iterations());
+
+    // percentiles of the threads can't be combined, only the last thread reports them and the sum of
+    // the counters over the threads is its value
+    RunSamples &run = runSamples();
+    std::lock_guard<std::mutex> lock(run.mutex);
+    run.samples.insert(run.samples.end(), samples.begin(), samples.end());
+    if (++run.threads == state.threads())
+    {
+        state.counters["p50_ns"] = percentile(run.samples, 0.5);
+        state.counters["p99_ns"] = percentile(run.samples, 0.99);
+        state.counters["p99.9_ns"] = percentile(run.samples, 0.999);
+        run.samples.clear();
+        run.threads = 0;
+    }
+}
+
+/* the first thread installs the logger, the others wait for it at the start of the loop */
+template <typename Factory>
+void install(benchmark::State &state, Factory factory, LogLevel level = LogLevel::INFO)
+{
+    if (state.thread_index() == 0)
+    {
+        log().set(LoggerInterface::UPtr(factory()));
+        log().level(level);
+    }
+}
+
+LoggerInterface *nullLogger()
+{
+    return new NullLogger;
+}
+
+void finish(benchmark::State &state)
+{
+    if (state.thread_index() == 0)
+    {
+        log().flush();
+    }
+}
+
+void loggingMessage(benchmark::State &state)
+{
+    measure(state, [](int i) { LOGI(cDomain, "message %d of the benchmark with a %s argument", i, "string"); });
+    finish(state);
+}
+} // namespace
+
+static void logFilteredOut(benchmark::State &state)
+{
+    install(state, nullLogger, LogLevel::WARNING);
+    measure(state, [](int i) { LOGD(cDomain, "filtered message %d", i); });
+}
+BENCHMARK(logFilteredOut)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logNullLogger(benchmark::State &state)
+{
+    install(state, nullLogger);
+    loggingMessage(state);
+}
+BENCHMARK(logNullLogger)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logConsole(benchmark::State &state)
+{
+    install(state, [] { return new ConsoleLogger; });
+    loggingMessage(state);
+}
+BENCHMARK(logConsole)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logConsoleAsync(benchmark::State &state)
+{
+    install(state, [] { return new AsyncLogger(LoggerInterface::UPtr(new ConsoleLogger)); });
+    loggingMessage(state);
+}
+BENCHMARK(logConsoleAsync)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logSyslog(benchmark::State &state)
+{
+    install(state, [] { return new SystemLogger("logging_benchmark", LOG_PID, LOG_USER); });
+    loggingMessage(state);
+}
+BENCHMARK(logSyslog)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logFile(benchmark::State &state)
+{
+    install(state, [] {
+        FileLogger::settings_t settings;
+        settings.path = cLogFile;
+        return new FileLogger(settings);
+    });
+    loggingMessage(state);
+    if (state.thread_index() == 0)
+    {
+        // the file is not needed, it must not grow through the runs
+        log().set(LoggerInterface::UPtr(new NullLogger));
+        unlink(cLogFile);
+    }
+}
+BENCHMARK(logFile)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logDeferred(benchmark::State &state)
+{
+    install(state, nullLogger);
+    measure(state, [](int i) { DLOGI(cDomain, "message %d of the benchmark with a %s argument", i, "string"); });
+    if (state.thread_index() == 0)
+    {
+        DeferredLog::get().flush();
+    }
+}
+BENCHMARK(logDeferred)->ThreadRange(1, maxThreads())->UseRealTime();
+
+static void logFanOut(benchmark::State &state)
+{
+    std::vector<Log::SinkId> sinks;
+    install(state, nullLogger);
+    if (state.thread_index() == 0)
+    {
+        const int count = static_cast<int>(state.range(0));
+        for (int i = 0; i < count; ++i)
+        {
+            sinks.push_back(log().addSink(LoggerInterface::UPtr(new NullLogger)));
+        }
+    }
+    loggingMessage(state);
+    for (Log::SinkId sink : sinks)
+    {
+        log().removeSink(sink);
+    }
+}
+BENCHMARK(logFanOut)->Arg(1)->Arg(4)->ThreadRange(1, maxThreads())->UseRealTime();
+
+int main(int argc, char **argv)
+{
+    // loggers print to stdout, it must not be mixed with the results
+    if (!freopen("/dev/null", "w", stdout))
+    {
+        perror("freopen");
+        return 1;
+    }
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+    {
+        return 1;
+    }
+    benchmark::ConsoleReporter reporter(isatty(STDERR_FILENO) ? benchmark::ConsoleReporter::OO_ColorTabular
+                                                              : benchmark::ConsoleReporter::OO_Tabular);
+    reporter.SetOutputStream(&std::cerr);
+    reporter.SetErrorStream(&std::cerr);
+    benchmark::RunSpecifiedBenchmarks(&reporter);
+    benchmark::Shutdown();
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include <common/logging/deferred_log.hh>
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+using namespace softeq::common::logging;
+
+/*
+  Turns binary logs written by DeferredLog (SC_LOG_BINARY=path) into text lines
+  usage: common-logging-decoder [file]
+  the standard input is decoded when the file is not specified, timestamps follow SC_LOG_TIME_RESOLUTION
+*/
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        std::cerr << "usage: " << argv[0] << " [file]\n";
+        return 1;
+    }
+
+    std::ifstream file;
+    if (argc == 2)
+    {
+        file.open(argv[1], std::ios::binary);
+        if (!file)
+        {
+            std::cerr << "can't open " << argv[1] << '\n';
+            return 1;
+        }
+    }
+
+    LogFormatter::TimeResolution resolution = LogFormatter::TimeResolution::SECONDS;
+    const char *timeResolution = getenv("SC_LOG_TIME_RESOLUTION");
+    if (timeResolution)
+    {
+        try
+        {
+            resolution = LogFormatter::timeResolutionFromString(timeResolution);
+        }
+        catch (const std::exception &e)
+        {
+            std::cerr << "time resolution error: " << e.what() << "\nfix your SC_LOG_TIME_RESOLUTION envvar\n";
+            return 1;
+        }
+    }
+
+    DeferredLogReader reader(argc == 2 ? file : std::cin);
+    if (!reader.decode(std::cout, resolution))
+    {
+        std::cerr << "the log is corrupted or truncated\n";
+        return 1;
+    }
+    return 0;
+}
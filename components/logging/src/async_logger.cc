@@ -0,0 +1,391 @@
+#include "async_logger.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+const char *const LOG_DOMAIN = "AsyncLogger";
+
+// records have fixed size, longer strings are cut and end with the mark
+constexpr std::size_t cMaxDomainLength = 64;
+constexpr std::size_t cMaxMessageLength = 1024;
+constexpr char cTruncationMark[] = "...";
+constexpr std::size_t cCacheLineSize = 64;
+constexpr int cSpinsBeforeWait = 64;
+// waiters are woken by notifications, the bound of a wait only limits the damage of a missed one
+constexpr std::chrono::seconds cWaitPeriod{1};
+
+std::size_t roundUpToPowerOfTwo(std::size_t value)
+{
+    std::size_t result = 2;
+    while (result < value)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+} // namespace
+
+/*!
+  Bounded multi-producer queue of fixed size records (D. Vyukov's algorithm). Every slot has a sequence number
+  which tells whether the slot is free for the producer owning the position or filled for the consumer.
+  Popping is safe from several threads too, which lets producers discard the oldest record on overflow.
+*/
+class AsyncLogger::RingBuffer final
+{
+public:
+    struct Record
+    {
+        LogLevel level;
+        std::thread::id threadId;
+        LogContext::Clock::time_point time;
+        char domain[cMaxDomainLength];
+        char message[cMaxMessageLength];
+    };
+
+    explicit RingBuffer(std::size_t capacity)
+        : _mask(roundUpToPowerOfTwo(capacity) - 1)
+        , _slots(_mask + 1)
+    {
+        for (std::size_t i = 0; i < _slots.size(); ++i)
+        {
+            _slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(LogLevel level, const LogContext &context, const char *msg)
+    {
+        std::size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;)
+        {
+            slot = &_slots[pos & _mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+            if (diff == 0)
+            {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        Record &record = slot->record;
+        record.level = level;
+        record.threadId = context._threadId;
+        record.time = context._time;
+        copyTruncated(record.domain, context._name.c_str());
+        copyTruncated(record.message, msg);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(Record *record)
+    {
+        std::size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;)
+        {
+            slot = &_slots[pos & _mask];
+            std::size_t seq = slot->sequence.load(std::memory_order_acquire);
+            std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (record)
+        {
+            *record = slot->record;
+        }
+        slot->sequence.store(pos + _mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const
+    {
+        return _dequeuePos.load(std::memory_order_acquire) >= _enqueuePos.load(std::memory_order_acquire);
+    }
+
+    bool full() const
+    {
+        return _enqueuePos.load(std::memory_order_acquire) - _dequeuePos.load(std::memory_order_acquire) > _mask;
+    }
+
+    std::size_t enqueued() const
+    {
+        return _enqueuePos.load(std::memory_order_acquire);
+    }
+
+    std::size_t dequeued() const
+    {
+        return _dequeuePos.load(std::memory_order_acquire);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::size_t> sequence;
+        Record record;
+    };
+
+    template <std::size_t N>
+    static void copyTruncated(char (&dst)[N], const char *src)
+    {
+        std::size_t length = strnlen(src, N - 1);
+        std::memcpy(dst, src, length);
+        dst[length] = '\0';
+        // the cut is visible in the log
+        if (length == N - 1 && src[length])
+        {
+            std::memcpy(dst + length - (sizeof(cTruncationMark) - 1), cTruncationMark, sizeof(cTruncationMark) - 1);
+        }
+    }
+
+    const std::size_t _mask;
+    std::vector<Slot> _slots;
+    // positions are modified by different parties, keep them on separate cache lines
+    char _padding0[cCacheLineSize];
+    std::atomic<std::size_t> _enqueuePos{0};
+    char _padding1[cCacheLineSize];
+    std::atomic<std::size_t> _dequeuePos{0};
+};
+
+AsyncLogger::AsyncLogger(LoggerInterface::UPtr &&sink)
+    : AsyncLogger(std::move(sink), settings_t())
+{
+}
+
+AsyncLogger::AsyncLogger(LoggerInterface::UPtr &&sink, const settings_t &settings)
+    : _sink(std::move(sink))
+    , _settings(settings)
+    , _queue(new RingBuffer(settings.capacity))
+{
+    if (!_sink)
+    {
+        throw std::invalid_argument(std::string(__func__) + "(): sink");
+    }
+    _worker = std::thread(&AsyncLogger::worker, this);
+}
+
+AsyncLogger::~AsyncLogger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _dataAvailable.notify_one();
+    if (_worker.joinable())
+    {
+        _worker.join();
+    }
+}
+
+void AsyncLogger::log(LogLevel level, const LogContext &context, const char *msg)
+{
+    int spins = 0;
+    while (!_queue->tryPush(level, context, msg))
+    {
+        switch (_settings.policy)
+        {
+        case OverflowPolicy::DROP_NEWEST:
+            _dropped++;
+            return;
+        case OverflowPolicy::DROP_OLDEST:
+            if (_queue->tryPop(nullptr))
+            {
+                _dropped++;
+            }
+            break;
+        case OverflowPolicy::BLOCK:
+            if (std::this_thread::get_id() == _worker.get_id() || _stop)
+            {
+                // the sink logs from the background thread, nobody is going to free a slot
+                _dropped++;
+                return;
+            }
+            if (++spins < cSpinsBeforeWait)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                std::unique_lock<std::mutex> lock(_mutex);
+                _waiters++;
+                // pairs with the fence of the worker: either the slot freed is seen here or the waiter there
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                _dataAvailable.notify_one();
+                _progress.wait_for(lock, cWaitPeriod, [this] { return _stop || !_queue->full(); });
+                _waiters--;
+            }
+            break;
+        }
+    }
+
+    // pairs with the fence of the worker: either the record is seen there or the idle worker here
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_consumerIdle.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _dataAvailable.notify_one();
+    }
+}
+
+void AsyncLogger::flush()
+{
+    if (std::this_thread::get_id() == _worker.get_id())
+    {
+        return;
+    }
+
+    const std::size_t target = _queue->enqueued();
+    std::unique_lock<std::mutex> lock(_mutex);
+    _flushTarget = std::max(_flushTarget, target);
+    const uint64_t ticket = ++_flushRequested;
+    _dataAvailable.notify_one();
+    while (_flushed < ticket && !_stop)
+    {
+        _progress.wait_for(lock, cWaitPeriod);
+    }
+}
+
+std::size_t AsyncLogger::dropped() const noexcept
+{
+    return _droppedTotal + _dropped;
+}
+
+AsyncLogger::OverflowPolicy AsyncLogger::overflowPolicyFromString(const std::string &str)
+{
+    if (str.empty() || str == "block")
+    {
+        return OverflowPolicy::BLOCK;
+    }
+    if (str == "drop_newest")
+    {
+        return OverflowPolicy::DROP_NEWEST;
+    }
+    if (str == "drop_oldest")
+    {
+        return OverflowPolicy::DROP_OLDEST;
+    }
+    throw std::logic_error("invalid value of overflow policy");
+}
+
+void AsyncLogger::worker()
+{
+    for (;;)
+    {
+        std::size_t count = drain();
+
+        // pairs with the fence of a blocked producer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_waiters.load(std::memory_order_relaxed))
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _progress.notify_all();
+        }
+        flushRequested();
+
+        if (count == 0)
+        {
+            std::unique_lock<std::mutex> lock(_mutex);
+            if (_stop && _queue->empty())
+            {
+                break;
+            }
+            _consumerIdle.store(true, std::memory_order_relaxed);
+            // pairs with the fence of a producer which has just pushed a record
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            _dataAvailable.wait_for(lock, cWaitPeriod,
+                                    [this] { return _stop || !_queue->empty() || _flushRequested != _flushed; });
+            _consumerIdle.store(false, std::memory_order_relaxed);
+        }
+    }
+    _sink->flush();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flushed = _flushRequested;
+    }
+    _progress.notify_all();
+}
+
+void AsyncLogger::flushRequested()
+{
+    uint64_t ticket;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_flushed == _flushRequested || _written.load() < _flushTarget)
+        {
+            return;
+        }
+        ticket = _flushRequested;
+    }
+    _sink->flush();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _flushed = ticket;
+    }
+    _progress.notify_all();
+}
+
+std::size_t AsyncLogger::drain()
+{
+    reportDropped();
+
+    RingBuffer::Record record;
+    std::size_t count = 0;
+    while (count < _settings.batchSize && _queue->tryPop(&record))
+    {
+        _sink->log(record.level, LogContext(record.domain, record.threadId, record.time), record.message);
+        if (record.level == LogLevel::FATAL)
+        {
+            _sink->flush();
+        }
+        ++count;
+    }
+
+    // records popped by producers with DROP_OLDEST policy are accounted as written too
+    _written.store(_queue->dequeued());
+    return count;
+}
+
+void AsyncLogger::reportDropped()
+{
+    std::size_t dropped = _dropped.exchange(0);
+    if (dropped == 0)
+    {
+        return;
+    }
+    _droppedTotal += dropped;
+
+    char msg[128];
+    snprintf(msg, sizeof(msg), "%zu messages were dropped due to the queue overflow", dropped);
+    _sink->log(LogLevel::WARNING, LogContext(LOG_DOMAIN, std::this_thread::get_id()), msg);
+}
@@ -1,26 +1,22 @@
 #include "console_logger.hh"
 
-#include <iomanip>
-#include <sstream>
+#include <cstdio>
 
 using namespace softeq::common::logging;
 
-namespace
-{
-inline std::string makeThreadId(const std::thread::id &id)
+ConsoleLogger::ConsoleLogger()
+    : ConsoleLogger(LogFormatter::TimeResolution::SECONDS)
 {
-    std::stringstream stream;
-    stream << "0x" << std::uppercase << std::setfill('0') << std::setw(4) << std::hex << id;
-    return stream.str();
 }
-} // namespace
-ConsoleLogger::ConsoleLogger()
+
+ConsoleLogger::ConsoleLogger(LogFormatter::TimeResolution resolution)
+    : _formatter(resolution)
 {
 }
 
 void ConsoleLogger::log(LogLevel level, const LogContext &context, const char *msg)
 {
-    fprintf(stdout, "%lu %s [%c] %s: %s\n", static_cast<unsigned long>(time(0)),
-            makeThreadId(context._threadId).c_str(), logLevelToChar(level), context._name.c_str(), msg);
+    const std::string &line = _formatter.format(level, context, msg);
+    fwrite(line.data(), 1, line.size(), stdout);
     fflush(stdout);
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "logger_interface.hh"
+#include "log_formatter.hh"
 
 namespace softeq
 {
@@ -13,7 +14,11 @@ class ConsoleLogger : public LoggerInterface
 {
 public:
     ConsoleLogger();
+    explicit ConsoleLogger(LogFormatter::TimeResolution resolution);
     virtual void log(LogLevel level, const LogContext &context, const char *msg);
+
+private:
+    const LogFormatter _formatter;
 };
 
 } // namespace logging
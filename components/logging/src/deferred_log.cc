@@ -0,0 +1,902 @@
+#include "deferred_log.hh"
+#include "log_formatter.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <iostream>
+
+#include <time.h>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+const char cMagic[] = "SCBLOG1\n";
+constexpr std::size_t cMagicLength = sizeof(cMagic) - 1;
+
+constexpr std::size_t cThreadBufferSize = 64 * 1024;
+constexpr std::size_t cMaxDomainLength = 256;
+// the longest time a record waits for the worker when its buffer stays below the wakeup threshold
+constexpr std::chrono::milliseconds cWaitPeriod{100};
+// a producer wakes the worker up when its buffer gets filled past this size
+constexpr std::size_t cWakeupThreshold = cThreadBufferSize / 4;
+
+// records of thread buffers are aligned to keep headers accessible without copying
+constexpr std::size_t cRecordAlignment = 8;
+// descriptor id of the record which fills the tail of the buffer before wrapping
+constexpr uint32_t cPaddingId = UINT32_MAX;
+// domain length of the record which has the same domain as its descriptor
+constexpr uint32_t cDescriptorDomain = UINT32_MAX;
+
+// binary file entry types
+constexpr char cEntryDescriptor = 'D';
+constexpr char cEntryThread = 'T';
+constexpr char cEntryMessage = 'M';
+
+struct RecordHeader
+{
+    uint32_t size;
+    uint32_t id;
+    uint64_t time;
+    uint32_t domainLength;
+    uint32_t argsLength;
+};
+
+std::size_t alignRecord(std::size_t size)
+{
+    return (size + cRecordAlignment - 1) & ~(cRecordAlignment - 1);
+}
+
+uint64_t nowNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void writeString(FILE *file, const char *str, uint32_t length)
+{
+    fwrite(&length, sizeof(length), 1, file);
+    fwrite(str, 1, length, file);
+}
+
+void writeString(FILE *file, const char *str)
+{
+    writeString(file, str ? str : "", str ? static_cast<uint32_t>(strlen(str)) : 0);
+}
+
+template <typename T>
+bool readValue(std::istream &stream, T &value)
+{
+    return static_cast<bool>(stream.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+bool readString(std::istream &stream, std::string &value)
+{
+    uint32_t length;
+    if (!readValue(stream, length))
+    {
+        return false;
+    }
+    value.resize(length);
+    return length == 0 || static_cast<bool>(stream.read(&value[0], length));
+}
+
+/* Reader of encoded arguments which converts them to the type requested by the format */
+class ArgumentReader final
+{
+public:
+    ArgumentReader(const char *args, std::size_t length)
+        : _pos(args)
+        , _end(args + length)
+    {
+    }
+
+    bool next(deferred::ArgumentType &type, uint64_t &value, std::string &str)
+    {
+        if (_pos >= _end)
+        {
+            return false;
+        }
+        type = static_cast<deferred::ArgumentType>(*_pos++);
+        if (type == deferred::ArgumentType::STRING)
+        {
+            uint32_t length;
+            if (_pos + sizeof(length) > _end)
+            {
+                return false;
+            }
+            std::memcpy(&length, _pos, sizeof(length));
+            _pos += sizeof(length);
+            if (length == deferred::cNullString)
+            {
+                str = "(null)";
+                return true;
+            }
+            if (_pos + length > _end)
+            {
+                return false;
+            }
+            str.assign(_pos, length);
+            _pos += length;
+            return true;
+        }
+        if (_pos + sizeof(value) > _end)
+        {
+            return false;
+        }
+        std::memcpy(&value, _pos, sizeof(value));
+        _pos += sizeof(value);
+        return true;
+    }
+
+    long long nextInteger()
+    {
+        deferred::ArgumentType type;
+        uint64_t value = 0;
+        std::string str;
+        if (!next(type, value, str))
+        {
+            return 0;
+        }
+        if (type == deferred::ArgumentType::DOUBLE)
+        {
+            double d;
+            std::memcpy(&d, &value, sizeof(d));
+            return static_cast<long long>(d);
+        }
+        return type == deferred::ArgumentType::STRING ? 0 : static_cast<long long>(value);
+    }
+
+private:
+    const char *_pos;
+    const char *_end;
+};
+
+void appendFormatted(std::string &out, const char *spec, ...)
+{
+    char buf[512];
+    va_list args;
+    va_start(args, spec);
+    int length = vsnprintf(buf, sizeof(buf), spec, args);
+    va_end(args);
+    if (length < 0)
+    {
+        return;
+    }
+    if (static_cast<std::size_t>(length) < sizeof(buf))
+    {
+        out.append(buf, length);
+        return;
+    }
+    std::string large(length + 1, '\0');
+    va_start(args, spec);
+    vsnprintf(&large[0], large.size(), spec, args);
+    va_end(args);
+    out.append(large.c_str(), length);
+}
+} // namespace
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+namespace deferred
+{
+std::string format(const char *format, const char *args, std::size_t length)
+{
+    std::string out;
+    ArgumentReader reader(args, length);
+
+    const char *p = format;
+    while (*p)
+    {
+        if (*p != '%')
+        {
+            const char *next = strchr(p, '%');
+            if (!next)
+            {
+                out.append(p);
+                break;
+            }
+            out.append(p, next - p);
+            p = next;
+            continue;
+        }
+        if (p[1] == '%')
+        {
+            out.push_back('%');
+            p += 2;
+            continue;
+        }
+
+        // flags, width and precision are kept, '*' is replaced with the stored value,
+        // length modifiers are replaced with the ones matching the stored 64 bit values
+        std::string spec("%");
+        ++p;
+        while (*p && strchr("-+ #0'", *p))
+        {
+            spec.push_back(*p++);
+        }
+        if (*p == '*')
+        {
+            spec += std::to_string(reader.nextInteger());
+            ++p;
+        }
+        while (isdigit(static_cast<unsigned char>(*p)))
+        {
+            spec.push_back(*p++);
+        }
+        if (*p == '.')
+        {
+            spec.push_back(*p++);
+            if (*p == '*')
+            {
+                spec += std::to_string(reader.nextInteger());
+                ++p;
+            }
+            while (isdigit(static_cast<unsigned char>(*p)))
+            {
+                spec.push_back(*p++);
+            }
+        }
+        const char *modifier = p;
+        while (*p && strchr("hljztLq", *p))
+        {
+            ++p;
+        }
+        // integers are printed with ll, h and hh narrow them first the way printf does
+        const std::string length(modifier, p);
+        const char conversion = *p;
+        if (!conversion)
+        {
+            break;
+        }
+        ++p;
+
+        ArgumentType type;
+        uint64_t value = 0;
+        std::string str;
+        if (conversion == 'n' || !reader.next(type, value, str))
+        {
+            continue;
+        }
+        double d = 0;
+        std::memcpy(&d, &value, sizeof(d));
+
+        switch (conversion)
+        {
+        case 'd':
+        case 'i':
+        {
+            long long integer =
+                type == ArgumentType::DOUBLE ? static_cast<long long>(d) : static_cast<long long>(value);
+            if (length == "hh")
+            {
+                integer = static_cast<signed char>(integer);
+            }
+            else if (length == "h")
+            {
+                integer = static_cast<short>(integer);
+            }
+            appendFormatted(out, (spec + "ll" + conversion).c_str(), integer);
+            break;
+        }
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+        {
+            unsigned long long integer = type == ArgumentType::DOUBLE ? static_cast<unsigned long long>(d)
+                                                                      : static_cast<unsigned long long>(value);
+            if (length == "hh")
+            {
+                integer = static_cast<unsigned char>(integer);
+            }
+            else if (length == "h")
+            {
+                integer = static_cast<unsigned short>(integer);
+            }
+            appendFormatted(out, (spec + "ll" + conversion).c_str(), integer);
+            break;
+        }
+        case 'c':
+            appendFormatted(out, (spec + conversion).c_str(), static_cast<int>(value));
+            break;
+        case 'f':
+        case 'F':
+        case 'e':
+        case 'E':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            appendFormatted(out, (spec + conversion).c_str(),
+                            type == ArgumentType::DOUBLE
+                                ? d
+                                : (type == ArgumentType::SIGNED ? static_cast<double>(static_cast<int64_t>(value))
+                                                                : static_cast<double>(value)));
+            break;
+        case 's':
+            appendFormatted(out, (spec + conversion).c_str(), type == ArgumentType::STRING ? str.c_str() : "");
+            break;
+        case 'p':
+            appendFormatted(out, (spec + conversion).c_str(), reinterpret_cast<void *>(static_cast<uintptr_t>(value)));
+            break;
+        default:
+            out.append(spec);
+            out.push_back(conversion);
+            break;
+        }
+    }
+    return out;
+}
+} // namespace deferred
+
+/*!
+  Single producer single consumer byte ring owned by one thread. Records are contiguous, when a record
+  doesn't fit into the tail of the buffer the tail is filled with a padding record, or just skipped when
+  it is shorter than a record header.
+*/
+class DeferredLog::ThreadBuffer final
+{
+public:
+    ThreadBuffer(uint32_t index, std::size_t capacity)
+        : index(index)
+        , threadId(std::this_thread::get_id())
+        , threadName(LogFormatter::threadId(threadId))
+        , _data(capacity)
+    {
+    }
+
+    char *reserve(std::size_t size, const std::atomic<bool> &stop)
+    {
+        size = alignRecord(size);
+        if (size > _data.size() / 2)
+        {
+            return nullptr;
+        }
+
+        std::size_t head = _head.load(std::memory_order_relaxed);
+        std::size_t offset = head % _data.size();
+        std::size_t padding = (_data.size() - offset < size) ? _data.size() - offset : 0;
+        while (head + padding + size - _tail.load(std::memory_order_acquire) > _data.size())
+        {
+            if (stop)
+            {
+                return nullptr;
+            }
+            std::this_thread::yield();
+        }
+
+        if (padding)
+        {
+            // a leftover shorter than a header gets no padding record, the consumer skips it by its size
+            if (padding >= sizeof(RecordHeader))
+            {
+                RecordHeader header = RecordHeader();
+                header.size = static_cast<uint32_t>(padding);
+                header.id = cPaddingId;
+                std::memcpy(&_data[offset], &header, sizeof(header));
+            }
+            head += padding;
+            _head.store(head, std::memory_order_release);
+            offset = 0;
+        }
+        _reserved = size;
+        return &_data[offset];
+    }
+
+    // returns true when the record fills the buffer past the wakeup threshold
+    bool commit()
+    {
+        const std::size_t head = _head.load(std::memory_order_relaxed) + _reserved;
+        _head.store(head, std::memory_order_release);
+        const std::size_t used = head - _tail.load(std::memory_order_relaxed);
+        return used >= cWakeupThreshold && used - _reserved < cWakeupThreshold;
+    }
+
+    // called by the consumer only
+    const char *peek()
+    {
+        std::size_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire))
+        {
+            return nullptr;
+        }
+        std::size_t offset = tail % _data.size();
+        if (_data.size() - offset < sizeof(RecordHeader))
+        {
+            // records never start there, the producer has wrapped
+            tail += _data.size() - offset;
+            _tail.store(tail, std::memory_order_release);
+            if (tail == _head.load(std::memory_order_acquire))
+            {
+                return nullptr;
+            }
+            offset = 0;
+        }
+        return &_data[offset];
+    }
+
+    void release(std::size_t size)
+    {
+        _tail.store(_tail.load(std::memory_order_relaxed) + size, std::memory_order_release);
+    }
+
+    std::size_t head() const
+    {
+        return _head.load(std::memory_order_acquire);
+    }
+
+    std::size_t tail() const
+    {
+        return _tail.load(std::memory_order_acquire);
+    }
+
+    const uint32_t index;
+    const std::thread::id threadId;
+    const std::string threadName;
+    std::atomic<bool> retired{false};
+
+private:
+    std::vector<char> _data;
+    std::size_t _reserved{0};
+    std::atomic<std::size_t> _head{0};
+    char _padding[64];
+    std::atomic<std::size_t> _tail{0};
+};
+
+/*!
+  Keeps the buffer of the thread, marks it as retired when the thread exits
+*/
+struct DeferredLog::ThreadLocal final
+{
+    ~ThreadLocal()
+    {
+        if (buffer)
+        {
+            buffer->retired = true;
+        }
+    }
+
+    std::shared_ptr<ThreadBuffer> buffer;
+};
+
+thread_local DeferredLog::ThreadLocal DeferredLog::_threadLocal;
+
+DeferredLog::DeferredLog()
+{
+    // the consumer passes records to the Log, so it must outlive this object
+    Log::get();
+
+    char *path = getenv("SC_LOG_BINARY");
+    if (path && !open(path))
+    {
+        std::cerr << "Deferred logger can't open " << path << "\nfix your SC_LOG_BINARY envvar\n";
+    }
+    _worker = std::thread(&DeferredLog::worker, this);
+}
+
+DeferredLog::~DeferredLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _wakeup.notify_one();
+    if (_worker.joinable())
+    {
+        _worker.join();
+    }
+    close();
+}
+
+DeferredLog &DeferredLog::get()
+{
+    static DeferredLog deferredLog;
+    return deferredLog;
+}
+
+bool DeferredLog::open(const std::string &path)
+{
+    FILE *file = fopen(path.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    fwrite(cMagic, 1, cMagicLength, file);
+
+    std::lock_guard<std::mutex> lock(_fileMutex);
+    if (_file)
+    {
+        fclose(_file);
+    }
+    _file = file;
+    _descriptorsWritten.clear();
+    _threadsWritten.clear();
+    return true;
+}
+
+void DeferredLog::close()
+{
+    std::lock_guard<std::mutex> lock(_fileMutex);
+    if (_file)
+    {
+        fclose(_file);
+        _file = nullptr;
+    }
+}
+
+void DeferredLog::flush()
+{
+    if (std::this_thread::get_id() == _worker.get_id())
+    {
+        return;
+    }
+
+    std::vector<std::pair<std::shared_ptr<ThreadBuffer>, std::size_t>> targets;
+    {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        for (const std::shared_ptr<ThreadBuffer> &buffer : _buffers)
+        {
+            targets.emplace_back(buffer, buffer->head());
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (const auto &target : targets)
+    {
+        while (target.first->tail() < target.second && !_stop)
+        {
+            _pending = true;
+            _wakeup.notify_one();
+            _progress.wait_for(lock, cWaitPeriod);
+        }
+    }
+    lock.unlock();
+
+    std::lock_guard<std::mutex> fileLock(_fileMutex);
+    if (_file)
+    {
+        fflush(_file);
+    }
+    else
+    {
+        log().flush();
+    }
+}
+
+bool DeferredLog::accept(LogDescriptor &descriptor, const char *domain, const char *format)
+{
+    if (descriptor.id.load(std::memory_order_acquire) == 0)
+    {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        if (descriptor.id.load(std::memory_order_relaxed) == 0)
+        {
+            descriptor.format = format;
+            descriptor.domain = domain;
+            _descriptors.push_back(&descriptor);
+            descriptor.id.store(static_cast<uint32_t>(_descriptors.size()), std::memory_order_release);
+        }
+    }
+    return descriptor.format == format;
+}
+
+char *DeferredLog::begin(const LogDescriptor &descriptor, const char *domain, std::size_t argsSize)
+{
+    ThreadBuffer *buffer = threadBuffer();
+    if (!buffer)
+    {
+        return nullptr;
+    }
+
+    const bool ownDomain = domain != descriptor.domain;
+    const uint32_t domainLength =
+        ownDomain ? static_cast<uint32_t>(domain ? strnlen(domain, cMaxDomainLength) : 0) : cDescriptorDomain;
+    const std::size_t size = sizeof(RecordHeader) + (ownDomain ? domainLength : 0) + argsSize;
+
+    char *record = buffer->reserve(size, _stop);
+    if (!record)
+    {
+        return nullptr;
+    }
+
+    RecordHeader header;
+    header.size = static_cast<uint32_t>(alignRecord(size));
+    header.id = descriptor.id.load(std::memory_order_relaxed);
+    header.time = nowNs();
+    header.domainLength = domainLength;
+    header.argsLength = static_cast<uint32_t>(argsSize);
+    std::memcpy(record, &header, sizeof(header));
+    record += sizeof(header);
+    if (ownDomain && domainLength)
+    {
+        std::memcpy(record, domain, domainLength);
+        record += domainLength;
+    }
+    return record;
+}
+
+void DeferredLog::commit()
+{
+    if (_threadLocal.buffer->commit())
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _pending = true;
+        _wakeup.notify_one();
+    }
+}
+
+DeferredLog::ThreadBuffer *DeferredLog::threadBuffer()
+{
+    if (!_threadLocal.buffer)
+    {
+        if (std::this_thread::get_id() == _worker.get_id())
+        {
+            // nobody would consume records of the consumer itself
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        _threadLocal.buffer = std::make_shared<ThreadBuffer>(_buffersCreated++, cThreadBufferSize);
+        _buffers.push_back(_threadLocal.buffer);
+    }
+    return _threadLocal.buffer.get();
+}
+
+void DeferredLog::worker()
+{
+    for (;;)
+    {
+        std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+        {
+            std::lock_guard<std::mutex> lock(_registryMutex);
+            buffers = _buffers;
+        }
+
+        bool progress = false;
+        for (const std::shared_ptr<ThreadBuffer> &buffer : buffers)
+        {
+            progress |= consume(*buffer);
+            if (buffer->retired && !buffer->peek())
+            {
+                std::lock_guard<std::mutex> lock(_registryMutex);
+                _buffers.erase(std::remove(_buffers.begin(), _buffers.end(), buffer), _buffers.end());
+            }
+        }
+
+        std::unique_lock<std::mutex> lock(_mutex);
+        _progress.notify_all();
+        if (!progress)
+        {
+            if (_stop)
+            {
+                break;
+            }
+            _wakeup.wait_for(lock, cWaitPeriod, [this]() { return _pending || _stop; });
+        }
+        _pending = false;
+    }
+}
+
+bool DeferredLog::consume(ThreadBuffer &buffer)
+{
+    bool progress = false;
+    while (const char *record = buffer.peek())
+    {
+        RecordHeader header;
+        std::memcpy(&header, record, sizeof(header));
+        if (header.id != cPaddingId)
+        {
+            writeRecord(buffer, record);
+        }
+        buffer.release(header.size);
+        progress = true;
+    }
+    return progress;
+}
+
+void DeferredLog::writeRecord(ThreadBuffer &buffer, const char *record)
+{
+    RecordHeader header;
+    std::memcpy(&header, record, sizeof(header));
+    const char *domain = record + sizeof(header);
+    const uint32_t domainLength = header.domainLength == cDescriptorDomain ? 0 : header.domainLength;
+    const char *args = domain + domainLength;
+
+    LogDescriptor *descriptor;
+    {
+        std::lock_guard<std::mutex> lock(_registryMutex);
+        descriptor = _descriptors.at(header.id - 1);
+    }
+
+    std::lock_guard<std::mutex> lock(_fileMutex);
+    if (_file)
+    {
+        if (_descriptorsWritten.size() < header.id)
+        {
+            _descriptorsWritten.resize(header.id, false);
+        }
+        if (!_descriptorsWritten[header.id - 1])
+        {
+            const uint8_t level = static_cast<uint8_t>(descriptor->level);
+            const uint32_t line = static_cast<uint32_t>(descriptor->line);
+            fputc(cEntryDescriptor, _file);
+            fwrite(&header.id, sizeof(header.id), 1, _file);
+            fwrite(&level, sizeof(level), 1, _file);
+            fwrite(&line, sizeof(line), 1, _file);
+            writeString(_file, descriptor->format);
+            writeString(_file, descriptor->domain);
+            writeString(_file, descriptor->file);
+            _descriptorsWritten[header.id - 1] = true;
+        }
+        if (_threadsWritten.size() <= buffer.index)
+        {
+            _threadsWritten.resize(buffer.index + 1, false);
+        }
+        if (!_threadsWritten[buffer.index])
+        {
+            fputc(cEntryThread, _file);
+            fwrite(&buffer.index, sizeof(buffer.index), 1, _file);
+            writeString(_file, buffer.threadName.c_str());
+            _threadsWritten[buffer.index] = true;
+        }
+
+        fputc(cEntryMessage, _file);
+        fwrite(&header.id, sizeof(header.id), 1, _file);
+        fwrite(&buffer.index, sizeof(buffer.index), 1, _file);
+        fwrite(&header.time, sizeof(header.time), 1, _file);
+        fwrite(&header.domainLength, sizeof(header.domainLength), 1, _file);
+        fwrite(domain, 1, domainLength, _file);
+        writeString(_file, args, header.argsLength);
+        if (descriptor->level == LogLevel::FATAL)
+        {
+            fflush(_file);
+        }
+        return;
+    }
+
+    std::string message = deferred::format(descriptor->format, args, header.argsLength);
+    std::string domainName = header.domainLength == cDescriptorDomain
+                                 ? std::string(descriptor->domain ? descriptor->domain : "")
+                                 : std::string(domain, domainLength);
+    LogContext context(domainName, buffer.threadId,
+                       LogContext::Clock::time_point(std::chrono::duration_cast<LogContext::Clock::duration>(
+                           std::chrono::nanoseconds(header.time))));
+    log().Write(descriptor->level, context, message.c_str());
+}
+
+/// Implementation of DeferredLogReader
+DeferredLogReader::DeferredLogReader(std::istream &stream)
+    : _stream(stream)
+{
+}
+
+bool DeferredLogReader::read(const Handler &handler)
+{
+    return readRecords([&handler](LogLevel level, const std::string &domain, const std::string &threadId,
+                                  uint64_t time, const std::string &message) {
+        handler(level, domain, threadId, static_cast<std::time_t>(time / 1000000000ULL), message);
+    });
+}
+
+bool DeferredLogReader::readRecords(const RecordHandler &handler)
+{
+    char magic[cMagicLength];
+    if (!_stream.read(magic, cMagicLength) || std::memcmp(magic, cMagic, cMagicLength) != 0)
+    {
+        return false;
+    }
+
+    char type;
+    while (_stream.get(type))
+    {
+        switch (type)
+        {
+        case cEntryDescriptor:
+        {
+            uint32_t id;
+            uint8_t level;
+            uint32_t line;
+            Descriptor descriptor;
+            std::string file;
+            if (!readValue(_stream, id) || !readValue(_stream, level) || !readValue(_stream, line) ||
+                !readString(_stream, descriptor.format) || !readString(_stream, descriptor.domain) ||
+                !readString(_stream, file) || id == 0)
+            {
+                return false;
+            }
+            descriptor.level = static_cast<LogLevel>(level);
+            if (_descriptors.size() < id)
+            {
+                _descriptors.resize(id);
+            }
+            _descriptors[id - 1] = descriptor;
+            break;
+        }
+        case cEntryThread:
+        {
+            uint32_t index;
+            std::string name;
+            if (!readValue(_stream, index) || !readString(_stream, name))
+            {
+                return false;
+            }
+            if (_threads.size() <= index)
+            {
+                _threads.resize(index + 1);
+            }
+            _threads[index] = name;
+            break;
+        }
+        case cEntryMessage:
+        {
+            uint32_t id;
+            uint32_t thread;
+            uint64_t time;
+            uint32_t domainLength;
+            std::string domain;
+            std::string args;
+            if (!readValue(_stream, id) || !readValue(_stream, thread) || !readValue(_stream, time) ||
+                !readValue(_stream, domainLength))
+            {
+                return false;
+            }
+            if (id == 0 || id > _descriptors.size() || thread >= _threads.size())
+            {
+                return false;
+            }
+            const Descriptor &descriptor = _descriptors[id - 1];
+            if (domainLength == cDescriptorDomain)
+            {
+                domain = descriptor.domain;
+            }
+            else
+            {
+                domain.resize(domainLength);
+                if (domainLength && !_stream.read(&domain[0], domainLength))
+                {
+                    return false;
+                }
+            }
+            if (!readString(_stream, args))
+            {
+                return false;
+            }
+            handler(descriptor.level, domain, _threads[thread], time,
+                    deferred::format(descriptor.format.c_str(), args.data(), args.size()));
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+    return _stream.eof();
+}
+
+bool DeferredLogReader::decode(std::ostream &output, LogFormatter::TimeResolution resolution)
+{
+    return readRecords([&output, resolution](LogLevel level, const std::string &domain, const std::string &threadId,
+                                             uint64_t time, const std::string &message) {
+        const unsigned long seconds = static_cast<unsigned long>(time / 1000000000ULL);
+        char prefix[128];
+        if (resolution == LogFormatter::TimeResolution::MILLISECONDS)
+        {
+            snprintf(prefix, sizeof(prefix), "%lu.%03u %s [", seconds,
+                     static_cast<unsigned>(time / 1000000ULL % 1000), threadId.c_str());
+        }
+        else
+        {
+            snprintf(prefix, sizeof(prefix), "%lu %s [", seconds, threadId.c_str());
+        }
+        output << prefix << logLevelToChar(level) << "] " << domain << ": " << message << '\n';
+    });
+}
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,466 @@
+#include "file_logger.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <zlib.h>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+// producers wait for the writer only when it is this many batches behind
+constexpr std::size_t cMaxPendingBatches = 8;
+constexpr std::size_t cCopyBufferSize = 64 * 1024;
+constexpr std::chrono::milliseconds cWaitPeriod{10};
+const char *const cCompressedSuffix = ".gz";
+
+std::size_t sizeFromString(const std::string &str)
+{
+    std::size_t pos = 0;
+    unsigned long long value = std::stoull(str, &pos);
+    const std::string suffix = str.substr(pos);
+    if (suffix == "K" || suffix == "k")
+    {
+        value <<= 10;
+    }
+    else if (suffix == "M" || suffix == "m")
+    {
+        value <<= 20;
+    }
+    else if (suffix == "G" || suffix == "g")
+    {
+        value <<= 30;
+    }
+    else if (!suffix.empty())
+    {
+        throw std::logic_error("invalid size suffix '" + suffix + "'");
+    }
+    return static_cast<std::size_t>(value);
+}
+
+std::string rotatedName(const std::string &path)
+{
+    struct timeval now;
+    gettimeofday(&now, nullptr);
+
+    struct stat st;
+    std::string name;
+    // a name is never reused, so the names sort in the order of rotation
+    do
+    {
+        struct tm tm;
+        // UTC, so the names keep sorting in time order across DST and time zone changes
+        gmtime_r(&now.tv_sec, &tm);
+        char stamp[64];
+        size_t length = strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", &tm);
+        snprintf(stamp + length, sizeof(stamp) - length, ".%06ld", static_cast<long>(now.tv_usec));
+        name = path + "." + stamp;
+
+        if (++now.tv_usec == 1000000)
+        {
+            now.tv_usec = 0;
+            ++now.tv_sec;
+        }
+    } while (stat(name.c_str(), &st) == 0 || stat((name + cCompressedSuffix).c_str(), &st) == 0);
+    return name;
+}
+
+// checks that the suffix is the one rotatedName() adds: "YYYYmmdd-HHMMSS.uuuuuu" with optional compression
+bool isRotatedSuffix(const std::string &suffix)
+{
+    static const char cPattern[] = "dddddddd-dddddd.dddddd";
+    const std::size_t length = sizeof(cPattern) - 1;
+    if (suffix.size() != length && suffix != suffix.substr(0, length) + cCompressedSuffix)
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < length; ++i)
+    {
+        if (cPattern[i] == 'd' ? !isdigit(static_cast<unsigned char>(suffix[i])) : suffix[i] != cPattern[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+} // namespace
+
+FileLogger::FileLogger(const settings_t &settings)
+    : _settings(settings)
+    , _formatter(settings.resolution)
+{
+    if (_settings.path.empty())
+    {
+        throw std::invalid_argument(std::string(__func__) + "(): path");
+    }
+    openFile();
+    _writer = std::thread(&FileLogger::writer, this);
+    _housekeeper = std::thread(&FileLogger::housekeeper, this);
+}
+
+FileLogger::~FileLogger()
+{
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stop = true;
+    }
+    _dataAvailable.notify_one();
+    if (_writer.joinable())
+    {
+        _writer.join();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_housekeepingMutex);
+        _housekeepingStop = true;
+    }
+    _rotated.notify_one();
+    if (_housekeeper.joinable())
+    {
+        _housekeeper.join();
+    }
+
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+}
+
+void FileLogger::log(LogLevel level, const LogContext &context, const char *msg)
+{
+    const std::string &line = _formatter.format(level, context, msg);
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (_pending.size() >= _settings.bufferSize * cMaxPendingBatches && !_stop)
+    {
+        // the disk doesn't keep up, memory is not unlimited
+        _dataAvailable.notify_one();
+        _written.wait_for(lock, cWaitPeriod);
+    }
+    _pending.append(line);
+    if (_pending.size() >= _settings.bufferSize)
+    {
+        _dataAvailable.notify_one();
+    }
+}
+
+void FileLogger::flush()
+{
+    if (std::this_thread::get_id() == _writer.get_id())
+    {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(_mutex);
+    const uint64_t ticket = ++_flushRequested;
+    _dataAvailable.notify_one();
+    while (_flushed < ticket && !_stop)
+    {
+        _written.wait_for(lock, cWaitPeriod);
+    }
+}
+
+void FileLogger::rotate()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _rotateRequested = true;
+    _dataAvailable.notify_one();
+}
+
+FileLogger::settings_t FileLogger::settingsFromString(const std::string &str)
+{
+    settings_t settings;
+    std::size_t begin = 0;
+    bool first = true;
+    while (begin <= str.size())
+    {
+        std::size_t end = str.find(',', begin);
+        if (end == std::string::npos)
+        {
+            end = str.size();
+        }
+        const std::string option = str.substr(begin, end - begin);
+        begin = end + 1;
+
+        if (first)
+        {
+            settings.path = option;
+            first = false;
+            continue;
+        }
+
+        const std::size_t delim = option.find('=');
+        if (delim == std::string::npos)
+        {
+            throw std::logic_error("invalid file logger option '" + option + "'");
+        }
+        const std::string name = option.substr(0, delim);
+        const std::string value = option.substr(delim + 1);
+        if (name == "size")
+        {
+            settings.maxFileSize = sizeFromString(value);
+        }
+        else if (name == "period")
+        {
+            settings.rotationPeriod = std::chrono::seconds(std::stoul(value));
+        }
+        else if (name == "files")
+        {
+            settings.maxFiles = std::stoul(value);
+        }
+        else if (name == "bytes")
+        {
+            settings.maxBytes = sizeFromString(value);
+        }
+        else if (name == "compress")
+        {
+            settings.compress = std::stoi(value) != 0;
+        }
+        else
+        {
+            throw std::logic_error("unknown file logger option '" + name + "'");
+        }
+    }
+    if (settings.path.empty())
+    {
+        throw std::logic_error("file logger path is empty");
+    }
+    return settings;
+}
+
+void FileLogger::writer()
+{
+    std::string batch;
+    std::unique_lock<std::mutex> lock(_mutex);
+    for (;;)
+    {
+        _dataAvailable.wait_for(lock, _settings.flushPeriod, [this] {
+            return _stop || _rotateRequested || _flushRequested != _flushed ||
+                   _pending.size() >= _settings.bufferSize;
+        });
+
+        batch.swap(_pending);
+        const bool rotate = _rotateRequested;
+        _rotateRequested = false;
+        const uint64_t ticket = _flushRequested;
+        const bool stop = _stop;
+        lock.unlock();
+
+        writeBatch(batch);
+        batch.clear();
+        if (rotate || rotationRequired())
+        {
+            rotateFile();
+        }
+
+        lock.lock();
+        _flushed = ticket;
+        _written.notify_all();
+        if (stop && _pending.empty())
+        {
+            break;
+        }
+    }
+}
+
+void FileLogger::housekeeper()
+{
+    std::unique_lock<std::mutex> lock(_housekeepingMutex);
+    for (;;)
+    {
+        if (_segments.empty())
+        {
+            if (_housekeepingStop)
+            {
+                break;
+            }
+            _rotated.wait_for(lock, _settings.flushPeriod);
+            continue;
+        }
+
+        const std::string segment = _segments.front();
+        _segments.pop_front();
+        lock.unlock();
+
+        if (_settings.compress)
+        {
+            compress(segment);
+        }
+        enforceRetention();
+
+        lock.lock();
+    }
+}
+
+void FileLogger::openFile()
+{
+    _fd = ::open(_settings.path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (_fd < 0)
+    {
+        throw std::system_error(errno, std::generic_category(), _settings.path);
+    }
+    struct stat st;
+    _fileSize = fstat(_fd, &st) == 0 ? static_cast<std::size_t>(st.st_size) : 0;
+    _opened = std::chrono::steady_clock::now();
+}
+
+void FileLogger::writeBatch(const std::string &batch)
+{
+    const char *data = batch.data();
+    std::size_t left = batch.size();
+    while (left && _fd >= 0)
+    {
+        ssize_t written = ::write(_fd, data, left);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // the logger can't report its own failures through the log
+            fprintf(stderr, "FileLogger: write to %s failed: %s\n", _settings.path.c_str(), strerror(errno));
+            return;
+        }
+        data += written;
+        left -= static_cast<std::size_t>(written);
+        _fileSize += static_cast<std::size_t>(written);
+    }
+}
+
+bool FileLogger::rotationRequired() const
+{
+    if (_settings.maxFileSize && _fileSize >= _settings.maxFileSize)
+    {
+        return true;
+    }
+    return _settings.rotationPeriod.count() && _fileSize &&
+           std::chrono::steady_clock::now() - _opened >= _settings.rotationPeriod;
+}
+
+void FileLogger::rotateFile()
+{
+    const std::string segment = rotatedName(_settings.path);
+    if (::rename(_settings.path.c_str(), segment.c_str()) != 0)
+    {
+        fprintf(stderr, "FileLogger: rename of %s failed: %s\n", _settings.path.c_str(), strerror(errno));
+        return;
+    }
+    ::close(_fd);
+    _fd = -1;
+    try
+    {
+        openFile();
+    }
+    catch (const std::system_error &e)
+    {
+        fprintf(stderr, "FileLogger: %s\n", e.what());
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_housekeepingMutex);
+        _segments.push_back(segment);
+    }
+    _rotated.notify_one();
+}
+
+void FileLogger::compress(const std::string &path)
+{
+    const std::string compressed = path + cCompressedSuffix;
+    FILE *input = fopen(path.c_str(), "rb");
+    if (!input)
+    {
+        return;
+    }
+    gzFile output = gzopen(compressed.c_str(), "wb");
+    if (!output)
+    {
+        fclose(input);
+        return;
+    }
+
+    std::vector<char> buffer(cCopyBufferSize);
+    bool success = true;
+    std::size_t length;
+    while ((length = fread(buffer.data(), 1, buffer.size(), input)) > 0)
+    {
+        if (gzwrite(output, buffer.data(), static_cast<unsigned>(length)) != static_cast<int>(length))
+        {
+            success = false;
+            break;
+        }
+    }
+    success = success && !ferror(input);
+    fclose(input);
+    success = gzclose(output) == Z_OK && success;
+
+    // the original is kept if anything went wrong
+    ::unlink(success ? path.c_str() : compressed.c_str());
+}
+
+void FileLogger::enforceRetention()
+{
+    if (!_settings.maxFiles && !_settings.maxBytes)
+    {
+        return;
+    }
+
+    const std::size_t slash = _settings.path.find_last_of('/');
+    const std::string directory = slash == std::string::npos ? "." : _settings.path.substr(0, slash + 1);
+    const std::string prefix = (slash == std::string::npos ? _settings.path : _settings.path.substr(slash + 1)) + ".";
+
+    DIR *dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        return;
+    }
+    std::vector<std::pair<std::string, std::size_t>> segments;
+    while (struct dirent *entry = readdir(dir))
+    {
+        const std::string name = entry->d_name;
+        // other files of the same base name, like backups, are not segments
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0 ||
+            !isRotatedSuffix(name.substr(prefix.size())))
+        {
+            continue;
+        }
+        const std::string path = slash == std::string::npos ? name : directory + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+        {
+            segments.emplace_back(path, static_cast<std::size_t>(st.st_size));
+        }
+    }
+    closedir(dir);
+
+    // the newest segments go first
+    std::sort(segments.begin(), segments.end(),
+              [](const std::pair<std::string, std::size_t> &a, const std::pair<std::string, std::size_t> &b) {
+                  return a.first > b.first;
+              });
+
+    std::size_t count = 0;
+    std::size_t bytes = 0;
+    for (const auto &segment : segments)
+    {
+        ++count;
+        bytes += segment.second;
+        if ((_settings.maxFiles && count > _settings.maxFiles) || (_settings.maxBytes && bytes > _settings.maxBytes))
+        {
+            ::unlink(segment.first.c_str());
+        }
+    }
+}
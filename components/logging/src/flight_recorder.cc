@@ -0,0 +1,300 @@
+#include "flight_recorder.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace softeq::common::logging;
+
+/*
+  Beginning of the mapping, it describes the ring for a reader of the memfd
+*/
+struct FlightRecorder::Header
+{
+    char magic[8];
+    uint32_t records;
+    uint32_t recordSize;
+    std::atomic<uint64_t> next; // index of the next line, the slot is index % records
+};
+
+/*
+  Slot of a line, the text follows it. The sequence is 2 * index + 1 while the line of the index is
+  being written and 2 * index + 2 once it is complete
+*/
+struct FlightRecorder::Slot
+{
+    std::atomic<uint64_t> sequence;
+    uint32_t length;
+    uint32_t reserved;
+};
+
+namespace
+{
+const char cMagic[8] = {'S', 'C', 'F', 'R', 'E', 'C', '1', '\n'};
+constexpr std::size_t cHeaderSize = 64;
+constexpr std::size_t cMaxRecordSize = 64 * 1024;
+const int cCrashSignals[] = {SIGSEGV, SIGBUS, SIGILL, SIGFPE, SIGABRT};
+constexpr std::size_t cCrashSignalsCount = sizeof(cCrashSignals) / sizeof(cCrashSignals[0]);
+
+std::atomic<const FlightRecorder *> gCrashRecorder{nullptr};
+std::atomic<bool> gCrashDumped{false};
+struct sigaction gPreviousActions[cCrashSignalsCount];
+std::once_flag gHandlersInstalled;
+
+void writeAll(int fd, const char *data, std::size_t length) noexcept
+{
+    while (length)
+    {
+        ssize_t written = ::write(fd, data, length);
+        if (written < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += written;
+        length -= static_cast<std::size_t>(written);
+    }
+}
+
+void writeString(int fd, const char *str) noexcept
+{
+    writeAll(fd, str, strlen(str));
+}
+
+void crashHandler(int signum, siginfo_t *, void *)
+{
+    const int savedErrno = errno;
+    // a crash inside the dump, or the crash path which has dumped before raising the signal, doesn't dump again
+    const FlightRecorder *recorder = gCrashRecorder.load();
+    if (recorder)
+    {
+        recorder->dumpOnce(STDERR_FILENO);
+    }
+
+    // the previous handler gets the signal once this one returns
+    for (std::size_t i = 0; i < cCrashSignalsCount; ++i)
+    {
+        if (cCrashSignals[i] == signum)
+        {
+            sigaction(signum, &gPreviousActions[i], nullptr);
+        }
+    }
+    raise(signum);
+    errno = savedErrno;
+}
+
+void installCrashHandlers()
+{
+    struct sigaction action;
+    std::memset(&action, 0, sizeof action);
+    action.sa_sigaction = crashHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_SIGINFO | SA_ONSTACK;
+    for (std::size_t i = 0; i < cCrashSignalsCount; ++i)
+    {
+        sigaction(cCrashSignals[i], &action, &gPreviousActions[i]);
+    }
+}
+
+bool boolFromString(const std::string &value)
+{
+    if (value == "1")
+    {
+        return true;
+    }
+    if (value == "0")
+    {
+        return false;
+    }
+    throw std::logic_error("invalid boolean value '" + value + "'");
+}
+} // namespace
+
+FlightRecorder::FlightRecorder(const settings_t &settings)
+    : _settings(settings)
+    , _formatter(settings.resolution)
+{
+    if (!_settings.records)
+    {
+        throw std::invalid_argument(std::string(__func__) + "(): records");
+    }
+    if (_settings.recordSize <= sizeof(Slot) || _settings.recordSize > cMaxRecordSize)
+    {
+        throw std::invalid_argument(std::string(__func__) + "(): recordSize");
+    }
+
+    // slots are aligned for their atomic sequence numbers
+    const std::size_t recordSize = (_settings.recordSize + alignof(Slot) - 1) / alignof(Slot) * alignof(Slot);
+    _size = cHeaderSize + recordSize * _settings.records;
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    if (_settings.memfd)
+    {
+        _fd = memfd_create("sc-log-recorder", MFD_CLOEXEC);
+        if (_fd < 0 || ftruncate(_fd, static_cast<off_t>(_size)) != 0)
+        {
+            const int error = errno;
+            if (_fd >= 0)
+            {
+                ::close(_fd);
+            }
+            throw std::system_error(error, std::generic_category(), "memfd");
+        }
+        flags = MAP_SHARED;
+    }
+    _memory = mmap(nullptr, _size, PROT_READ | PROT_WRITE, flags, _fd, 0);
+    if (_memory == MAP_FAILED)
+    {
+        const int error = errno;
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+        throw std::system_error(error, std::generic_category(), "mmap");
+    }
+
+    // the mapping is zero filled, so every slot starts empty
+    _header = new (_memory) Header;
+    std::memcpy(_header->magic, cMagic, sizeof(cMagic));
+    _header->records = static_cast<uint32_t>(_settings.records);
+    _header->recordSize = static_cast<uint32_t>(recordSize);
+    _header->next.store(0, std::memory_order_relaxed);
+    for (std::size_t i = 0; i < _settings.records; ++i)
+    {
+        new (slot(i)) Slot{{0}, 0, 0};
+    }
+}
+
+FlightRecorder::~FlightRecorder()
+{
+    const FlightRecorder *self = this;
+    gCrashRecorder.compare_exchange_strong(self, nullptr);
+    munmap(_memory, _size);
+    if (_fd >= 0)
+    {
+        ::close(_fd);
+    }
+}
+
+void FlightRecorder::log(LogLevel level, const LogContext &context, const char *msg)
+{
+    if (level > _settings.level)
+    {
+        return;
+    }
+    const std::string &line = _formatter.format(level, context, msg);
+
+    const uint64_t index = _header->next.fetch_add(1, std::memory_order_relaxed);
+    Slot *target = slot(index);
+    target->sequence.store(index * 2 + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const std::size_t capacity = _header->recordSize - sizeof(Slot);
+    const std::size_t length = std::min(line.size(), capacity);
+    char *text = reinterpret_cast<char *>(target + 1);
+    std::memcpy(text, line.data(), length);
+    if (length < line.size())
+    {
+        text[length - 1] = '\n';
+    }
+    target->length = static_cast<uint32_t>(length);
+    target->sequence.store(index * 2 + 2, std::memory_order_release);
+}
+
+void FlightRecorder::dump(int fd) const noexcept
+{
+    const uint64_t next = _header->next.load(std::memory_order_acquire);
+    const uint64_t first = next > _settings.records ? next - _settings.records : 0;
+    const std::size_t capacity = _header->recordSize - sizeof(Slot);
+
+    writeString(fd, "--- flight recorder: last log records ---\n");
+    for (uint64_t index = first; index < next; ++index)
+    {
+        const Slot *source = slot(index);
+        // the line is being written or has been overwritten already
+        if (source->sequence.load(std::memory_order_acquire) != index * 2 + 2)
+        {
+            continue;
+        }
+        writeAll(fd, reinterpret_cast<const char *>(source + 1), std::min<std::size_t>(source->length, capacity));
+    }
+    writeString(fd, "--- flight recorder: end ---\n");
+}
+
+bool FlightRecorder::dumpOnce(int fd) const noexcept
+{
+    if (gCrashDumped.exchange(true))
+    {
+        return false;
+    }
+    dump(fd);
+    return true;
+}
+
+void FlightRecorder::dumpOnCrash(const FlightRecorder *recorder)
+{
+    gCrashRecorder.store(recorder);
+    if (recorder)
+    {
+        std::call_once(gHandlersInstalled, installCrashHandlers);
+    }
+}
+
+FlightRecorder::settings_t FlightRecorder::settingsFromString(const std::string &str)
+{
+    settings_t settings;
+    std::stringstream stream(str);
+    std::string option;
+    while (getline(stream, option, ','))
+    {
+        const std::size_t delim = option.find('=');
+        if (delim == std::string::npos)
+        {
+            throw std::logic_error("invalid flight recorder option '" + option + "'");
+        }
+        const std::string name = option.substr(0, delim);
+        const std::string value = option.substr(delim + 1);
+        if (name == "records")
+        {
+            settings.records = std::stoul(value);
+        }
+        else if (name == "size")
+        {
+            settings.recordSize = std::stoul(value);
+        }
+        else if (name == "level")
+        {
+            settings.level = logLevelFromString(value);
+        }
+        else if (name == "memfd")
+        {
+            settings.memfd = boolFromString(value);
+        }
+        else if (name == "handlers")
+        {
+            settings.crashHandlers = boolFromString(value);
+        }
+        else
+        {
+            throw std::logic_error("unknown flight recorder option '" + name + "'");
+        }
+    }
+    return settings;
+}
+
+FlightRecorder::Slot *FlightRecorder::slot(uint64_t index) const noexcept
+{
+    return reinterpret_cast<Slot *>(static_cast<char *>(_memory) + cHeaderSize +
+                                    (index % _settings.records) * _header->recordSize);
+}
@@ -1,49 +1,203 @@
 #include "log.hh"
+#include "async_logger.hh"
 #include "console_logger.hh"
+#include "file_logger.hh"
+#include "flight_recorder.hh"
 
+#include <algorithm>
+#include <cinttypes>
 #include <cstring>
 #include <csignal>
 #include <sstream>
+#include <stdexcept>
 #include <iostream>
 
 using namespace softeq::common::logging;
 
+namespace
+{
+// repetitions of a message are reported at least this often even if it keeps repeating
+constexpr std::chrono::seconds cRepeatPeriod{30};
+// a thread which exits after the logger is destroyed must not report its repetitions
+std::atomic<bool> gLogAlive{false};
+
+int64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+int64_t intervalOf(unsigned rate)
+{
+    return rate ? static_cast<int64_t>(1000000000 / rate) : 0;
+}
+
+std::size_t domainHash(const char *domain)
+{
+    std::size_t length;
+    return static_cast<std::size_t>(softeq::common::stdutils::fnv1a(domain, length));
+}
+
+void parseRate(const std::string &value, unsigned &rate, unsigned &burst)
+{
+    const std::size_t slash = value.find('/');
+    rate = static_cast<unsigned>(std::stoul(value.substr(0, slash)));
+    burst = slash == std::string::npos ? 0 : static_cast<unsigned>(std::stoul(value.substr(slash + 1)));
+}
+} // namespace
+
+/*
+  The last message written by the thread, it is compared with the next one to collapse repetitions
+*/
+struct Log::LastMessage
+{
+    ~LastMessage()
+    {
+        if (gLogAlive)
+        {
+            report();
+        }
+    }
+
+    void report()
+    {
+        if (repeats)
+        {
+            char msg[64];
+            snprintf(msg, sizeof(msg), "last message repeated %" PRIu64 " times", repeats);
+            repeats = 0;
+            since = std::chrono::steady_clock::now();
+            log().Write(level, LogContext(domain, std::this_thread::get_id()), msg);
+        }
+    }
+
+    bool valid{false};
+    LogLevel level{LogLevel::NONE};
+    std::string domain;
+    std::string message;
+    uint64_t repeats{0};
+    std::chrono::steady_clock::time_point since;
+};
+
+thread_local Log::LastMessage Log::_lastMessage;
+
 Log::Log()
-    : _logger(new ConsoleLogger())
 {
+    LogFormatter::TimeResolution resolution = LogFormatter::TimeResolution::SECONDS;
     try
     {
-        char *filter = getenv("SC_LOG_FILTER");
+        char *timeResolution = getenv("SC_LOG_TIME_RESOLUTION");
 
-        if (filter)
+        if (timeResolution)
         {
-            std::stringstream stream_filter(filter);
-            std::string single_filter;
-            while (getline(stream_filter, single_filter, ','))
+            resolution = LogFormatter::timeResolutionFromString(timeResolution);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Logger time resolution error: " << e.what() << "\nfix your SC_LOG_TIME_RESOLUTION envvar\n";
+    }
+    _logger.reset(new ConsoleLogger(resolution));
+    try
+    {
+        char *file = getenv("SC_LOG_FILE");
+
+        if (file)
+        {
+            FileLogger::settings_t settings = FileLogger::settingsFromString(file);
+            settings.resolution = resolution;
+            _logger.reset(new FileLogger(settings));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Logger file error: " << e.what() << "\nfix your SC_LOG_FILE envvar\n";
+    }
+    std::unique_ptr<Filter> filter(new Filter{LogLevel::DEBUG, {}});
+    char *filterEnv = getenv("SC_LOG_FILTER");
+    if (filterEnv)
+    {
+        // entries are applied one by one so a malformed one doesn't discard the others
+        std::stringstream entries(filterEnv);
+        std::string entry;
+        while (getline(entries, entry, ','))
+        {
+            try
             {
-                size_t delim_pos = single_filter.find(':');
-                if (delim_pos == std::string::npos)
-                {
-                    _level = logLevelFromString(single_filter);
-                }
-                else
+                Filter parsed = parseFilter(entry, filter->level);
+                filter->level = parsed.level;
+                for (const auto &domain : parsed.domains)
                 {
-                    _domain_filter[single_filter.substr(0, delim_pos)] =
-                        logLevelFromString(single_filter.substr(delim_pos + 1));
+                    filter->domains[domain.first] = domain.second;
                 }
             }
+            catch (const std::exception &e)
+            {
+                std::cerr << "Logger filter error: " << e.what() << "\nfix \"" << entry
+                          << "\" in your SC_LOG_FILTER envvar\n";
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_filterMutex);
+        publish(std::move(filter));
+    }
+    try
+    {
+        // messages longer than 1023 characters are cut by the asynchronous logger, see AsyncLogger
+        char *async = getenv("SC_LOG_ASYNC");
+
+        if (async)
+        {
+            AsyncLogger::settings_t settings;
+            settings.policy = AsyncLogger::overflowPolicyFromString(async);
+            _logger.reset(new AsyncLogger(std::move(_logger), settings));
         }
     }
     catch (const std::exception &e)
     {
-        std::cerr << "Logger filter error: " << e.what() << "\nfix your SC_LOG_FILTER envvar\n";
+        std::cerr << "Logger async mode error: " << e.what() << "\nfix your SC_LOG_ASYNC envvar\n";
+    }
+    try
+    {
+        char *rateLimitEnv = getenv("SC_LOG_RATE_LIMIT");
+
+        if (rateLimitEnv)
+        {
+            rateLimit(rateLimitFromString(rateLimitEnv));
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Logger rate limit error: " << e.what() << "\nfix your SC_LOG_RATE_LIMIT envvar\n";
+    }
+    try
+    {
+        char *recorder = getenv("SC_LOG_RECORDER");
+
+        if (recorder)
+        {
+            FlightRecorder::settings_t settings = FlightRecorder::settingsFromString(recorder);
+            settings.resolution = resolution;
+            startRecorder(settings);
+        }
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Logger flight recorder error: " << e.what() << "\nfix your SC_LOG_RECORDER envvar\n";
     }
     _raise_sigtrap_on_error = (getenv("SC_DEBUG_ON_ERROR") != NULL);
     _raise_sigtrap_on_warning = (getenv("SC_DEBUG_ON_WARNING") != NULL);
+    filterChanged();
+    gLogAlive = true;
 }
 
 Log::~Log()
 {
+    gLogAlive = false;
+    delete _filter.load(std::memory_order_relaxed);
+    delete _sinks.load(std::memory_order_relaxed);
 }
 
 Log &Log::get()
@@ -71,37 +225,396 @@ void Log::Message(LogLevel level, const char *domain, const char *format, ...)
     va_end(args);
 }
 
+void Log::Message(LogSite &site, LogLevel level, const char *domain, const char *format, ...)
+{
+    const bool write = level <= levelOf(site, domain) && admit(&site, level, domain);
+    if (write || recorded(level))
+    {
+        va_list args;
+        va_start(args, format);
+        output(level, domain, write, format, args);
+        va_end(args);
+    }
+
+    if (trapRequested(level))
+    {
+        raise(SIGTRAP);
+    }
+}
+
 void Log::MessageV(LogLevel level, const char *domain, const char *format, va_list args)
 {
-    LogLevel severity_level = _level;
+    const bool write = level <= levelOf(domain) && admit(nullptr, level, domain);
+    if (write || recorded(level))
+    {
+        output(level, domain, write, format, args);
+    }
+
+    if (trapRequested(level))
+    {
+        raise(SIGTRAP);
+    }
+}
+
+LogLevel Log::levelOf(const std::map<std::string, LogLevel> &filter, LogLevel level, const char *domain)
+{
     if (domain != NULL)
     {
-        const auto it = _domain_filter.find(domain);
-        if (it != _domain_filter.end())
-            severity_level = it->second;
+        const auto it = filter.find(domain);
+        if (it != filter.end())
+            return it->second;
     }
-    else
+    return level;
+}
+
+LogLevel Log::levelOf(const char *domain) const
+{
+    GracePeriod::Reader reader(_grace);
+    const Filter *filter = _filter.load(std::memory_order_acquire);
+    LogLevel level = levelOf(filter->domains, filter->level, domain);
+    for (const Sink &sink : *_sinks.load(std::memory_order_acquire))
     {
-        domain = "";
+        level = std::max(level, levelOf(sink.domains, sink.level, domain));
     }
+    return level;
+}
 
-    if (level <= severity_level)
+bool Log::admit(LogSite *site, LogLevel level, const char *domain)
+{
+    if (!_limited.load(std::memory_order_relaxed) || level == LogLevel::FATAL)
     {
-        char buf[2048];
-        vsnprintf(buf, sizeof(buf), format, args);
+        return true;
+    }
 
-        LogContext logContext(domain, std::this_thread::get_id());
-        _logger->log(level, logContext, buf);
+    const int64_t now = nowNs();
+    const int64_t siteInterval = _siteInterval.load(std::memory_order_relaxed);
+    if (site && siteInterval &&
+        !site->limiter().take(now, siteInterval, _siteBurst.load(std::memory_order_relaxed)))
+    {
+        _rateLimited.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    const int64_t domainInterval = _domainInterval.load(std::memory_order_relaxed);
+    RateLimiter *domainLimiter = domainInterval ? &_domainLimiters[domainHash(domain) % cDomainLimiters] : nullptr;
+    if (domainLimiter && !domainLimiter->take(now, domainInterval, _domainBurst.load(std::memory_order_relaxed)))
+    {
+        _rateLimited.fetch_add(1, std::memory_order_relaxed);
+        return false;
     }
 
-    if ((_raise_sigtrap_on_error && level == LogLevel::ERROR) ||
-        (_raise_sigtrap_on_warning && level == LogLevel::WARNING))
+    uint64_t suppressed = domainLimiter ? domainLimiter->suppressed() : 0;
+    if (site)
     {
-        raise(SIGTRAP);
+        suppressed += site->limiter().suppressed();
+    }
+    if (suppressed)
+    {
+        char msg[64];
+        snprintf(msg, sizeof(msg), "%" PRIu64 " messages suppressed by rate limit", suppressed);
+        Write(level, LogContext(domain ? domain : "", std::this_thread::get_id()), msg);
+    }
+    return true;
+}
+
+void Log::output(LogLevel level, const char *domain, bool write, const char *format, va_list args)
+{
+    char buf[2048];
+    vsnprintf(buf, sizeof(buf), format, args);
+
+    const LogContext context(domain ? domain : "", std::this_thread::get_id());
+    if (recorded(level))
+    {
+        FlightRecorder *recorder = _recorder.load(std::memory_order_acquire);
+        if (recorder)
+        {
+            recorder->log(level, context, buf);
+        }
+    }
+    if (write && !collapsed(level, context._name.c_str(), buf))
+    {
+        Write(level, context, buf);
     }
 }
 
+bool Log::collapsed(LogLevel level, const char *domain, const char *msg)
+{
+    LastMessage &last = _lastMessage;
+    if (!_collapse.load(std::memory_order_relaxed) || level == LogLevel::FATAL)
+    {
+        // repetitions collected before collapsing was disabled
+        last.report();
+        last.valid = false;
+        return false;
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (last.valid && last.level == level && last.domain == domain && last.message == msg)
+    {
+        ++last.repeats;
+        _repeated.fetch_add(1, std::memory_order_relaxed);
+        if (now - last.since >= cRepeatPeriod)
+        {
+            last.report();
+        }
+        return true;
+    }
+
+    last.report();
+    last.valid = true;
+    last.level = level;
+    last.domain = domain;
+    last.message = msg;
+    last.since = now;
+    return false;
+}
+
+void Log::Write(LogLevel level, const LogContext &context, const char *msg)
+{
+    const char *domain = context._name.c_str();
+    bool accepted;
+    {
+        GracePeriod::Reader reader(_grace);
+        const Filter *filter = _filter.load(std::memory_order_acquire);
+        accepted = level <= levelOf(filter->domains, filter->level, domain);
+    }
+    if (accepted)
+    {
+        _logger->log(level, context, msg);
+    }
+    {
+        GracePeriod::Reader reader(_grace);
+        for (const Sink &sink : *_sinks.load(std::memory_order_acquire))
+        {
+            if (level <= levelOf(sink.domains, sink.level, domain))
+            {
+                sink.logger->log(level, context, msg);
+            }
+        }
+    }
+
+    if (level == LogLevel::FATAL)
+    {
+        // the process is likely to die, asynchronous loggers must not lose the reason
+        flush();
+    }
+}
+
+void Log::filterChanged()
+{
+    std::lock_guard<std::mutex> lock(_filterMutex);
+    const Filter *current = _filter.load(std::memory_order_acquire);
+    LogLevel maxLevel = current->level;
+    for (const auto &filter : current->domains)
+    {
+        maxLevel = std::max(maxLevel, filter.second);
+    }
+    {
+        GracePeriod::Reader reader(_grace);
+        for (const Sink &sink : *_sinks.load(std::memory_order_acquire))
+        {
+            maxLevel = std::max(maxLevel, sink.level);
+            for (const auto &filter : sink.domains)
+            {
+                maxLevel = std::max(maxLevel, filter.second);
+            }
+        }
+    }
+    maxLevel = std::max(maxLevel, static_cast<LogLevel>(_recorderLevel.load(std::memory_order_relaxed)));
+    if (_raise_sigtrap_on_warning)
+    {
+        maxLevel = std::max(maxLevel, LogLevel::WARNING);
+    }
+    else if (_raise_sigtrap_on_error)
+    {
+        maxLevel = std::max(maxLevel, LogLevel::ERROR);
+    }
+
+    _maxLevel.store(static_cast<int>(maxLevel), std::memory_order_relaxed);
+    _generation.fetch_add(1, std::memory_order_release);
+}
+
+void Log::flush()
+{
+    _lastMessage.report();
+    _logger->flush();
+    GracePeriod::Reader reader(_grace);
+    for (const Sink &sink : *_sinks.load(std::memory_order_acquire))
+    {
+        sink.logger->flush();
+    }
+}
+
+Log::SinkId Log::addSink(LoggerInterface::UPtr &&sink)
+{
+    return addSink(std::move(sink), sink_settings_t());
+}
+
+Log::SinkId Log::addSink(LoggerInterface::UPtr &&sink, const sink_settings_t &settings)
+{
+    if (!sink)
+    {
+        throw std::invalid_argument(std::string(__func__) + "(): sink");
+    }
+
+    Sink entry;
+    entry.level = settings.level;
+    entry.domains = settings.domains;
+    if (settings.async)
+    {
+        entry.logger.reset(new AsyncLogger(std::move(sink), settings.queue));
+    }
+    else
+    {
+        entry.logger = std::move(sink);
+    }
+
+    std::lock_guard<std::mutex> lock(_sinksMutex);
+    const SinkId id = ++_lastSinkId;
+    entry.id = id;
+    std::unique_ptr<Sinks> sinks(new Sinks(*_sinks.load(std::memory_order_relaxed)));
+    sinks->push_back(std::move(entry));
+    publish(std::move(sinks));
+    filterChanged();
+    return id;
+}
+
+bool Log::removeSink(SinkId id)
+{
+    std::lock_guard<std::mutex> lock(_sinksMutex);
+    std::unique_ptr<Sinks> sinks(new Sinks(*_sinks.load(std::memory_order_relaxed)));
+    auto it = std::find_if(sinks->begin(), sinks->end(), [id](const Sink &sink) { return sink.id == id; });
+    if (it == sinks->end())
+    {
+        return false;
+    }
+    sinks->erase(it);
+    publish(std::move(sinks));
+    filterChanged();
+    return true;
+}
+
 void Log::level(LogLevel level)
 {
-    _level = level;
+    {
+        std::lock_guard<std::mutex> lock(_filterMutex);
+        std::unique_ptr<Filter> filter(new Filter(*_filter.load(std::memory_order_relaxed)));
+        filter->level = level;
+        publish(std::move(filter));
+    }
+    filterChanged();
+}
+
+void Log::filter(const std::string &filter)
+{
+    {
+        std::lock_guard<std::mutex> lock(_filterMutex);
+        // the level is kept unless the string sets it, domain filters are replaced
+        const LogLevel level = _filter.load(std::memory_order_relaxed)->level;
+        publish(std::unique_ptr<Filter>(new Filter(parseFilter(filter, level))));
+    }
+    filterChanged();
+}
+
+void Log::rateLimit(const rate_limit_t &settings)
+{
+    std::lock_guard<std::mutex> lock(_rateLimitMutex);
+    _rateLimit = settings;
+    _siteInterval.store(intervalOf(settings.siteRate), std::memory_order_relaxed);
+    _siteBurst.store(settings.siteBurst ? settings.siteBurst : settings.siteRate, std::memory_order_relaxed);
+    _domainInterval.store(intervalOf(settings.domainRate), std::memory_order_relaxed);
+    _domainBurst.store(settings.domainBurst ? settings.domainBurst : settings.domainRate, std::memory_order_relaxed);
+    _collapse.store(settings.collapse, std::memory_order_relaxed);
+    _limited.store(settings.siteRate || settings.domainRate, std::memory_order_relaxed);
+}
+
+Log::rate_limit_t Log::rateLimit() const
+{
+    std::lock_guard<std::mutex> lock(_rateLimitMutex);
+    return _rateLimit;
+}
+
+Log::rate_limit_t Log::rateLimitFromString(const std::string &str)
+{
+    rate_limit_t settings;
+    std::stringstream stream(str);
+    std::string option;
+    while (getline(stream, option, ','))
+    {
+        const std::size_t delim = option.find('=');
+        const std::string name = option.substr(0, delim);
+        if (name == "collapse" && delim == std::string::npos)
+        {
+            settings.collapse = true;
+        }
+        else if (name == "site" && delim != std::string::npos)
+        {
+            parseRate(option.substr(delim + 1), settings.siteRate, settings.siteBurst);
+        }
+        else if (name == "domain" && delim != std::string::npos)
+        {
+            parseRate(option.substr(delim + 1), settings.domainRate, settings.domainBurst);
+        }
+        else
+        {
+            throw std::logic_error("invalid rate limit option '" + option + "'");
+        }
+    }
+    return settings;
+}
+
+void Log::startRecorder(const FlightRecorder::settings_t &settings)
+{
+    {
+        std::lock_guard<std::mutex> lock(_recorderMutex);
+        std::unique_ptr<FlightRecorder> recorder(new FlightRecorder(settings));
+        _recorder.store(recorder.get(), std::memory_order_release);
+        _recorderLevel.store(static_cast<int>(settings.level), std::memory_order_relaxed);
+        FlightRecorder::dumpOnCrash(settings.crashHandlers ? recorder.get() : nullptr);
+        _recorders.emplace_back(std::move(recorder));
+    }
+    filterChanged();
+}
+
+void Log::stopRecorder()
+{
+    {
+        std::lock_guard<std::mutex> lock(_recorderMutex);
+        _recorderLevel.store(static_cast<int>(LogLevel::NONE), std::memory_order_relaxed);
+        _recorder.store(nullptr, std::memory_order_release);
+        FlightRecorder::dumpOnCrash(nullptr);
+    }
+    filterChanged();
+}
+
+Log::Filter Log::parseFilter(const std::string &filter, LogLevel level)
+{
+    Filter result{level, {}};
+    std::stringstream stream_filter(filter);
+    std::string single_filter;
+    while (getline(stream_filter, single_filter, ','))
+    {
+        size_t delim_pos = single_filter.find(':');
+        if (delim_pos == std::string::npos)
+        {
+            result.level = logLevelFromString(single_filter);
+        }
+        else
+        {
+            result.domains[single_filter.substr(0, delim_pos)] =
+                logLevelFromString(single_filter.substr(delim_pos + 1));
+        }
+    }
+    return result;
+}
+
+void Log::publish(std::unique_ptr<Filter> &&filter)
+{
+    std::unique_ptr<const Filter> replaced(_filter.exchange(filter.release(), std::memory_order_acq_rel));
+    _grace.synchronize();
+}
+
+void Log::publish(std::unique_ptr<const Sinks> &&sinks)
+{
+    std::unique_ptr<const Sinks> replaced(_sinks.exchange(sinks.release(), std::memory_order_acq_rel));
+    _grace.synchronize();
 }
@@ -0,0 +1,131 @@
+#include "log_formatter.hh"
+
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+// a logger thread of AsyncLogger formats messages of many threads, so several ids are kept
+constexpr std::size_t cThreadIdCacheSize = 16;
+constexpr std::size_t cLineReserve = 256;
+
+struct ThreadIdCache
+{
+    struct Entry
+    {
+        std::thread::id id;
+        std::string text;
+    };
+    Entry entries[cThreadIdCacheSize];
+};
+
+struct TimeCache
+{
+    // the time in units of the resolution the text was made for
+    long long units{-1};
+    LogFormatter::TimeResolution resolution{LogFormatter::TimeResolution::SECONDS};
+    char text[32];
+    std::size_t length{0};
+};
+
+thread_local ThreadIdCache tThreadIds;
+thread_local TimeCache tTime;
+thread_local std::string tLine;
+
+char *appendDecimal(char *end, unsigned long long value, int minDigits)
+{
+    for (int digits = 0; value || digits < minDigits; ++digits)
+    {
+        *--end = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+    return end;
+}
+
+void appendTime(std::string &line, const LogContext::Clock::time_point &time, LogFormatter::TimeResolution resolution)
+{
+    using namespace std::chrono;
+
+    const long long ms = duration_cast<milliseconds>(time.time_since_epoch()).count();
+    const bool millis = resolution == LogFormatter::TimeResolution::MILLISECONDS;
+    const long long units = millis ? ms : static_cast<long long>(LogContext::Clock::to_time_t(time));
+
+    TimeCache &cache = tTime;
+    if (cache.units != units || cache.resolution != resolution)
+    {
+        char buf[sizeof(cache.text)];
+        char *end = buf + sizeof(buf);
+        char *begin = end;
+        if (millis)
+        {
+            begin = appendDecimal(begin, static_cast<unsigned long long>(ms % 1000), 3);
+            *--begin = '.';
+            begin = appendDecimal(begin, static_cast<unsigned long long>(ms / 1000), 1);
+        }
+        else
+        {
+            begin = appendDecimal(begin, static_cast<unsigned long long>(units), 1);
+        }
+        cache.length = end - begin;
+        std::copy(begin, end, cache.text);
+        cache.units = units;
+        cache.resolution = resolution;
+    }
+    line.append(cache.text, cache.length);
+}
+} // namespace
+
+LogFormatter::LogFormatter(TimeResolution resolution)
+    : _resolution(resolution)
+{
+}
+
+const std::string &LogFormatter::format(LogLevel level, const LogContext &context, const char *msg) const
+{
+    std::string &line = tLine;
+    line.clear();
+    line.reserve(cLineReserve);
+
+    appendTime(line, context._time, _resolution);
+    line.push_back(' ');
+    line.append(threadId(context._threadId));
+    line.append(" [", 2);
+    line.push_back(logLevelToChar(level));
+    line.append("] ", 2);
+    line.append(context._name);
+    line.append(": ", 2);
+    line.append(msg);
+    line.push_back('\n');
+    return line;
+}
+
+const std::string &LogFormatter::threadId(const std::thread::id &id)
+{
+    ThreadIdCache::Entry &entry = tThreadIds.entries[std::hash<std::thread::id>()(id) % cThreadIdCacheSize];
+    if (entry.text.empty() || entry.id != id)
+    {
+        std::stringstream stream;
+        stream << "0x" << std::uppercase << std::setfill('0') << std::setw(4) << std::hex << id;
+        entry.id = id;
+        entry.text = stream.str();
+    }
+    return entry.text;
+}
+
+LogFormatter::TimeResolution LogFormatter::timeResolutionFromString(const std::string &str)
+{
+    if (str.empty() || str == "s")
+    {
+        return TimeResolution::SECONDS;
+    }
+    if (str == "ms")
+    {
+        return TimeResolution::MILLISECONDS;
+    }
+    throw std::logic_error("invalid value of time resolution");
+}
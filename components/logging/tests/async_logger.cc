@@ -0,0 +1,278 @@
+#include <gtest/gtest.h>
+
+#include <common/logging/async_logger.hh>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+/* logger which keeps everything it receives */
+class MemoryLogger final : public LoggerInterface
+{
+public:
+    struct Record
+    {
+        LogLevel level;
+        std::string domain;
+        std::string message;
+    };
+
+    MemoryLogger(std::vector<Record> &records, std::mutex &mutex, std::atomic<bool> *gate = nullptr)
+        : _records(records)
+        , _mutex(mutex)
+        , _gate(gate)
+    {
+    }
+
+    void log(LogLevel level, const LogContext &context, const char *msg) override
+    {
+        /* emulates slow output until the gate is opened */
+        while (_gate && !_gate->load())
+        {
+            std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _records.push_back(Record{level, context._name, msg});
+    }
+
+    void flush() override
+    {
+        _flushes++;
+    }
+
+    static std::atomic<int> _flushes;
+
+private:
+    std::vector<Record> &_records;
+    std::mutex &_mutex;
+    std::atomic<bool> *_gate;
+};
+
+std::atomic<int> MemoryLogger::_flushes{0};
+
+std::thread::id threadId()
+{
+    return std::this_thread::get_id();
+}
+} // namespace
+
+TEST(AsyncLogger, DeliversInOrder)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+        for (int i = 0; i < 1000; ++i)
+        {
+            logger.log(LogLevel::INFO, LogContext("async", threadId()), std::to_string(i).c_str());
+        }
+        logger.flush();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        ASSERT_EQ(records.size(), 1000U);
+        for (int i = 0; i < 1000; ++i)
+        {
+            EXPECT_EQ(records[i].message, std::to_string(i));
+            EXPECT_EQ(records[i].domain, "async");
+        }
+        EXPECT_EQ(logger.dropped(), 0U);
+    }
+}
+
+TEST(AsyncLogger, FlushOnShutdown)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.log(LogLevel::DEBUG, LogContext("async", threadId()), "message");
+        }
+    }
+    EXPECT_EQ(records.size(), 100U);
+}
+
+TEST(AsyncLogger, MarksTruncatedMessages)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+        logger.log(LogLevel::INFO, LogContext(std::string(100, 'd'), threadId()), std::string(2000, 'm').c_str());
+        logger.log(LogLevel::INFO, LogContext("async", threadId()), std::string(1023, 'm').c_str());
+    }
+    ASSERT_EQ(records.size(), 2U);
+    EXPECT_EQ(records[0].domain, std::string(60, 'd') + "...");
+    EXPECT_EQ(records[0].message, std::string(1020, 'm') + "...");
+    /* a message which fits is not marked */
+    EXPECT_EQ(records[1].message, std::string(1023, 'm'));
+}
+
+TEST(AsyncLogger, MultipleProducers)
+{
+    constexpr int cThreads = 4;
+    constexpr int cMessages = 5000;
+
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    AsyncLogger::settings_t settings;
+    settings.capacity = 64;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)), settings);
+
+        std::vector<std::thread> producers;
+        for (int t = 0; t < cThreads; ++t)
+        {
+            producers.emplace_back([&logger, t] {
+                for (int i = 0; i < cMessages; ++i)
+                {
+                    logger.log(LogLevel::INFO, LogContext(std::to_string(t), threadId()), std::to_string(i).c_str());
+                }
+            });
+        }
+        for (std::thread &producer : producers)
+        {
+            producer.join();
+        }
+        logger.flush();
+        EXPECT_EQ(logger.dropped(), 0U);
+    }
+
+    /* blocking policy loses nothing and keeps the order of every producer */
+    ASSERT_EQ(records.size(), static_cast<size_t>(cThreads * cMessages));
+    std::vector<int> next(cThreads, 0);
+    for (const MemoryLogger::Record &record : records)
+    {
+        int producer = std::stoi(record.domain);
+        EXPECT_EQ(std::stoi(record.message), next[producer]++);
+    }
+}
+
+TEST(AsyncLogger, DropNewest)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    std::atomic<bool> gate{false};
+    AsyncLogger::settings_t settings;
+    settings.capacity = 8;
+    settings.policy = AsyncLogger::OverflowPolicy::DROP_NEWEST;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex, &gate)), settings);
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.log(LogLevel::INFO, LogContext("async", threadId()), std::to_string(i).c_str());
+        }
+        EXPECT_GT(logger.dropped(), 0U);
+        gate = true;
+        logger.flush();
+    }
+
+    /* the first message always survives, the overflow is reported */
+    std::string first;
+    bool reported = false;
+    for (const MemoryLogger::Record &record : records)
+    {
+        if (first.empty() && record.level == LogLevel::INFO)
+        {
+            first = record.message;
+        }
+        reported |= record.level == LogLevel::WARNING && record.message.find("dropped") != std::string::npos;
+    }
+    EXPECT_EQ(first, "0");
+    EXPECT_TRUE(reported);
+}
+
+TEST(AsyncLogger, DropOldest)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    std::atomic<bool> gate{false};
+    AsyncLogger::settings_t settings;
+    settings.capacity = 8;
+    settings.policy = AsyncLogger::OverflowPolicy::DROP_OLDEST;
+    {
+        AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex, &gate)), settings);
+        for (int i = 0; i < 100; ++i)
+        {
+            logger.log(LogLevel::INFO, LogContext("async", threadId()), std::to_string(i).c_str());
+        }
+        EXPECT_GT(logger.dropped(), 0U);
+        gate = true;
+        logger.flush();
+    }
+
+    /* the newest message always survives */
+    std::string last;
+    for (const MemoryLogger::Record &record : records)
+    {
+        if (record.level == LogLevel::INFO)
+        {
+            last = record.message;
+        }
+    }
+    EXPECT_EQ(last, "99");
+}
+
+TEST(AsyncLogger, FlushOnFatal)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    int flushes = MemoryLogger::_flushes;
+    logger.log(LogLevel::FATAL, LogContext("async", threadId()), "fatal");
+    logger.flush();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(records.size(), 1U);
+    EXPECT_EQ(records[0].level, LogLevel::FATAL);
+    EXPECT_GT(MemoryLogger::_flushes, flushes);
+}
+
+TEST(AsyncLogger, FlushOnRequest)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    AsyncLogger logger(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    const int flushes = MemoryLogger::_flushes;
+    for (int i = 0; i < 1000; ++i)
+    {
+        logger.log(LogLevel::INFO, LogContext("async", threadId()), "message");
+    }
+    // the records are delivered without a flush of the wrapped logger after every batch
+    for (int i = 0; i < 1000; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (records.size() == 1000U)
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(records.size(), 1000U);
+    }
+    EXPECT_EQ(MemoryLogger::_flushes, flushes);
+
+    logger.flush();
+    EXPECT_EQ(MemoryLogger::_flushes, flushes + 1);
+}
+
+TEST(AsyncLogger, OverflowPolicyFromString)
+{
+    EXPECT_EQ(AsyncLogger::overflowPolicyFromString(""), AsyncLogger::OverflowPolicy::BLOCK);
+    EXPECT_EQ(AsyncLogger::overflowPolicyFromString("block"), AsyncLogger::OverflowPolicy::BLOCK);
+    EXPECT_EQ(AsyncLogger::overflowPolicyFromString("drop_newest"), AsyncLogger::OverflowPolicy::DROP_NEWEST);
+    EXPECT_EQ(AsyncLogger::overflowPolicyFromString("drop_oldest"), AsyncLogger::OverflowPolicy::DROP_OLDEST);
+    EXPECT_THROW(AsyncLogger::overflowPolicyFromString("unknown"), std::logic_error);
+}
@@ -0,0 +1,282 @@
+#include <gtest/gtest.h>
+
+#include <common/logging/deferred_log.hh>
+
+#include <cstdio>
+#include <algorithm>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "log_guard.hh"
+
+using namespace softeq::common::logging;
+
+namespace
+{
+const char *const cBinaryLogFile = "TemporaryDeferredLogTest.bin"; /* name of temporary binary log */
+
+/* logger which keeps everything it receives */
+class MemoryLogger final : public LoggerInterface
+{
+public:
+    struct Record
+    {
+        LogLevel level;
+        std::string domain;
+        std::string message;
+    };
+
+    MemoryLogger(std::vector<Record> &records, std::mutex &mutex)
+        : _records(records)
+        , _mutex(mutex)
+    {
+    }
+
+    void log(LogLevel level, const LogContext &context, const char *msg) override
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _records.push_back(Record{level, context._name, msg});
+    }
+
+private:
+    std::vector<Record> &_records;
+    std::mutex &_mutex;
+};
+
+template <typename... Args>
+std::string encodeAndFormat(const char *format, const Args &... args)
+{
+    std::vector<char> buffer(deferred::argumentsSize(args...));
+    char *pos = buffer.data();
+    deferred::putArguments(pos, args...);
+    EXPECT_EQ(static_cast<std::size_t>(pos - buffer.data()), buffer.size());
+    return deferred::format(format, buffer.data(), buffer.size());
+}
+
+template <typename... Args>
+std::string printfFormat(const char *format, const Args &... args)
+{
+    char buffer[1024];
+    snprintf(buffer, sizeof(buffer), format, args...);
+    return buffer;
+}
+} // namespace
+
+TEST(DeferredLog, FormatArguments)
+{
+    const char *null = nullptr;
+    int value = 42;
+
+    EXPECT_EQ(encodeAndFormat("no arguments 100%%"), "no arguments 100%");
+    EXPECT_EQ(encodeAndFormat("%d %i %u", -1, 7, 3U), "-1 7 3");
+    EXPECT_EQ(encodeAndFormat("%hhd %hd %ld %lld %zu", static_cast<signed char>(-5), static_cast<short>(-300), -70000L,
+                              -5000000000LL, static_cast<std::size_t>(12)),
+              "-5 -300 -70000 -5000000000 12");
+    /* h and hh narrow wider arguments like printf does */
+    EXPECT_EQ(encodeAndFormat("%hhd %hd %hhu %hu %hhx", 300, 70000, 300, 70000, -1),
+              printfFormat("%hhd %hd %hhu %hu %hhx", 300, 70000, 300, 70000, -1));
+    EXPECT_EQ(encodeAndFormat("%hhd", 300), "44");
+    EXPECT_EQ(encodeAndFormat("%08.3f|%-6x|%+d|%#o", 3.14159, 255U, 5, 8U),
+              printfFormat("%08.3f|%-6x|%+d|%#o", 3.14159, 255U, 5, 8U));
+    EXPECT_EQ(encodeAndFormat("%*d|%.*s", 6, 12, 3, "abcdef"), printfFormat("%*d|%.*s", 6, 12, 3, "abcdef"));
+    EXPECT_EQ(encodeAndFormat("%e %g %c", 1e10, 0.5f, 'x'), printfFormat("%e %g %c", 1e10, 0.5, 'x'));
+    EXPECT_EQ(encodeAndFormat("%s and %s", "string", null), "string and (null)");
+    EXPECT_EQ(encodeAndFormat("%p", &value), printfFormat("%p", static_cast<void *>(&value)));
+}
+
+TEST(DeferredLog, FormatTruncatedArguments)
+{
+    /* missing arguments are skipped instead of reading garbage */
+    EXPECT_EQ(encodeAndFormat("%d and %d", 1), "1 and ");
+}
+
+TEST(DeferredLog, PassesMessagesToLogger)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        DLOGI("deferred", "message %d of %s", i, "test");
+    }
+    DLOGT("deferred", "filtered %d", 0);
+    DeferredLog::get().flush();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(records.size(), 100U);
+    for (int i = 0; i < 100; ++i)
+    {
+        EXPECT_EQ(records[i].level, LogLevel::INFO);
+        EXPECT_EQ(records[i].domain, "deferred");
+        EXPECT_EQ(records[i].message, "message " + std::to_string(i) + " of test");
+    }
+}
+
+TEST(DeferredLog, RateLimit)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    Log::rate_limit_t settings;
+    settings.siteRate = 1;
+    settings.siteBurst = 3;
+    log().rateLimit(settings);
+    const Log::statistics_t before = log().statistics();
+
+    /* dropped before they take space in the buffer */
+    for (int i = 0; i < 10; ++i)
+    {
+        DLOGI("flood", "deferred %d", i);
+    }
+    DeferredLog::get().flush();
+    EXPECT_EQ(log().statistics().rateLimited - before.rateLimited, 7U);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(records.size(), 3U);
+    EXPECT_EQ(records[2].message, "deferred 2");
+}
+
+TEST(DeferredLog, CallSiteWithDifferentFormats)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    /* the second format can't be described by the registered descriptor, it is written directly */
+    static LogDescriptor descriptor(LogLevel::WARNING, __FILE__, __LINE__);
+    const char *formats[] = {"first %d", "second %d"};
+    for (int i = 0; i < 2; ++i)
+    {
+        DeferredLog::get().write(descriptor, "deferred", formats[i], i);
+    }
+    DeferredLog::get().flush();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(records.size(), 2U);
+    std::vector<std::string> messages = {records[0].message, records[1].message};
+    std::sort(messages.begin(), messages.end());
+    EXPECT_EQ(messages[0], "first 0");
+    EXPECT_EQ(messages[1], "second 1");
+}
+
+TEST(DeferredLog, WrapsShortLeftover)
+{
+    std::vector<MemoryLogger::Record> records;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemoryLogger(records, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    /* a record without arguments in the registered domain takes only its header, 24 bytes */
+    const char *domain = "wrap";
+    static LogDescriptor descriptor(LogLevel::INFO, __FILE__, __LINE__);
+    /* registered here, so that the record of another thread carries its own 8 byte domain */
+    static LogDescriptor wide(LogLevel::INFO, __FILE__, __LINE__);
+    DeferredLog::get().write(wide, "register", "wide");
+
+    /* 64 KiB of a fresh thread buffer leave 16 bytes after 2730 short records and 8 bytes after 2729 short
+       ones and a wider one, both are too small for a padding record */
+    const std::size_t cShortRecords[] = {2730, 2729};
+    for (std::size_t shortRecords : cShortRecords)
+    {
+        std::thread writer([domain, shortRecords]() {
+            for (std::size_t i = 0; i < shortRecords; ++i)
+            {
+                DeferredLog::get().write(descriptor, domain, "short");
+            }
+            if (shortRecords % 2)
+            {
+                DeferredLog::get().write(wide, "8 chars!", "wide");
+            }
+            for (int i = 0; i < 100; ++i)
+            {
+                DeferredLog::get().write(descriptor, domain, "short");
+            }
+        });
+        writer.join();
+    }
+    DeferredLog::get().flush();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ASSERT_EQ(records.size(), 1U + 2730 + 100 + 2729 + 1 + 100);
+    EXPECT_EQ(records[0].domain, "register");
+    EXPECT_EQ(std::count_if(records.begin(), records.end(),
+                            [](const MemoryLogger::Record &record) { return record.message == "short"; }),
+              2730 + 100 + 2729 + 100);
+    EXPECT_EQ(records[1 + 2730 + 100 + 2729].domain, "8 chars!");
+    EXPECT_EQ(records[1 + 2730 + 100 + 2729].message, "wide");
+}
+
+TEST(DeferredLog, BinaryFileRoundTrip)
+{
+    LogGuard guard;
+    log().level(LogLevel::DEBUG);
+    ASSERT_TRUE(DeferredLog::get().open(cBinaryLogFile));
+    for (int i = 0; i < 3; ++i)
+    {
+        DLOGW(i % 2 ? "odd" : "even", "value %d, ratio %.2f", i, i / 2.0);
+    }
+    DeferredLog::get().flush();
+    DeferredLog::get().close();
+
+    std::ifstream file(cBinaryLogFile, std::ios::binary);
+    DeferredLogReader reader(file);
+    std::vector<std::string> lines;
+    ASSERT_TRUE(reader.read([&lines](LogLevel level, const std::string &domain, const std::string &threadId,
+                                     std::time_t time, const std::string &message) {
+        EXPECT_EQ(level, LogLevel::WARNING);
+        EXPECT_FALSE(threadId.empty());
+        EXPECT_GT(time, 0);
+        lines.push_back(domain + ": " + message);
+    }));
+    ASSERT_EQ(lines.size(), 3U);
+    EXPECT_EQ(lines[0], "even: value 0, ratio 0.00");
+    EXPECT_EQ(lines[1], "odd: value 1, ratio 0.50");
+    EXPECT_EQ(lines[2], "even: value 2, ratio 1.00");
+
+    /* decoded text has the same layout as the console logger output */
+    file.clear();
+    file.seekg(0);
+    DeferredLogReader decoder(file);
+    std::stringstream text;
+    ASSERT_TRUE(decoder.decode(text));
+    std::string line;
+    ASSERT_TRUE(static_cast<bool>(std::getline(text, line)));
+    EXPECT_NE(line.find(" [W] even: value 0, ratio 0.00"), std::string::npos);
+    const std::string secondsLine = line;
+
+    /* milliseconds are kept as SC_LOG_TIME_RESOLUTION=ms asks */
+    file.clear();
+    file.seekg(0);
+    DeferredLogReader millisDecoder(file);
+    std::stringstream millisText;
+    ASSERT_TRUE(millisDecoder.decode(millisText, LogFormatter::TimeResolution::MILLISECONDS));
+    ASSERT_TRUE(static_cast<bool>(std::getline(millisText, line)));
+    const std::size_t space = line.find(' ');
+    ASSERT_NE(space, std::string::npos);
+    ASSERT_GT(space, 4U);
+    EXPECT_EQ(line[space - 4], '.');
+    EXPECT_EQ(line.substr(0, space - 4) + line.substr(space), secondsLine);
+
+    std::remove(cBinaryLogFile);
+}
+
+TEST(DeferredLog, RejectsForeignFile)
+{
+    std::stringstream stream("plain text");
+    DeferredLogReader reader(stream);
+    EXPECT_FALSE(reader.read([](LogLevel, const std::string &, const std::string &, std::time_t,
+                                const std::string &) {}));
+}
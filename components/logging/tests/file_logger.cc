@@ -0,0 +1,263 @@
+#include <gtest/gtest.h>
+
+#include <common/logging/file_logger.hh>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+class FileLoggerTest : public ::testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        /* tests may run in parallel, each one has its own directory */
+        _directory =
+            std::string("FileLoggerTest.") + ::testing::UnitTest::GetInstance()->current_test_info()->name();
+        _file = _directory + "/test.log";
+        removeDirectory();
+        mkdir(_directory.c_str(), 0755);
+    }
+
+    void TearDown() override
+    {
+        removeDirectory();
+    }
+
+    std::vector<std::string> rotatedSegments() const
+    {
+        std::vector<std::string> segments;
+        DIR *dir = opendir(_directory.c_str());
+        while (struct dirent *entry = dir ? readdir(dir) : nullptr)
+        {
+            std::string name = entry->d_name;
+            /* test.log.YYYYmmdd-HHMMSS.uuuuuu[.gz] */
+            const bool compressed = name.size() == 34 && name.compare(31, 3, ".gz") == 0;
+            if (name.compare(0, 9, "test.log.") == 0 && (name.size() == 31 || compressed))
+            {
+                segments.push_back(_directory + "/" + name);
+            }
+        }
+        if (dir)
+        {
+            closedir(dir);
+        }
+        std::sort(segments.begin(), segments.end());
+        return segments;
+    }
+
+    static std::vector<std::string> readLines(const std::string &path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream file(path);
+        std::string line;
+        while (std::getline(file, line))
+        {
+            lines.push_back(line);
+        }
+        return lines;
+    }
+
+    static std::string readCompressed(const std::string &path)
+    {
+        std::string content;
+        gzFile file = gzopen(path.c_str(), "rb");
+        char buffer[4096];
+        int length;
+        while (file && (length = gzread(file, buffer, sizeof(buffer))) > 0)
+        {
+            content.append(buffer, length);
+        }
+        if (file)
+        {
+            gzclose(file);
+        }
+        return content;
+    }
+
+    static LogContext context()
+    {
+        return LogContext("file", std::this_thread::get_id());
+    }
+
+    std::string _directory; /* temporary directory for log files */
+    std::string _file;
+
+private:
+    void removeDirectory()
+    {
+        DIR *dir = opendir(_directory.c_str());
+        while (struct dirent *entry = dir ? readdir(dir) : nullptr)
+        {
+            unlink((_directory + "/" + entry->d_name).c_str());
+        }
+        if (dir)
+        {
+            closedir(dir);
+        }
+        rmdir(_directory.c_str());
+    }
+};
+} // namespace
+
+TEST_F(FileLoggerTest, WritesLines)
+{
+    FileLogger::settings_t settings;
+    settings.path = _file;
+    FileLogger logger(settings);
+    for (int i = 0; i < 1000; ++i)
+    {
+        logger.log(LogLevel::INFO, context(), std::to_string(i).c_str());
+    }
+    logger.flush();
+
+    std::vector<std::string> lines = readLines(_file);
+    ASSERT_EQ(lines.size(), 1000U);
+    for (int i = 0; i < 1000; ++i)
+    {
+        const std::string suffix = " [I] file: " + std::to_string(i);
+        EXPECT_EQ(lines[i].substr(lines[i].size() - suffix.size()), suffix);
+    }
+    EXPECT_TRUE(rotatedSegments().empty());
+}
+
+TEST_F(FileLoggerTest, AppendsToExistingFile)
+{
+    {
+        std::ofstream file(_file);
+        file << "existing line\n";
+    }
+    FileLogger::settings_t settings;
+    settings.path = _file;
+    {
+        FileLogger logger(settings);
+        logger.log(LogLevel::ERROR, context(), "appended");
+    }
+
+    std::vector<std::string> lines = readLines(_file);
+    ASSERT_EQ(lines.size(), 2U);
+    EXPECT_EQ(lines[0], "existing line");
+}
+
+TEST_F(FileLoggerTest, RotatesBySize)
+{
+    FileLogger::settings_t settings;
+    settings.path = _file;
+    settings.bufferSize = 256;
+    settings.maxFileSize = 1024;
+    settings.compress = false;
+    {
+        FileLogger logger(settings);
+        for (int i = 0; i < 200; ++i)
+        {
+            logger.log(LogLevel::INFO, context(), "message which fills the file up");
+            logger.flush();
+        }
+    }
+
+    std::vector<std::string> segments = rotatedSegments();
+    EXPECT_GE(segments.size(), 5U);
+    std::size_t lines = readLines(_file).size();
+    for (const std::string &segment : segments)
+    {
+        struct stat st;
+        ASSERT_EQ(stat(segment.c_str(), &st), 0);
+        EXPECT_LT(static_cast<std::size_t>(st.st_size), settings.maxFileSize + settings.bufferSize);
+        lines += readLines(segment).size();
+    }
+    /* nothing is lost on rotation */
+    EXPECT_EQ(lines, 200U);
+}
+
+TEST_F(FileLoggerTest, CompressesRotatedSegments)
+{
+    FileLogger::settings_t settings;
+    settings.path = _file;
+    {
+        FileLogger logger(settings);
+        logger.log(LogLevel::WARNING, context(), "before rotation");
+        logger.rotate();
+        logger.flush();
+        logger.log(LogLevel::WARNING, context(), "after rotation");
+    }
+
+    std::vector<std::string> segments = rotatedSegments();
+    ASSERT_EQ(segments.size(), 1U);
+    ASSERT_EQ(segments[0].substr(segments[0].size() - 3), ".gz");
+    EXPECT_NE(readCompressed(segments[0]).find("[W] file: before rotation\n"), std::string::npos);
+
+    std::vector<std::string> lines = readLines(_file);
+    ASSERT_EQ(lines.size(), 1U);
+    EXPECT_NE(lines[0].find("after rotation"), std::string::npos);
+}
+
+TEST_F(FileLoggerTest, RetainsLimitedSegments)
+{
+    FileLogger::settings_t settings;
+    settings.path = _file;
+    settings.maxFiles = 2;
+    /* files which only share the base name are not segments */
+    const std::vector<std::string> unrelated = {_file + ".bak", _file + ".1", _file + ".20200101-000000.000000.gz.tmp"};
+    for (const std::string &path : unrelated)
+    {
+        std::ofstream(path) << "keep";
+    }
+    {
+        FileLogger logger(settings);
+        for (int i = 0; i < 5; ++i)
+        {
+            logger.log(LogLevel::INFO, context(), ("segment " + std::to_string(i)).c_str());
+            logger.rotate();
+            logger.flush();
+        }
+    }
+
+    /* the newest segments survive */
+    std::vector<std::string> segments = rotatedSegments();
+    ASSERT_EQ(segments.size(), 2U);
+    EXPECT_NE(readCompressed(segments[0]).find("segment 3"), std::string::npos);
+    EXPECT_NE(readCompressed(segments[1]).find("segment 4"), std::string::npos);
+    for (const std::string &path : unrelated)
+    {
+        struct stat st;
+        EXPECT_EQ(stat(path.c_str(), &st), 0) << path;
+    }
+}
+
+TEST_F(FileLoggerTest, SettingsFromString)
+{
+    FileLogger::settings_t settings =
+        FileLogger::settingsFromString("/var/log/app.log,size=10M,period=3600,files=5,bytes=1G,compress=0");
+    EXPECT_EQ(settings.path, "/var/log/app.log");
+    EXPECT_EQ(settings.maxFileSize, 10U << 20);
+    EXPECT_EQ(settings.rotationPeriod, std::chrono::seconds(3600));
+    EXPECT_EQ(settings.maxFiles, 5U);
+    EXPECT_EQ(settings.maxBytes, 1U << 30);
+    EXPECT_FALSE(settings.compress);
+
+    settings = FileLogger::settingsFromString("app.log");
+    EXPECT_EQ(settings.path, "app.log");
+    EXPECT_EQ(settings.maxFileSize, 0U);
+    EXPECT_TRUE(settings.compress);
+
+    EXPECT_THROW(FileLogger::settingsFromString(""), std::logic_error);
+    EXPECT_THROW(FileLogger::settingsFromString("app.log,size=10X"), std::logic_error);
+    EXPECT_THROW(FileLogger::settingsFromString("app.log,unknown=1"), std::logic_error);
+}
+
+TEST_F(FileLoggerTest, ThrowsOnInaccessiblePath)
+{
+    FileLogger::settings_t settings;
+    settings.path = _directory + "/missing/test.log";
+    EXPECT_THROW(FileLogger logger(settings), std::system_error);
+}
@@ -0,0 +1,198 @@
+#include <gtest/gtest.h>
+
+#include <common/logging/flight_recorder.hh>
+#include <common/logging/log.hh>
+
+#include <unistd.h>
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "log_guard.hh"
+
+using namespace softeq::common::logging;
+
+namespace
+{
+/* returns everything the recorder dumps */
+std::string dump(const FlightRecorder &recorder)
+{
+    FILE *file = tmpfile();
+    recorder.dump(fileno(file));
+    rewind(file);
+    std::string text;
+    char buffer[4096];
+    std::size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+        text.append(buffer, length);
+    }
+    fclose(file);
+    return text;
+}
+
+LogContext context()
+{
+    return LogContext("recorder", std::this_thread::get_id());
+}
+
+/* logger which only counts messages */
+class CountingLogger final : public LoggerInterface
+{
+public:
+    explicit CountingLogger(int &count)
+        : _count(count)
+    {
+    }
+
+    void log(LogLevel, const LogContext &, const char *) override
+    {
+        ++_count;
+    }
+
+private:
+    int &_count;
+};
+} // namespace
+
+TEST(FlightRecorder, KeepsLastRecords)
+{
+    FlightRecorder::settings_t settings;
+    settings.records = 4;
+    FlightRecorder recorder(settings);
+    for (int i = 0; i < 10; ++i)
+    {
+        recorder.log(LogLevel::TRACE, context(), ("message " + std::to_string(i)).c_str());
+    }
+
+    const std::string text = dump(recorder);
+    EXPECT_EQ(text.find("message 5"), std::string::npos);
+    std::size_t position = 0;
+    for (int i = 6; i < 10; ++i)
+    {
+        const std::size_t found = text.find("[T] recorder: message " + std::to_string(i) + "\n");
+        ASSERT_NE(found, std::string::npos);
+        EXPECT_GT(found, position);
+        position = found;
+    }
+}
+
+TEST(FlightRecorder, TruncatesLongLines)
+{
+    FlightRecorder::settings_t settings;
+    settings.records = 2;
+    settings.recordSize = 64;
+    FlightRecorder recorder(settings);
+    recorder.log(LogLevel::INFO, context(), std::string(200, 'x').c_str());
+    recorder.log(LogLevel::INFO, context(), "short");
+
+    const std::string text = dump(recorder);
+    EXPECT_NE(text.find("x\n"), std::string::npos);
+    EXPECT_EQ(text.find(std::string(64, 'x')), std::string::npos);
+    EXPECT_NE(text.find("recorder: short\n"), std::string::npos);
+
+    settings.recordSize = 8;
+    EXPECT_THROW(FlightRecorder{settings}, std::invalid_argument);
+}
+
+TEST(FlightRecorder, Memfd)
+{
+    FlightRecorder::settings_t settings;
+    settings.records = 8;
+    settings.memfd = true;
+    FlightRecorder recorder(settings);
+    ASSERT_GE(recorder.fd(), 0);
+    recorder.log(LogLevel::DEBUG, context(), "shared");
+
+    /* another process can map the descriptor and find the lines */
+    std::string mapped(4096, '\0');
+    ASSERT_GT(pread(recorder.fd(), &mapped[0], mapped.size(), 0), 0);
+    EXPECT_EQ(mapped.compare(0, 8, "SCFREC1\n"), 0);
+    EXPECT_NE(mapped.find("recorder: shared\n"), std::string::npos);
+}
+
+TEST(FlightRecorder, RecordsFilteredMessages)
+{
+    int written = 0;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new CountingLogger(written)));
+    log().level(LogLevel::ERROR);
+
+    FlightRecorder::settings_t settings;
+    settings.crashHandlers = false;
+    log().startRecorder(settings);
+    LOGT("recorder", "trace context %d", 1);
+    LOGE("recorder", "error");
+
+    FILE *file = tmpfile();
+    log().dumpRecorder(fileno(file));
+    log().stopRecorder();
+    long size = ftell(file);
+    std::string text(static_cast<std::size_t>(size), '\0');
+    rewind(file);
+    EXPECT_EQ(fread(&text[0], 1, text.size(), file), text.size());
+    fclose(file);
+
+    /* the installed logger receives filtered messages only */
+    EXPECT_EQ(written, 1);
+    EXPECT_NE(text.find("[T] recorder: trace context 1\n"), std::string::npos);
+    EXPECT_NE(text.find("[E] recorder: error\n"), std::string::npos);
+
+    /* the recorder doesn't keep the level open once stopped */
+    bool evaluated = false;
+    LOGT("recorder", "%d", (evaluated = true));
+    EXPECT_FALSE(evaluated);
+}
+
+TEST(FlightRecorder, DumpOnCrash)
+{
+    ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+    EXPECT_DEATH(
+        {
+            log().level(LogLevel::NONE);
+            log().startRecorder(FlightRecorder::settings_t());
+            LOGT("recorder", "context before the crash");
+            raise(SIGSEGV);
+        },
+        "recorder: context before the crash");
+    EXPECT_DEATH(
+        {
+            log().level(LogLevel::NONE);
+            log().startRecorder(FlightRecorder::settings_t());
+            LOGD("recorder", "context before abort");
+            abort();
+        },
+        "recorder: context before abort");
+    /* the crash handler doesn't repeat the dump of the crash path */
+    EXPECT_DEATH(
+        {
+            log().level(LogLevel::NONE);
+            log().startRecorder(FlightRecorder::settings_t());
+            LOGD("recorder", "context before terminate");
+            log().dumpRecorderOnce(STDERR_FILENO);
+            abort();
+        },
+        "^[^-]*--- flight recorder: last log records ---\n[^-]*recorder: context before terminate\n"
+        "--- flight recorder: end ---\n[^-]*$");
+}
+
+TEST(FlightRecorder, SettingsFromString)
+{
+    FlightRecorder::settings_t settings = FlightRecorder::settingsFromString("records=100,size=512,level=debug,memfd=1");
+    EXPECT_EQ(settings.records, 100U);
+    EXPECT_EQ(settings.recordSize, 512U);
+    EXPECT_EQ(settings.level, LogLevel::DEBUG);
+    EXPECT_TRUE(settings.memfd);
+    EXPECT_TRUE(settings.crashHandlers);
+
+    settings = FlightRecorder::settingsFromString("handlers=0");
+    EXPECT_EQ(settings.records, 1024U);
+    EXPECT_FALSE(settings.crashHandlers);
+
+    EXPECT_THROW(FlightRecorder::settingsFromString("memfd"), std::logic_error);
+    EXPECT_THROW(FlightRecorder::settingsFromString("memfd=yes"), std::logic_error);
+    EXPECT_THROW(FlightRecorder::settingsFromString("depth=10"), std::logic_error);
+}
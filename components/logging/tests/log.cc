@@ -3,13 +3,18 @@
 #include <common/logging/log.hh>
 #include <common/logging/system_logger.hh>
 
+#include "log_guard.hh"
+
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <syslog.h>
 #include <thread>
 #include <algorithm>
+#include <atomic>
+#include <mutex>
 
 using namespace softeq::common::logging;
 
@@ -34,7 +39,7 @@ const std::vector<LogLevel> cLogLevels =
 const std::vector<std::string> cConsoleLogWithBadEnvVar =
 {
     {"Logger filter error: stoi"},
-    {"fix your SC_LOG_FILTER envvar"}
+    {"fix \"empty\" in your SC_LOG_FILTER envvar"}
 };
 
 const std::vector<std::pair<std::string, std::string>> cConsoleLogWithEnvVar =
@@ -227,13 +232,13 @@ private:
 
 TEST(Logger, ConsoleLogWithBadFilter)
 {
-    /* set incorrect environment variable */
-    setenv("SC_LOG_FILTER", "empty", true);
+    /* set incorrect environment variable, the valid entries are still applied */
+    setenv("SC_LOG_FILTER", "warning,empty", true);
 
     std::stringstream file;
     std::streambuf *buffer = std::cerr.rdbuf(file.rdbuf());
     std::string s;                                      /* string for compare */
-    EXPECT_NO_THROW(log().level(LogLevel::WARNING));    /* call log constructor with incorrect value of SC_LOG_FILTER */
+    EXPECT_EQ(log().level(), LogLevel::WARNING);        /* call log constructor with incorrect value of SC_LOG_FILTER */
 
     /* run and test the content of the log */
     for (std::string i : cConsoleLogWithBadEnvVar)
@@ -363,3 +368,455 @@ TEST(Logger, SysLog)
     logAnalysis.sysLogCheck(domain.c_str());
     interception.removeTemporaryFile();
 }
+
+TEST(Logger, FilteredArgumentsNotEvaluated)
+{
+    LogLevel level = log().level();
+    int evaluated = 0;
+    auto argument = [&evaluated]() {
+        evaluated++;
+        return "argument";
+    };
+
+    log().level(LogLevel::NONE);
+    for (int i = 0; i < 10; i++)
+    {
+        LOGT("filtered.logger", "%s", argument());
+        LOGE("filtered.logger", "%s", argument());
+    }
+    EXPECT_EQ(evaluated, 0);
+
+    /* call site caches are invalidated by the level change */
+    log().level(LogLevel::ERROR);
+    for (int i = 0; i < 10; i++)
+    {
+        LOGT("filtered.logger", "%s", argument());
+        LOGE("filtered.logger", "%s", argument());
+    }
+    EXPECT_EQ(evaluated, 10);
+
+    log().level(level);
+}
+
+namespace
+{
+/* sink which keeps received messages, optionally stalls until the gate is opened */
+class MemorySink final : public LoggerInterface
+{
+public:
+    MemorySink(std::vector<std::string> &messages, std::mutex &mutex, std::atomic<bool> *gate = nullptr)
+        : _messages(messages)
+        , _mutex(mutex)
+        , _gate(gate)
+    {
+    }
+
+    void log(LogLevel level, const LogContext &context, const char *msg) override
+    {
+        while (_gate && !_gate->load())
+        {
+            std::this_thread::yield();
+        }
+        std::lock_guard<std::mutex> lock(_mutex);
+        _messages.push_back(std::string(1, logLevelToChar(level)) + " " + context._name + ": " + msg);
+    }
+
+private:
+    std::vector<std::string> &_messages;
+    std::mutex &_mutex;
+    std::atomic<bool> *_gate;
+};
+
+/* sink which counts the living instances */
+class CountedSink final : public LoggerInterface
+{
+public:
+    explicit CountedSink(std::atomic<int> &instances)
+        : _instances(instances)
+    {
+        ++_instances;
+    }
+
+    ~CountedSink() override
+    {
+        --_instances;
+    }
+
+    void log(LogLevel, const LogContext &, const char *) override
+    {
+    }
+
+private:
+    std::atomic<int> &_instances;
+};
+} // namespace
+
+TEST(Logger, SinksHaveOwnFilters)
+{
+    std::vector<std::string> primary, errors, traces;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(primary, mutex)));
+    log().level(LogLevel::INFO);
+
+    Log::sink_settings_t errorSettings;
+    errorSettings.level = LogLevel::ERROR;
+    errorSettings.async = false;
+    Log::SinkId errorSink = log().addSink(LoggerInterface::UPtr(new MemorySink(errors, mutex)), errorSettings);
+
+    Log::sink_settings_t traceSettings;
+    traceSettings.level = LogLevel::NONE;
+    traceSettings.domains["verbose"] = LogLevel::TRACE;
+    traceSettings.async = false;
+    Log::SinkId traceSink = log().addSink(LoggerInterface::UPtr(new MemorySink(traces, mutex)), traceSettings);
+
+    LOGT("verbose", "trace %d", 1);
+    LOGI("verbose", "info %d", 2);
+    LOGE("quiet", "error %d", 3);
+    LOGT("quiet", "trace %d", 4);
+
+    EXPECT_EQ(primary, std::vector<std::string>({"I verbose: info 2", "E quiet: error 3"}));
+    EXPECT_EQ(errors, std::vector<std::string>({"E quiet: error 3"}));
+    EXPECT_EQ(traces, std::vector<std::string>({"T verbose: trace 1", "I verbose: info 2"}));
+
+    /* removed sinks don't receive messages, the verbose level is not needed anymore */
+    EXPECT_TRUE(log().removeSink(traceSink));
+    EXPECT_FALSE(log().removeSink(traceSink));
+    LOGT("verbose", "trace %d", 5);
+    EXPECT_EQ(traces.size(), 2U);
+    EXPECT_EQ(primary.size(), 2U);
+
+    EXPECT_TRUE(log().removeSink(errorSink));
+}
+
+TEST(Logger, SlowSinkIsolated)
+{
+    std::vector<std::string> primary, fast, slow;
+    std::mutex mutex;
+    std::atomic<bool> gate{false};
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(primary, mutex)));
+    log().level(LogLevel::NONE);
+
+    Log::SinkId fastSink = log().addSink(LoggerInterface::UPtr(new MemorySink(fast, mutex)));
+    Log::sink_settings_t slowSettings;
+    slowSettings.queue.capacity = 1024;
+    Log::SinkId slowSink = log().addSink(LoggerInterface::UPtr(new MemorySink(slow, mutex, &gate)), slowSettings);
+
+    for (int i = 0; i < 100; ++i)
+    {
+        LOGD("sinks", "message %d", i);
+    }
+    /* the fast sink gets everything while the slow one is stuck */
+    for (int i = 0; i < 1000; ++i)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fast.size() == 100U)
+            {
+                break;
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(fast.size(), 100U);
+        EXPECT_TRUE(slow.empty());
+        EXPECT_TRUE(primary.empty());
+    }
+
+    gate = true;
+    log().flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ(slow.size(), 100U);
+    }
+    log().removeSink(fastSink);
+    log().removeSink(slowSink);
+}
+
+TEST(Logger, RemovedSinkReleased)
+{
+    std::vector<std::string> primary;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(primary, mutex)));
+    log().level(LogLevel::NONE);
+
+    /* the writers keep reading the list of sinks while it is replaced */
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i)
+    {
+        writers.emplace_back([&stop] {
+            while (!stop)
+            {
+                LOGD("sinks", "message");
+            }
+        });
+    }
+
+    std::atomic<int> instances{0};
+    Log::sink_settings_t settings;
+    settings.async = false;
+    for (int i = 0; i < 100; ++i)
+    {
+        Log::SinkId sink = log().addSink(LoggerInterface::UPtr(new CountedSink(instances)), settings);
+        EXPECT_TRUE(log().removeSink(sink));
+        /* nobody writes to the removed sink anymore, it is destroyed at once */
+        EXPECT_EQ(instances, 0);
+    }
+
+    stop = true;
+    for (std::thread &writer : writers)
+    {
+        writer.join();
+    }
+}
+
+TEST(GracePeriod, WaitsForReadersOfReplacedSnapshot)
+{
+    GracePeriod grace;
+    std::atomic<bool> synchronized{false};
+    std::unique_ptr<GracePeriod::Reader> early(new GracePeriod::Reader(grace));
+
+    std::thread writer([&grace, &synchronized] {
+        grace.synchronize();
+        synchronized = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(synchronized);
+
+    /* a reader which comes after the snapshot is replaced doesn't delay the writer */
+    GracePeriod::Reader late(grace);
+    early.reset();
+    writer.join();
+    EXPECT_TRUE(synchronized);
+}
+
+TEST(Logger, FilterChangesWhileLogging)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().level(LogLevel::INFO);
+
+    /* replaced filters are freed while the writers look them up, nothing is kept */
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> writers;
+    for (int i = 0; i < 4; ++i)
+    {
+        writers.emplace_back([&stop] {
+            while (!stop)
+            {
+                log().Message(LogLevel::DEBUG, "changing", "debug");
+                log().Message(LogLevel::ERROR, "changing", "error");
+            }
+        });
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        log().level(i % 2 ? LogLevel::INFO : LogLevel::WARNING);
+        log().filter(i % 2 ? "changing:error" : "changing:info");
+    }
+    stop = true;
+    for (std::thread &writer : writers)
+    {
+        writer.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(std::count(messages.begin(), messages.end(), "D changing: debug"), 0);
+    EXPECT_EQ(std::count(messages.begin(), messages.end(), "E changing: error"),
+              static_cast<std::ptrdiff_t>(messages.size()));
+}
+
+TEST(Logger, FilterReload)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().level(LogLevel::INFO);
+
+    LOGD("reload", "hidden");
+    log().filter("warning,reload:debug");
+    EXPECT_EQ(log().level(), LogLevel::WARNING);
+    LOGD("reload", "shown");
+    LOGI("other", "hidden");
+    LOGW("other", "shown");
+
+    /* a malformed filter doesn't change anything */
+    EXPECT_ANY_THROW(log().filter("reload:verbose"));
+    LOGD("reload", "still shown");
+
+    /* domain filters are replaced, the level is kept when the string doesn't set it */
+    log().filter("other:trace");
+    EXPECT_EQ(log().level(), LogLevel::WARNING);
+    LOGD("reload", "hidden");
+    LOGT("other", "shown");
+
+    EXPECT_EQ(messages, std::vector<std::string>({"D reload: shown", "W other: shown", "D reload: still shown",
+                                                  "T other: shown"}));
+}
+
+TEST(Logger, SiteCacheFollowsDomainName)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().filter("3,foo:7");
+
+    /* the call site is given different names from the same buffer */
+    char domain[4];
+    for (const char *name : {"bar", "foo", "bar", "foo"})
+    {
+        strcpy(domain, name);
+        LOGD(domain, "%s", name);
+    }
+
+    EXPECT_EQ(messages, std::vector<std::string>({"D foo: foo", "D foo: foo"}));
+}
+
+TEST(Logger, FilterReloadWhileLogging)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().level(LogLevel::NONE);
+
+    std::atomic<bool> stop{false};
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; ++t)
+    {
+        producers.emplace_back([&stop] {
+            while (!stop)
+            {
+                LOGD("concurrent", "message");
+            }
+        });
+    }
+    for (int i = 0; i < 1000; ++i)
+    {
+        log().filter(i % 2 ? "none" : "none,concurrent:debug");
+    }
+    log().filter("none");
+    stop = true;
+    for (std::thread &producer : producers)
+    {
+        producer.join();
+    }
+
+    /* the producers have seen the new filter */
+    std::size_t count;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        count = messages.size();
+    }
+    LOGD("concurrent", "message");
+    std::lock_guard<std::mutex> lock(mutex);
+    EXPECT_EQ(messages.size(), count);
+}
+
+TEST(Logger, RateLimit)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    Log::rate_limit_t settings;
+    settings.siteRate = 1;
+    settings.siteBurst = 3;
+    log().rateLimit(settings);
+    const Log::statistics_t before = log().statistics();
+
+    /* every call site has its own budget */
+    for (int i = 0; i < 10; ++i)
+    {
+        LOGI("flood", "site one %d", i);
+        LOGI("flood", "site two %d", i);
+    }
+    const Log::statistics_t limited = log().statistics();
+    EXPECT_EQ(limited.rateLimited - before.rateLimited, 14U);
+
+    /* FATAL is never limited, plain Message() calls have no call site */
+    settings.siteRate = 0;
+    settings.domainRate = 1;
+    settings.domainBurst = 2;
+    log().rateLimit(settings);
+    for (int i = 0; i < 5; ++i)
+    {
+        log().Message(LogLevel::INFO, "domain", "domain %d", i);
+    }
+    log().Message(LogLevel::FATAL, "domain", "fatal");
+    EXPECT_EQ(log().statistics().rateLimited - limited.rateLimited, 3U);
+
+    /* the domain reports what it has lost once the budget is refilled */
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    log().Message(LogLevel::INFO, "domain", "resumed");
+    log().rateLimit(Log::rate_limit_t());
+
+    EXPECT_EQ(messages, std::vector<std::string>({"I flood: site one 0", "I flood: site two 0", "I flood: site one 1",
+                                                  "I flood: site two 1", "I flood: site one 2", "I flood: site two 2",
+                                                  "I domain: domain 0", "I domain: domain 1", "F domain: fatal",
+                                                  "I domain: 3 messages suppressed by rate limit",
+                                                  "I domain: resumed"}));
+}
+
+TEST(Logger, CollapseRepeats)
+{
+    std::vector<std::string> messages;
+    std::mutex mutex;
+    LogGuard guard;
+    log().set(LoggerInterface::UPtr(new MemorySink(messages, mutex)));
+    log().level(LogLevel::DEBUG);
+
+    Log::rate_limit_t settings;
+    settings.collapse = true;
+    log().rateLimit(settings);
+    const uint64_t before = log().statistics().repeated;
+
+    for (int i = 0; i < 5; ++i)
+    {
+        LOGW("repeat", "disk is full");
+    }
+    LOGW("repeat", "disk is fine");
+    LOGW("repeat", "disk is fine");
+    /* pending repetitions are reported by flush() of the same thread */
+    log().flush();
+    /* a thread reports its repetitions on exit */
+    std::thread([] {
+        LOGI("repeat", "from thread");
+        LOGI("repeat", "from thread");
+    }).join();
+    log().rateLimit(Log::rate_limit_t());
+
+    EXPECT_EQ(log().statistics().repeated - before, 6U);
+    EXPECT_EQ(messages, std::vector<std::string>({"W repeat: disk is full", "W repeat: last message repeated 4 times",
+                                                  "W repeat: disk is fine", "W repeat: last message repeated 1 times",
+                                                  "I repeat: from thread", "I repeat: last message repeated 1 times"}));
+}
+
+TEST(Logger, RateLimitFromString)
+{
+    Log::rate_limit_t settings = Log::rateLimitFromString("site=100/200,domain=1000,collapse");
+    EXPECT_EQ(settings.siteRate, 100U);
+    EXPECT_EQ(settings.siteBurst, 200U);
+    EXPECT_EQ(settings.domainRate, 1000U);
+    EXPECT_EQ(settings.domainBurst, 0U);
+    EXPECT_TRUE(settings.collapse);
+
+    settings = Log::rateLimitFromString("");
+    EXPECT_EQ(settings.siteRate, 0U);
+    EXPECT_FALSE(settings.collapse);
+
+    EXPECT_THROW(Log::rateLimitFromString("site"), std::logic_error);
+    EXPECT_THROW(Log::rateLimitFromString("burst=10"), std::logic_error);
+    EXPECT_ANY_THROW(Log::rateLimitFromString("domain=fast"));
+}
@@ -0,0 +1,68 @@
+#include <gtest/gtest.h>
+
+#include <common/logging/log_formatter.hh>
+
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+using namespace softeq::common::logging;
+
+namespace
+{
+LogContext::Clock::time_point timePoint(long long ms)
+{
+    return LogContext::Clock::time_point(
+        std::chrono::duration_cast<LogContext::Clock::duration>(std::chrono::milliseconds(ms)));
+}
+
+std::string streamThreadId(const std::thread::id &id)
+{
+    std::stringstream stream;
+    stream << "0x" << std::uppercase << std::setfill('0') << std::setw(4) << std::hex << id;
+    return stream.str();
+}
+} // namespace
+
+TEST(LogFormatter, Layout)
+{
+    LogFormatter formatter;
+    const std::thread::id id = std::this_thread::get_id();
+
+    EXPECT_EQ(formatter.format(LogLevel::WARNING, LogContext("domain", id, timePoint(1600000000123)), "message"),
+              "1600000000 " + streamThreadId(id) + " [W] domain: message\n");
+    /* cached timestamp is refreshed when the second changes */
+    EXPECT_EQ(formatter.format(LogLevel::INFO, LogContext("", id, timePoint(1600000001999)), "next"),
+              "1600000001 " + streamThreadId(id) + " [I] : next\n");
+}
+
+TEST(LogFormatter, Milliseconds)
+{
+    LogFormatter formatter(LogFormatter::TimeResolution::MILLISECONDS);
+    const std::thread::id id = std::this_thread::get_id();
+
+    EXPECT_EQ(formatter.format(LogLevel::ERROR, LogContext("ms", id, timePoint(1600000000007)), "a"),
+              "1600000000.007 " + streamThreadId(id) + " [E] ms: a\n");
+    EXPECT_EQ(formatter.format(LogLevel::ERROR, LogContext("ms", id, timePoint(1600000000250)), "b"),
+              "1600000000.250 " + streamThreadId(id) + " [E] ms: b\n");
+}
+
+TEST(LogFormatter, ThreadIdOfOtherThreads)
+{
+    std::thread::id other;
+    std::thread thread([&other] { other = std::this_thread::get_id(); });
+    thread.join();
+
+    /* loggers running in a background thread format messages of other threads */
+    EXPECT_EQ(LogFormatter::threadId(other), streamThreadId(other));
+    EXPECT_EQ(LogFormatter::threadId(std::this_thread::get_id()), streamThreadId(std::this_thread::get_id()));
+    EXPECT_EQ(LogFormatter::threadId(other), streamThreadId(other));
+}
+
+TEST(LogFormatter, TimeResolutionFromString)
+{
+    EXPECT_EQ(LogFormatter::timeResolutionFromString(""), LogFormatter::TimeResolution::SECONDS);
+    EXPECT_EQ(LogFormatter::timeResolutionFromString("s"), LogFormatter::TimeResolution::SECONDS);
+    EXPECT_EQ(LogFormatter::timeResolutionFromString("ms"), LogFormatter::TimeResolution::MILLISECONDS);
+    EXPECT_THROW(LogFormatter::timeResolutionFromString("us"), std::logic_error);
+}
@@ -0,0 +1,42 @@
+#ifndef SOFTEQ_COMMON_LOGGING_TESTS_LOG_GUARD_H
+#define SOFTEQ_COMMON_LOGGING_TESTS_LOG_GUARD_H
+
+#include <common/logging/log.hh>
+
+#include "console_logger.hh"
+
+/*
+  Restores the state of the log singleton which a test changes: the console logger, the level, the domain
+  filters and the rate limit, a running flight recorder is stopped. Declare it after the objects the installed
+  logger refers to, so it is destroyed before them
+*/
+class LogGuard final
+{
+public:
+    LogGuard()
+        : _level(softeq::common::logging::log().level())
+        , _rateLimit(softeq::common::logging::log().rateLimit())
+    {
+    }
+
+    ~LogGuard()
+    {
+        using namespace softeq::common::logging;
+
+        log().stopRecorder();
+        log().flush();
+        log().set(LoggerInterface::UPtr(new ConsoleLogger()));
+        log().filter("");
+        log().level(_level);
+        log().rateLimit(_rateLimit);
+    }
+
+    LogGuard(const LogGuard &) = delete;
+    LogGuard &operator=(const LogGuard &) = delete;
+
+private:
+    const softeq::common::logging::LogLevel _level;
+    const softeq::common::logging::Log::rate_limit_t _rateLimit;
+};
+
+#endif // SOFTEQ_COMMON_LOGGING_TESTS_LOG_GUARD_H
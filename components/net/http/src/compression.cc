@@ -0,0 +1,167 @@
+#include "compression.hh"
+
+#include <cstdlib>
+#include <cstring>
+
+#include <strings.h>
+#include <zlib.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+// zlib window of 32 KiB, +16 makes a gzip header and trailer
+constexpr int cWindowBits = 15;
+constexpr int cGzipWindowBits = cWindowBits + 16;
+constexpr int cMemoryLevel = 8;
+
+const char *const cIncompressibleTypes[] = {
+    "image/", "audio/", "video/", "font/woff", "application/zip", "application/gzip", "application/x-gzip",
+    "application/x-bzip2", "application/x-xz", "application/x-7z-compressed", "application/pdf",
+};
+
+std::string trim(const std::string &str, std::size_t first, std::size_t last)
+{
+    while (first < last && (str[first] == ' ' || str[first] == '\t'))
+    {
+        ++first;
+    }
+    while (last > first && (str[last - 1] == ' ' || str[last - 1] == '\t'))
+    {
+        --last;
+    }
+    return str.substr(first, last - first);
+}
+} // namespace
+
+ContentCoding negotiateContentCoding(const std::string &acceptEncoding)
+{
+    double gzip = -1;
+    double deflate = -1;
+    double any = -1;
+
+    std::size_t pos = 0;
+    while (pos < acceptEncoding.size())
+    {
+        std::size_t end = acceptEncoding.find(',', pos);
+        if (end == std::string::npos)
+        {
+            end = acceptEncoding.size();
+        }
+        std::size_t separator = acceptEncoding.find(';', pos);
+        if (separator == std::string::npos || separator > end)
+        {
+            separator = end;
+        }
+
+        const std::string token = trim(acceptEncoding, pos, separator);
+        double weight = 1;
+        const std::string parameter = trim(acceptEncoding, separator < end ? separator + 1 : end, end);
+        if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=')
+        {
+            weight = std::strtod(parameter.c_str() + 2, nullptr);
+        }
+
+        if (strcasecmp(token.c_str(), "gzip") == 0 || strcasecmp(token.c_str(), "x-gzip") == 0)
+        {
+            gzip = weight;
+        }
+        else if (strcasecmp(token.c_str(), "deflate") == 0)
+        {
+            deflate = weight;
+        }
+        else if (token == "*")
+        {
+            any = weight;
+        }
+        pos = end + 1;
+    }
+
+    // codings which are not listed take the weight of "*"
+    if (gzip < 0)
+    {
+        gzip = any;
+    }
+    if (deflate < 0)
+    {
+        deflate = any;
+    }
+    if (gzip > 0 && gzip >= deflate)
+    {
+        return ContentCoding::GZIP;
+    }
+    if (deflate > 0)
+    {
+        return ContentCoding::DEFLATE;
+    }
+    return ContentCoding::IDENTITY;
+}
+
+const char *contentCodingName(ContentCoding coding)
+{
+    switch (coding)
+    {
+    case ContentCoding::GZIP:
+        return "gzip";
+    case ContentCoding::DEFLATE:
+        return "deflate";
+    default:
+        return nullptr;
+    }
+}
+
+bool isCompressibleType(const std::string &contentType)
+{
+    for (const char *type : cIncompressibleTypes)
+    {
+        if (strncasecmp(contentType.c_str(), type, std::strlen(type)) == 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool compress(const char *data, std::size_t size, ContentCoding coding, int level, std::string &output)
+{
+    if (coding == ContentCoding::IDENTITY)
+    {
+        return false;
+    }
+
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    const int windowBits = coding == ContentCoding::GZIP ? cGzipWindowBits : cWindowBits;
+    if (deflateInit2(&stream, level, Z_DEFLATED, windowBits, cMemoryLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        return false;
+    }
+
+    // the result is not kept if it is larger than the data
+    output.resize(deflateBound(&stream, static_cast<uLong>(size)));
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    stream.avail_in = static_cast<uInt>(size);
+    stream.next_out = reinterpret_cast<Bytef *>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    const int result = deflate(&stream, Z_FINISH);
+    output.resize(stream.total_out);
+    deflateEnd(&stream);
+
+    if (result != Z_STREAM_END || output.size() >= size)
+    {
+        output.clear();
+        return false;
+    }
+    return true;
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+enum class ContentCoding
+{
+    IDENTITY,
+    GZIP,
+    DEFLATE,
+};
+
+/*!
+  Chooses the coding of a response from Accept-Encoding header, gzip is preferred on equal weights
+  \param[in] acceptEncoding Value of the header, e.g. "deflate, gzip;q=0.8, *;q=0"
+  \return Accepted coding with the highest weight or IDENTITY
+*/
+ContentCoding negotiateContentCoding(const std::string &acceptEncoding);
+
+/*!
+  \return Token of Content-Encoding header, nullptr for IDENTITY
+*/
+const char *contentCodingName(ContentCoding coding);
+
+/*!
+  Tells whether compression of the media type is worth trying, types which are compressed by their
+  format (images, audio, video, archives) are not
+  \param[in] contentType Value of Content-Type header, may be empty
+*/
+bool isCompressibleType(const std::string &contentType);
+
+/*!
+  Compresses the data with zlib
+  \param[in] data Data to compress
+  \param[in] size Size of the data
+  \param[in] coding GZIP or DEFLATE (zlib format, as HTTP defines it)
+  \param[in] level 1 (fastest) to 9 (smallest)
+  \param[out] output Compressed data
+  \return false if compression failed or didn't make the data smaller
+*/
+bool compress(const char *data, std::size_t size, ContentCoding coding, int level, std::string &output);
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,248 @@
+#include "file_cache.hh"
+#include "compression.hh"
+
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+// entries without contents are small, but they must not grow without limit either
+constexpr std::size_t cMaxEntries = 4096;
+const char *const cHttpDateFormat = "%a, %d %b %Y %H:%M:%S GMT";
+
+std::shared_ptr<const std::string> readFile(const std::string &path, uint64_t size)
+{
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+    {
+        return nullptr;
+    }
+    std::shared_ptr<std::string> content = std::make_shared<std::string>(size, '\0');
+    std::size_t received = 0;
+    while (received < size)
+    {
+        ssize_t length = ::read(fd, &(*content)[received], size - received);
+        if (length < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (length <= 0)
+        {
+            // the file has been changed meanwhile, it is checked again next time
+            content.reset();
+            break;
+        }
+        received += static_cast<std::size_t>(length);
+    }
+    ::close(fd);
+    return content;
+}
+} // namespace
+
+FileCache::FileCache(std::size_t budget, std::size_t maxFileSize, std::chrono::milliseconds revalidatePeriod)
+    : _budget(budget)
+    , _maxFileSize(maxFileSize)
+    , _revalidatePeriod(revalidatePeriod)
+{
+}
+
+bool FileCache::Entry::describes(const struct stat &st) const
+{
+    return inode == static_cast<uint64_t>(st.st_ino) && size == static_cast<uint64_t>(st.st_size) &&
+           mtimeNs == static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+FileCache::EntrySPtr FileCache::get(const std::string &path)
+{
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _nodes.find(path);
+        if (iter != _nodes.end() && now - iter->second.validated < _revalidatePeriod)
+        {
+            _lru.splice(_lru.begin(), _lru, iter->second.lru);
+            return iter->second.entry;
+        }
+    }
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _nodes.find(path);
+        if (iter != _nodes.end())
+        {
+            erase(iter);
+        }
+        return nullptr;
+    }
+    const int64_t mtimeNs = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+    const uint64_t size = static_cast<uint64_t>(st.st_size);
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _nodes.find(path);
+        if (iter != _nodes.end() && iter->second.entry->describes(st))
+        {
+            iter->second.validated = now;
+            _lru.splice(_lru.begin(), _lru, iter->second.lru);
+            return iter->second.entry;
+        }
+    }
+
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    entry->inode = st.st_ino;
+    entry->mtimeNs = mtimeNs;
+    entry->size = size;
+    entry->mtime = st.st_mtim.tv_sec;
+    char etag[64];
+    snprintf(etag, sizeof(etag), "\"%" PRIx64 "-%" PRIx64 "-%" PRIx64 "\"", static_cast<uint64_t>(st.st_ino), size,
+             static_cast<uint64_t>(mtimeNs));
+    entry->etag = etag;
+    entry->lastModified = httpDate(entry->mtime);
+    if (size <= _maxFileSize && size <= _budget)
+    {
+        entry->content = readFile(path, size);
+    }
+
+    Node node;
+    node.entry = entry;
+    node.validated = now;
+    node.gzipTried = false;
+    insert(path, std::move(node));
+    return entry;
+}
+
+void FileCache::invalidate(const std::string &path)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _nodes.find(path);
+    if (iter != _nodes.end())
+    {
+        iter->second.validated = std::chrono::steady_clock::time_point();
+    }
+}
+
+std::shared_ptr<const std::string> FileCache::gzipped(const std::string &path, const EntrySPtr &entry, int level)
+{
+    if (!entry->content)
+    {
+        return nullptr;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto iter = _nodes.find(path);
+        if (iter != _nodes.end() && iter->second.entry == entry && iter->second.gzipTried)
+        {
+            return iter->second.gzip;
+        }
+    }
+
+    // concurrent requests may compress the same file, only one result is kept
+    std::shared_ptr<std::string> compressed = std::make_shared<std::string>();
+    if (!compress(entry->content->data(), entry->content->size(), ContentCoding::GZIP, level, *compressed))
+    {
+        compressed.reset();
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _nodes.find(path);
+    if (iter != _nodes.end() && iter->second.entry == entry && !iter->second.gzipTried)
+    {
+        iter->second.gzipTried = true;
+        iter->second.gzip = compressed;
+        if (compressed)
+        {
+            _memoryUsage += compressed->size();
+            shrink();
+        }
+    }
+    return compressed;
+}
+
+std::size_t FileCache::memoryUsage() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _memoryUsage;
+}
+
+std::string FileCache::httpDate(std::time_t time)
+{
+    struct tm tm;
+    gmtime_r(&time, &tm);
+    char buffer[64];
+    std::size_t length = strftime(buffer, sizeof(buffer), cHttpDateFormat, &tm);
+    return std::string(buffer, length);
+}
+
+std::time_t FileCache::parseHttpDate(const std::string &str)
+{
+    struct tm tm;
+    std::memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(str.c_str(), cHttpDateFormat, &tm);
+    if (!end || *end != '\0')
+    {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+void FileCache::insert(const std::string &path, Node &&node)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto iter = _nodes.find(path);
+    if (iter != _nodes.end())
+    {
+        erase(iter);
+    }
+
+    _lru.push_front(path);
+    node.lru = _lru.begin();
+    if (node.entry->content)
+    {
+        _memoryUsage += node.entry->content->size();
+    }
+    _nodes.emplace(path, std::move(node));
+    shrink();
+}
+
+void FileCache::shrink()
+{
+    while ((_memoryUsage > _budget || _nodes.size() > cMaxEntries) && _lru.size() > 1)
+    {
+        erase(_nodes.find(_lru.back()));
+    }
+}
+
+void FileCache::erase(std::unordered_map<std::string, Node>::iterator iter)
+{
+    if (iter->second.entry->content)
+    {
+        _memoryUsage -= iter->second.entry->content->size();
+    }
+    if (iter->second.gzip)
+    {
+        _memoryUsage -= iter->second.gzip->size();
+    }
+    _lru.erase(iter->second.lru);
+    _nodes.erase(iter);
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+struct stat;
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Metadata and contents of files sent by the server.
+
+  A file is checked with stat() at most once per revalidation period, a change of its size, modification
+  time or inode replaces the entry. Contents of small files are kept in memory within a byte budget, the
+  least recently used ones are dropped first. The ETag is built from the inode, size and modification time
+  in nanoseconds, so it changes whenever the file does and doesn't need the contents to be read.
+  Compressed variants of the contents are kept with their entries and share the budget.
+*/
+class FileCache final
+{
+public:
+    struct Entry
+    {
+        /*!
+          \return true if the file of the status is the one of the entry and it has not changed since
+        */
+        bool describes(const struct stat &st) const;
+
+        uint64_t inode;
+        int64_t mtimeNs;
+        uint64_t size;
+        std::time_t mtime;
+        std::string etag;         // quoted as sent in the header
+        std::string lastModified; // HTTP date
+        std::shared_ptr<const std::string> content; // nullptr if the file is not kept in memory
+    };
+    using EntrySPtr = std::shared_ptr<const Entry>;
+
+    /*!
+      \param[in] budget Bytes of file contents kept in memory, 0 disables caching of contents
+      \param[in] maxFileSize Files larger than that are never kept in memory
+      \param[in] revalidatePeriod Time an entry is used without checking the file
+    */
+    FileCache(std::size_t budget, std::size_t maxFileSize,
+              std::chrono::milliseconds revalidatePeriod = std::chrono::seconds(1));
+
+    /*!
+      \param[in] path Path to the file
+      \return Entry or nullptr if the file doesn't exist or it is not a regular file
+    */
+    EntrySPtr get(const std::string &path);
+
+    /*!
+      Makes the next get() check the file, e.g. when the file opened to be sent differs from the entry
+      \param[in] path Path to the file
+    */
+    void invalidate(const std::string &path);
+
+    /*!
+      Contents of the file compressed with gzip, they are made once and kept with the entry
+      \param[in] path Path to the file
+      \param[in] entry Entry returned by get()
+      \param[in] level Compression level from 1 to 9
+      \return Compressed contents or nullptr if the contents are not in memory or don't compress
+    */
+    std::shared_ptr<const std::string> gzipped(const std::string &path, const EntrySPtr &entry, int level);
+
+    /*!
+      \return Bytes of file contents in memory
+    */
+    std::size_t memoryUsage() const;
+
+    /*!
+      Formats the time as HTTP date (RFC 7231), e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+    */
+    static std::string httpDate(std::time_t time);
+
+    /*!
+      Parses HTTP date
+      \return Time or -1 if the string is malformed
+    */
+    static std::time_t parseHttpDate(const std::string &str);
+
+private:
+    struct Node
+    {
+        EntrySPtr entry;
+        std::chrono::steady_clock::time_point validated;
+        std::list<std::string>::iterator lru;
+        std::shared_ptr<const std::string> gzip;
+        bool gzipTried;
+    };
+
+    void insert(const std::string &path, Node &&node);
+    void erase(std::unordered_map<std::string, Node>::iterator iter);
+    void shrink();
+
+    const std::size_t _budget;
+    const std::size_t _maxFileSize;
+    const std::chrono::milliseconds _revalidatePeriod;
+
+    mutable std::mutex _mutex;
+    std::unordered_map<std::string, Node> _nodes;
+    std::list<std::string> _lru; // the most recently used path goes first
+    std::size_t _memoryUsage{0};
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,105 @@
+#include "http_completion_impl.hh"
+#include "http_connection_impl.hh"
+#include "utils.hh"
+
+#include <common/net/http/http_server.hh>
+
+#include <microhttpd.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+DeferredRequest::DeferredRequest(HttpConnectionImpl &connection, MHD_Connection *mhdConnection, bool canSuspend)
+    : _connection(&connection)
+    , _mhdConnection(mhdConnection)
+    , _canSuspend(canSuspend)
+{
+}
+
+bool DeferredRequest::complete(const std::function<void(IHttpConnection &connection)> &respond)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!_connection || _completed)
+    {
+        return false;
+    }
+    try
+    {
+        respond(*_connection);
+    }
+    catch (const std::exception &ex)
+    {
+        LOGE(LOG_DOMAIN, "Deferred request %s is failed: %s", _connection->get().c_str(), ex.what());
+        _connection->setError(HttpStatusCode::STATUS_INTERNAL_ERROR);
+    }
+    if (!_connection->error())
+    {
+        _connection->setError(HttpStatusCode::STATUS_OK);
+    }
+    _completed = true;
+    _completion.notify_all();
+    if (_suspended)
+    {
+        MHD_resume_connection(_mhdConnection);
+    }
+    return true;
+}
+
+bool DeferredRequest::suspend()
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (!_canSuspend)
+    {
+        while (!_completed)
+        {
+            _completion.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+    if (_completed)
+    {
+        return false;
+    }
+    MHD_suspend_connection(_mhdConnection);
+    _suspended = true;
+    return true;
+}
+
+bool DeferredRequest::resumed() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _suspended && _completed;
+}
+
+void DeferredRequest::detach()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _connection = nullptr;
+}
+
+HttpCompletionImpl::HttpCompletionImpl(std::shared_ptr<DeferredRequest> request)
+    : _request(std::move(request))
+{
+}
+
+HttpCompletionImpl::~HttpCompletionImpl()
+{
+    // the client must not wait forever for the request nobody is going to complete
+    _request->complete([](IHttpConnection &connection) {
+        connection.setError(HttpStatusCode::STATUS_INTERNAL_ERROR, "The request has not been completed");
+    });
+}
+
+bool HttpCompletionImpl::complete(const std::function<void(IHttpConnection &connection)> &respond)
+{
+    return _request->complete(respond);
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <common/net/http/http_connection.hh>
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+struct MHD_Connection;
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+class HttpConnectionImpl;
+
+/*!
+  State of a request which response is deferred, shared by the connection and the completions. The connection
+  is suspended by the server thread once the handler has returned and resumed by the completion, the mutex
+  orders the two, so a request completed before the handler returns is answered at once.
+
+  libmicrohttpd can't suspend a connection which has its own thread, such a thread just waits for the completion.
+*/
+class DeferredRequest final
+{
+public:
+    /*!
+      \param[in] canSuspend false if the connection has its own thread
+    */
+    DeferredRequest(HttpConnectionImpl &connection, struct MHD_Connection *mhdConnection, bool canSuspend);
+
+    DeferredRequest(const DeferredRequest &) = delete;
+    DeferredRequest &operator=(const DeferredRequest &) = delete;
+
+    /*!
+      \return false if the request is over or it has been completed already
+    */
+    bool complete(const std::function<void(IHttpConnection &connection)> &respond);
+
+    /*!
+      Suspends the connection until the request is completed
+      \return false if it is completed already, or it has been waited for
+    */
+    bool suspend();
+
+    /*!
+      \return true if the request has been completed after the connection was suspended
+    */
+    bool resumed() const;
+
+    /*!
+      Called when the request is over, later completions do nothing
+    */
+    void detach();
+
+private:
+    mutable std::mutex _mutex;
+    std::condition_variable _completion;
+    HttpConnectionImpl *_connection;
+    struct MHD_Connection *_mhdConnection;
+    const bool _canSuspend;
+    bool _suspended{false};
+    bool _completed{false};
+};
+
+class HttpCompletionImpl final : public IHttpCompletion
+{
+public:
+    explicit HttpCompletionImpl(std::shared_ptr<DeferredRequest> request);
+    ~HttpCompletionImpl() override;
+
+    bool complete(const std::function<void(IHttpConnection &connection)> &respond) override;
+
+private:
+    std::shared_ptr<DeferredRequest> _request;
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -18,12 +18,27 @@ namespace net
 {
 namespace http
 {
+namespace
+{
+int formIterator(void *cls, MHD_ValueKind kind, const char *key, const char *filename, const char *contentType,
+                 const char *transferEncoding, const char *data, uint64_t off, size_t size)
+{
+    (void)kind;
+    (void)transferEncoding;
+    HttpConnectionImpl *connection = static_cast<HttpConnectionImpl *>(cls);
+    return connection->passFormChunk(FormChunk{key, filename, contentType, off, DataView{data, size}}) ? MHD_YES
+                                                                                                        : MHD_NO;
+}
+} // namespace
+
 /// Implementation of HttpConnectionImpl
-HttpConnectionImpl::HttpConnectionImpl(MHD_Connection *connection, const std::string &url, Method method,
-                                       const std::string &body, HttpServerImpl &owner)
+HttpConnectionImpl::HttpConnectionImpl(MHD_Connection *connection, const char *url, Method method,
+                                       HttpServerImpl &owner)
     : _connection(connection)
     , _url(url)
-    , _body(body)
+    , _urlLength(std::strlen(url))
+    , _pathLength(std::strcspn(url, "?"))
+    , _body(owner.settings().bodySpoolThreshold, owner.settings().bodySpoolDirectory)
     , _owner(owner)
     , _method(method)
 {
@@ -32,6 +47,19 @@ HttpConnectionImpl::HttpConnectionImpl(MHD_Connection *connection, const std::st
 
 HttpConnectionImpl::~HttpConnectionImpl()
 {
+    if (_postProcessor)
+    {
+        MHD_destroy_post_processor(_postProcessor);
+    }
+    if (_stream)
+    {
+        // a producer thread must not wait for the request which is over
+        _stream->abort();
+    }
+    if (_deferred)
+    {
+        _deferred->detach();
+    }
     _owner.decConnectionCounter();
 }
 
@@ -59,6 +87,9 @@ std::string HttpConnectionImpl::clientDescription() const
         result = s;
         break;
     }
+    case AF_UNIX:
+        result = "unix";
+        break;
     default:
         break;
     }
@@ -72,6 +103,12 @@ std::string HttpConnectionImpl::header(const std::string &name) const
     return value ? value : "";
 }
 
+DataView HttpConnectionImpl::headerView(const char *name) const
+{
+    const char *value = MHD_lookup_connection_value(_connection, MHD_HEADER_KIND, name);
+    return value ? DataView{value, std::strlen(value)} : DataView{};
+}
+
 bool HttpConnectionImpl::requestHasHeader(const std::string &name) const
 {
     return MHD_lookup_connection_value(_connection, MHD_HEADER_KIND, name.c_str()) != nullptr ? true : false;
@@ -127,8 +164,7 @@ void HttpConnectionImpl::setError(int error, const std::string &error_message)
 
 std::string HttpConnectionImpl::path() const
 {
-    std::size_t pos = _url.find('?');
-    return ((pos != std::string::npos) ? _url.substr(0, pos) : _url);
+    return std::string(_url, _pathLength);
 }
 
 std::string HttpConnectionImpl::field(const std::string &name) const
@@ -147,16 +183,123 @@ bool HttpConnectionImpl::hasField(const std::string &name) const
 IHttpConnection &HttpConnectionImpl::operator<<(const std::string &output)
 {
     _streamName.clear();
-    _strResponse << output;
+    _response.append(output);
+    return *this;
+}
+
+IHttpConnection &HttpConnectionImpl::operator<<(std::string &&output)
+{
+    _streamName.clear();
+    // the reserved buffer is kept if it is large enough
+    if (_response.empty() && output.size() > _response.capacity())
+    {
+        _response = std::move(output);
+    }
+    else
+    {
+        _response.append(output);
+    }
     return *this;
 }
 
 void HttpConnectionImpl::sendFile(const std::string &filepath)
 {
-    _strResponse.clear();
+    _response.clear();
     _streamName = filepath;
 }
 
+void HttpConnectionImpl::consumeBody(BodyConsumer consumer)
+{
+    _bodyConsumer = std::move(consumer);
+}
+
+bool HttpConnectionImpl::consumeForm(FormConsumer consumer)
+{
+    if (!_postProcessor)
+    {
+        // fails unless the body is a form
+        _postProcessor = MHD_create_post_processor(_connection, cFileBlockSize, &formIterator, this);
+        if (!_postProcessor)
+        {
+            return false;
+        }
+    }
+    _formConsumer = std::move(consumer);
+    return true;
+}
+
+bool HttpConnectionImpl::appendBodyData(const char *data, std::size_t data_size)
+{
+    _bodySize += data_size;
+    const std::size_t maxBodySize = _owner.settings().maxBodySize;
+    if (maxBodySize && _bodySize > maxBodySize)
+    {
+        LOGW(LOG_DOMAIN, "Request body is larger than %zu bytes", maxBodySize);
+        return false;
+    }
+    if (_postProcessor)
+    {
+        return MHD_post_process(_postProcessor, data, data_size) == MHD_YES;
+    }
+    if (_bodyConsumer)
+    {
+        return _bodyConsumer(DataView{data, data_size});
+    }
+    return _body.append(data, data_size);
+}
+
+bool HttpConnectionImpl::finishBody()
+{
+    if (_postProcessor)
+    {
+        // the last field is passed to the consumer here
+        const bool complete = MHD_destroy_post_processor(_postProcessor) == MHD_YES;
+        _postProcessor = nullptr;
+        if (!complete)
+        {
+            setError(MHD_HTTP_BAD_REQUEST, "Malformed form data");
+            return false;
+        }
+    }
+    if (!_body.finish())
+    {
+        setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+        return false;
+    }
+    return true;
+}
+
+bool HttpConnectionImpl::passFormChunk(const FormChunk &chunk)
+{
+    return !_formConsumer || _formConsumer(chunk);
+}
+
+IHttpStream::SPtr HttpConnectionImpl::startStream(IHttpStream::Producer producer, std::size_t bufferSize)
+{
+    _streamName.clear();
+    const bool ownThread = _owner.settings().threading == IHttpServer::ThreadingMode::THREAD_PER_CONNECTION;
+    _stream = std::make_shared<HttpStreamImpl>(std::move(producer), bufferSize, _owner.goingToStop(),
+                                               ownThread ? nullptr : _connection);
+    return _stream;
+}
+
+IHttpStream::SPtr HttpConnectionImpl::startEventStream()
+{
+    setResponseHeader("Content-Type", "text/event-stream");
+    setResponseHeader("Cache-Control", "no-cache");
+    return startStream(nullptr, 64 * 1024);
+}
+
+IHttpCompletion::SPtr HttpConnectionImpl::defer()
+{
+    if (!_deferred)
+    {
+        const bool ownThread = _owner.settings().threading == IHttpServer::ThreadingMode::THREAD_PER_CONNECTION;
+        _deferred = std::make_shared<DeferredRequest>(*this, _connection, !ownThread);
+    }
+    return std::make_shared<HttpCompletionImpl>(_deferred);
+}
+
 void HttpConnectionImpl::attachSession(HttpSession::SPtr session)
 {
     session->extendExpiration(system::TimeProvider::instance()->now() + cSessionLifeTimeMin * cSecInMin);
@@ -1,13 +1,17 @@
 #pragma once
 
+#include "http_completion_impl.hh"
 #include "http_connection.hh"
+#include "http_stream_impl.hh"
+#include "request_body.hh"
 
 #include <atomic>
 #include <map>
+#include <cstring>
 #include <string>
-#include <sstream>
 
 struct MHD_Connection;
+struct MHD_PostProcessor;
 
 namespace softeq
 {
@@ -25,14 +29,19 @@ public:
     using HttpHeader = std::pair<std::string, std::string>;
     using HttpHeaders = std::map<std::string, std::string>;
 
-    HttpConnectionImpl(struct MHD_Connection *connection, const std::string &url, Method method,
-                       const std::string &body, HttpServerImpl &owner);
+    /*!
+      \param[in] url URL of the request, it is not copied since libmicrohttpd keeps it until the request
+      is completed
+    */
+    HttpConnectionImpl(struct MHD_Connection *connection, const char *url, Method method, HttpServerImpl &owner);
     ~HttpConnectionImpl() override;
 
     std::string clientDescription() const override final;
 
     std::string header(const std::string &name) const override;
 
+    DataView headerView(const char *name) const override;
+
     bool requestHasHeader(const std::string &name) const override;
 
     bool responseHasHeader(const std::string &name) const override;
@@ -48,7 +57,7 @@ public:
     bool setCookie(const std::string &key, const std::string &value) override;
 
     // TODO: have to be refactored to MHD_response* getResponce() where all cases will be processed
-    HttpHeaders responseHeaders() const;
+    const HttpHeaders &responseHeaders() const;
 
     void setError(int error, const std::string &error_message) override;
 
@@ -58,23 +67,82 @@ public:
 
     std::string get() const override;
 
+    DataView getView() const override;
+
     std::string body() const override;
 
+    DataView bodyView() const override;
+
     std::string path() const override;
 
+    DataView pathView() const override;
+
     std::string field(const std::string &name) const override;
 
     bool hasField(const std::string &name) const override;
 
     IHttpConnection &operator<<(const std::string &output) override;
 
+    IHttpConnection &operator<<(std::string &&output) override;
+
+    void reserveResponse(std::size_t size) override;
+
     void sendFile(const std::string &filepath) override;
 
+    IHttpStream::SPtr startStream(IHttpStream::Producer producer, std::size_t bufferSize) override;
+
+    IHttpStream::SPtr startEventStream() override;
+
     std::string streamName() const;
 
+    const std::shared_ptr<HttpStreamImpl> &stream() const;
+
     std::string strResponse() const;
 
-    void appendBodyData(const char *data, std::size_t data_size);
+    /*!
+      Moves the response out, the connection is left with an empty one
+    */
+    std::string takeResponse();
+
+    IHttpCompletion::SPtr defer() override;
+
+    /*!
+      \return true if the handler has deferred the response
+    */
+    bool deferred() const;
+
+    /*!
+      Suspends the connection if the response is deferred and not ready yet
+      \return true if the connection is suspended, the response is sent when the request is completed
+    */
+    bool suspendIfDeferred();
+
+    /*!
+      \return true if the deferred request has been completed and it has only to be answered
+    */
+    bool resumed() const;
+
+    void consumeBody(BodyConsumer consumer) override;
+
+    bool consumeForm(FormConsumer consumer) override;
+
+    /*!
+      Passes a chunk of the body to its consumer or collects it
+      \return false if the request has to be aborted
+    */
+    bool appendBodyData(const char *data, std::size_t data_size);
+
+    /*!
+      Completes the body before the request is handled
+      \return false if the body is broken, the error is set
+    */
+    bool finishBody();
+
+    /*!
+      Passes a field of the form to its consumer
+      \return false if the request has to be aborted
+    */
+    bool passFormChunk(const FormChunk &chunk);
 
     void attachSession(HttpSession::SPtr session) final override;
 
@@ -89,12 +157,20 @@ private:
     const int cSecInMin = 60;
 
     struct MHD_Connection *_connection;
-    std::string _url;
-    std::string _body;
+    const char *_url;
+    std::size_t _urlLength;
+    std::size_t _pathLength;
+    RequestBody _body;
+    std::size_t _bodySize{0}; // including the consumed data
+    BodyConsumer _bodyConsumer;
+    FormConsumer _formConsumer;
+    struct MHD_PostProcessor *_postProcessor{nullptr};
     HttpServerImpl &_owner;
     int _error = 0;
     std::string _streamName;
-    std::stringstream _strResponse;
+    std::shared_ptr<HttpStreamImpl> _stream;
+    std::shared_ptr<DeferredRequest> _deferred;
+    std::string _response;
     HttpHeaders _responseHeaders;
     Method _method;
 
@@ -113,12 +189,27 @@ inline int HttpConnectionImpl::error() const
 
 inline std::string HttpConnectionImpl::get() const
 {
-    return _url;
+    return std::string(_url, _urlLength);
+}
+
+inline DataView HttpConnectionImpl::getView() const
+{
+    return DataView{_url, _urlLength};
 }
 
 inline std::string HttpConnectionImpl::body() const
 {
-    return _body;
+    return _body.view().str();
+}
+
+inline DataView HttpConnectionImpl::bodyView() const
+{
+    return _body.view();
+}
+
+inline DataView HttpConnectionImpl::pathView() const
+{
+    return DataView{_url, _pathLength};
 }
 
 inline void HttpConnectionImpl::setResponseHeader(const std::string &name, const std::string &content)
@@ -127,7 +218,7 @@ inline void HttpConnectionImpl::setResponseHeader(const std::string &name, const
 }
 
 // TODO: have to be refactored to MHD_response* getResponce() where all cases will be processed
-inline HttpConnectionImpl::HttpHeaders HttpConnectionImpl::responseHeaders() const
+inline const HttpConnectionImpl::HttpHeaders &HttpConnectionImpl::responseHeaders() const
 {
     return _responseHeaders;
 }
@@ -139,12 +230,19 @@ inline std::string HttpConnectionImpl::streamName() const
 
 inline std::string HttpConnectionImpl::strResponse() const
 {
-    return _strResponse.str();
+    return _response;
 }
 
-inline void HttpConnectionImpl::appendBodyData(const char *data, std::size_t data_size)
+inline std::string HttpConnectionImpl::takeResponse()
 {
-    _body.append(data, data_size);
+    std::string response;
+    response.swap(_response);
+    return response;
+}
+
+inline void HttpConnectionImpl::reserveResponse(std::size_t size)
+{
+    _response.reserve(size);
 }
 
 inline void HttpConnectionImpl::detachSession()
@@ -152,6 +250,26 @@ inline void HttpConnectionImpl::detachSession()
     _session.reset();
 }
 
+inline const std::shared_ptr<HttpStreamImpl> &HttpConnectionImpl::stream() const
+{
+    return _stream;
+}
+
+inline bool HttpConnectionImpl::deferred() const
+{
+    return static_cast<bool>(_deferred);
+}
+
+inline bool HttpConnectionImpl::suspendIfDeferred()
+{
+    return _deferred && _deferred->suspend();
+}
+
+inline bool HttpConnectionImpl::resumed() const
+{
+    return _deferred && _deferred->resumed();
+}
+
 inline Method HttpConnectionImpl::method() const
 {
     return _method;
@@ -24,3 +24,28 @@ void HttpServer::stop()
 {
     _impl->stop();
 }
+
+int HttpServer::pollDescriptor() const
+{
+    return _impl->pollDescriptor();
+}
+
+long HttpServer::pollTimeout() const
+{
+    return _impl->pollTimeout();
+}
+
+bool HttpServer::run()
+{
+    return _impl->run();
+}
+
+HttpLoadStats HttpServer::loadStats() const
+{
+    return _impl->loadStats();
+}
+
+bool HttpServer::reloadCertificate()
+{
+    return _impl->reloadCertificate();
+}
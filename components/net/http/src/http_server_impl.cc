@@ -1,24 +1,33 @@
 #include "http_server_impl.hh"
+#include "compression.hh"
 #include "http_connection_impl.hh"
 
 #include <common/system/cron.hh>
-#include <common/system/fsutils.hh>
 #include <common/system/time_provider.hh>
 #include <common/logging/log.hh>
+#include <common/stdutils/hash.hh>
 #include <common/stdutils/optional.hh>
 #include <common/stdutils/timeutils.hh>
 #include <common/stdutils/stdutils.hh>
 
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
 #include <cstring>
 #include <memory>
+#include <thread>
+#include <vector>
 
 #include <fcntl.h>
 #include <cinttypes>
+#include <strings.h>
 #include <sys/stat.h>
 
+#include <sys/epoll.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 
@@ -26,21 +35,151 @@
 
 namespace
 {
+const char *const cPrecompressedSuffix = ".gz";
+constexpr int cFileAttempts = 3;
+
+// socket context of every accepted connection
+struct AcceptedConnection
+{
+    softeq::common::net::http::LoadShedder::Clock::time_point accepted;
+    bool measured;   // the first request is accounted in the load shedding
+    bool overloaded; // accepted beyond maxConnections, its requests are rejected
+};
+
+AcceptedConnection *acceptedConnection(MHD_Connection *connection)
+{
+    const MHD_ConnectionInfo *info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_SOCKET_CONTEXT);
+    return info ? static_cast<AcceptedConnection *>(info->socket_context) : nullptr;
+}
+
 const std::map<std::string, softeq::common::net::http::Method> methodTypeFromString{
     {MHD_HTTP_METHOD_GET, softeq::common::net::http::Method::GET},
     {MHD_HTTP_METHOD_POST, softeq::common::net::http::Method::POST},
     {MHD_HTTP_METHOD_PUT, softeq::common::net::http::Method::PUT},
     {MHD_HTTP_METHOD_DELETE, softeq::common::net::http::Method::DELETE},
-    {MHD_HTTP_METHOD_OPTIONS, softeq::common::net::http::Method::OPTIONS}};
+    {MHD_HTTP_METHOD_OPTIONS, softeq::common::net::http::Method::OPTIONS},
+    {MHD_HTTP_METHOD_HEAD, softeq::common::net::http::Method::HEAD}};
+
+const std::string cUnixAddressPrefix = "unix:";
 
-sockaddr_in createAddressFor(const std::string &ipAddress, uint16_t port)
+bool createAddressFor(const std::string &ipAddress, uint16_t port, sockaddr_in &addressToUse)
 {
-    sockaddr_in addressToUse;
+    addressToUse = sockaddr_in();
     addressToUse.sin_family = AF_INET;
     addressToUse.sin_port = htons(port);
-    inet_pton(AF_INET, ipAddress.c_str(), &addressToUse.sin_addr);
+    return inet_pton(AF_INET, ipAddress.c_str(), &addressToUse.sin_addr) == 1;
+}
+
+// the address may be enclosed in brackets as in URLs
+bool createAddressFor(const std::string &ipAddress, uint16_t port, sockaddr_in6 &addressToUse)
+{
+    std::string host = ipAddress;
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+    {
+        host = host.substr(1, host.size() - 2);
+    }
+    addressToUse = sockaddr_in6();
+    addressToUse.sin6_family = AF_INET6;
+    addressToUse.sin6_port = htons(port);
+    return inet_pton(AF_INET6, host.c_str(), &addressToUse.sin6_addr) == 1;
+}
+
+// path starting with '@' is the name of an abstract socket, which has no file
+int openUnixSocket(const std::string &path, int backlog)
+{
+    sockaddr_un address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path))
+    {
+        LOGE(LOG_DOMAIN, "Invalid Unix domain socket path '%s'", path.c_str());
+        return -1;
+    }
+    std::memcpy(address.sun_path, path.data(), path.size());
+    socklen_t length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    if (path[0] == '@')
+    {
+        address.sun_path[0] = '\0';
+    }
+    else
+    {
+        ++length;
+        // a file left by the previous run prevents binding
+        struct stat st;
+        if (lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+        {
+            unlink(path.c_str());
+        }
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1 || bind(fd, reinterpret_cast<sockaddr *>(&address), length) != 0 || listen(fd, backlog) != 0)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't listen on Unix domain socket '%s': %s", path.c_str(), strerror(errno));
+        if (fd != -1)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
 
-    return addressToUse;
+// checks If-None-Match list of entity tags against the tag of the file, weak tags match too
+bool etagMatches(const std::string &list, const std::string &etag)
+{
+    std::size_t pos = 0;
+    while (pos < list.size())
+    {
+        std::size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+        std::size_t first = list.find_first_not_of(" \t", pos);
+        std::size_t last = list.find_last_not_of(" \t", end - 1);
+        if (first != std::string::npos && first < end && last >= first)
+        {
+            if (list.compare(first, 2, "W/") == 0)
+            {
+                first += 2;
+            }
+            const std::size_t length = last - first + 1;
+            if (list.compare(first, length, "*") == 0 || list.compare(first, length, etag) == 0)
+            {
+                return true;
+            }
+        }
+        pos = end + 1;
+    }
+    return false;
+}
+
+// checks whether a Vary list names the request header, "*" varies on everything already
+bool varyLists(const std::string &list, const char *name)
+{
+    const std::size_t nameLength = std::strlen(name);
+    std::size_t pos = 0;
+    while (pos < list.size())
+    {
+        std::size_t end = list.find(',', pos);
+        if (end == std::string::npos)
+        {
+            end = list.size();
+        }
+        std::size_t first = list.find_first_not_of(" \t", pos);
+        std::size_t last = list.find_last_not_of(" \t", end - 1);
+        if (first != std::string::npos && first < end && last >= first)
+        {
+            const std::size_t length = last - first + 1;
+            if (list.compare(first, length, "*") == 0 ||
+                (length == nameLength && strncasecmp(list.c_str() + first, name, length) == 0))
+            {
+                return true;
+            }
+        }
+        pos = end + 1;
+    }
+    return false;
 }
 
 } // namespace
@@ -57,10 +196,16 @@ namespace http
 HttpServerImpl::HttpServerImpl(const IHttpServer::settings_t &settings, IHttpConnectionDispatcher &dispatcher)
     : _settings(settings)
     , _dispatcher(dispatcher)
+    , _sessions(system::TimeProvider::instance()->now())
+    , _fileCache(settings.fileCacheSize, settings.fileCacheMaxFileSize)
     , _cron(common::system::CronFactory::create())
 {
     _cron->addJob("Check HTTP sessions expiration", "* * * * * *",
                   std::bind(&HttpServerImpl::pruneSessionsOnExpiration, this));
+    _cron->addJob("Reload changed TLS certificate", "* * * * * *",
+                  std::bind(&HttpServerImpl::reloadChangedCertificate, this));
+    _cron->addJob("Report rejected HTTP requests", "* * * * * *",
+                  std::bind(&HttpServerImpl::reportRejectedRequests, this));
 }
 
 HttpServerImpl::~HttpServerImpl()
@@ -68,7 +213,7 @@ HttpServerImpl::~HttpServerImpl()
     stop();
 }
 
-bool HttpServerImpl::handle(IHttpConnection &connection)
+bool HttpServerImpl::handle(HttpConnectionImpl &connection)
 {
     if (_goingToStop)
     {
@@ -76,7 +221,8 @@ bool HttpServerImpl::handle(IHttpConnection &connection)
         return false;
     }
     bool result = _dispatcher.handle(connection);
-    if (!connection.error())
+    // the completion of a deferred request may be writing the status on another thread, it sets the default itself
+    if (!connection.deferred() && !connection.error())
     {
         connection.setError(HttpStatusCode::STATUS_OK);
     }
@@ -89,9 +235,18 @@ void HttpServerImpl::waitUntilRequestsCompleted()
     constexpr int sleep_us = 100 * 1000;
     constexpr int max_attempts = 10;
 
+    const bool external = _settings.threading == IHttpServer::ThreadingMode::EXTERNAL;
     int attempt = 0;
     while (0 < _connectionsCounter)
     {
+        if (external)
+        {
+            // nobody else completes the requests
+            for (const Listener &listener : _listeners)
+            {
+                MHD_run(listener.daemon);
+            }
+        }
         usleep(sleep_us);
         if (max_attempts <= ++attempt)
         {
@@ -108,6 +263,14 @@ bool HttpServerImpl::start()
         LOGE(LOG_DOMAIN, "HTTPS is not available");
     }
 
+    _rateLimiter.reset(_settings.rateLimit ? new RateLimiter(_settings.rateLimit, _settings.rateLimitBurst,
+                                                             _settings.rateLimitBuckets)
+                                           : nullptr);
+    _loadShedder.reset(_settings.shedTargetDelay
+                           ? new LoadShedder(std::chrono::milliseconds(_settings.shedTargetDelay),
+                                             std::chrono::milliseconds(_settings.shedInterval))
+                           : nullptr);
+
     if (!startServerHttp())
     {
         LOGE(LOG_DOMAIN, "Couldn't start web server!");
@@ -121,9 +284,69 @@ bool HttpServerImpl::start()
     return true;
 }
 
+HttpLoadStats HttpServerImpl::loadStats() const
+{
+    HttpLoadStats result;
+    if (_loadShedder)
+    {
+        const LoadShedder::Stats stats = _loadShedder->stats();
+        result.overloaded = stats.overloaded;
+        result.shedRate = stats.shedRate;
+        result.shedRequests = stats.shedRequests;
+    }
+    return result;
+}
+
+int HttpServerImpl::pollDescriptor() const
+{
+    if (_listeners.empty() || _settings.threading != IHttpServer::ThreadingMode::EXTERNAL)
+    {
+        return -1;
+    }
+    if (_pollFd != -1)
+    {
+        return _pollFd;
+    }
+    const MHD_DaemonInfo *info = MHD_get_daemon_info(_listeners.front().daemon, MHD_DAEMON_INFO_EPOLL_FD);
+    return info ? info->epoll_fd : -1;
+}
+
+long HttpServerImpl::pollTimeout() const
+{
+    std::lock_guard<std::mutex> lock(_runMutex);
+    long result = -1;
+    for (const Listener &listener : _listeners)
+    {
+        MHD_UNSIGNED_LONG_LONG timeout;
+        if (MHD_get_timeout(listener.daemon, &timeout) == MHD_YES &&
+            (result == -1 || static_cast<long>(timeout) < result))
+        {
+            result = static_cast<long>(timeout);
+        }
+    }
+    return result;
+}
+
+bool HttpServerImpl::run()
+{
+    // once stop() has begun it drives the daemons itself
+    std::lock_guard<std::mutex> lock(_runMutex);
+    if (_goingToStop || _listeners.empty() || _settings.threading != IHttpServer::ThreadingMode::EXTERNAL)
+    {
+        return false;
+    }
+    bool result = true;
+    for (const Listener &listener : _listeners)
+    {
+        result = MHD_run(listener.daemon) == MHD_YES && result;
+    }
+    return result;
+}
+
 void HttpServerImpl::stop()
 {
-    if (!_server)
+    std::lock_guard<std::mutex> lock(_runMutex);
+    if (_listeners.empty())
     {
         return;
     }
@@ -131,109 +354,602 @@ void HttpServerImpl::stop()
     _cron->stop();
     LOGD(LOG_DOMAIN, "Stop accepting new requests.");
     _goingToStop = true;
-    MHD_socket fd = MHD_quiesce_daemon(_server);
+    quiesceListeners();
+    wakeStreams();
 
     waitUntilRequestsCompleted();
+    reportRejectedRequests();
 
     LOGD(LOG_DOMAIN, "Stopping of web server...");
-    MHD_stop_daemon(_server);
+    closeListeners();
+    LOGI(LOG_DOMAIN, "Web server stopped.");
+}
 
-    if (fd != MHD_INVALID_SOCKET)
+void HttpServerImpl::quiesceListeners()
+{
+    for (Listener &listener : _listeners)
     {
-        LOGD(LOG_DOMAIN, "Closing socket");
-        close(fd);
+        listener.socket = MHD_quiesce_daemon(listener.daemon);
     }
-    else
+}
+
+void HttpServerImpl::closeListeners()
+{
+    for (const Listener &listener : _listeners)
+    {
+        MHD_stop_daemon(listener.daemon);
+
+        if (listener.socket != MHD_INVALID_SOCKET && listener.socket == _listenSocket)
+        {
+            LOGD(LOG_DOMAIN, "Listening socket is kept open");
+        }
+        else if (listener.socket != MHD_INVALID_SOCKET)
+        {
+            LOGD(LOG_DOMAIN, "Closing socket");
+            close(listener.socket);
+        }
+        else
+        {
+            LOGE(LOG_DOMAIN, "MHD socket is invalid, nothing to close");
+        }
+        if (!listener.path.empty())
+        {
+            unlink(listener.path.c_str());
+        }
+    }
+    _listeners.clear();
+
+    if (_pollFd != -1)
     {
-        LOGE(LOG_DOMAIN, "MHD socket is invalid, nothing to close");
+        close(_pollFd);
+        _pollFd = -1;
     }
-    LOGI(LOG_DOMAIN, "Web server stopped.");
-    _server = nullptr;
 }
 
 bool HttpServerImpl::startServerHttp()
 {
-    assert(_server == nullptr);
+    assert(_listeners.empty());
+
+    unsigned int flags = MHD_USE_DEBUG | MHD_USE_ITC;
+    // connections over the limit are accepted to get a 503 response instead of hanging in the backlog
+    const unsigned connectionLimit = _settings.maxConnections + _settings.overloadConnections;
+    // clang-format off
+    std::vector<MHD_OptionItem> options{
+        {MHD_OPTION_EXTERNAL_LOGGER        , reinterpret_cast<intptr_t>(&mhdLogger), nullptr},
+        {MHD_OPTION_NOTIFY_COMPLETED       , reinterpret_cast<intptr_t>(&mhdRequestCompleted), nullptr},
+        {MHD_OPTION_NOTIFY_CONNECTION      , reinterpret_cast<intptr_t>(&mhdConnectionNotify), this},
+        {MHD_OPTION_CONNECTION_LIMIT       , connectionLimit, nullptr},
+        {MHD_OPTION_PER_IP_CONNECTION_LIMIT, _settings.maxConnectionsPerIp, nullptr},
+        {MHD_OPTION_CONNECTION_TIMEOUT     , _settings.connectionTimeout, nullptr},
+    };
+    // clang-format on
+    if (_settings.maxHeaderSize)
+    {
+        options.push_back({MHD_OPTION_CONNECTION_MEMORY_LIMIT, static_cast<intptr_t>(_settings.maxHeaderSize), nullptr});
+    }
+    if (_settings.listenBacklog)
+    {
+        options.push_back({MHD_OPTION_LISTEN_BACKLOG_SIZE, _settings.listenBacklog, nullptr});
+    }
 
-    sockaddr_in forcedAddress;
-    if (!(_settings.address.empty()))
+    switch (_settings.threading)
     {
-        forcedAddress = createAddressFor(_settings.address, _settings.port);
+    case IHttpServer::ThreadingMode::THREAD_PER_CONNECTION:
+        flags |= MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD;
+        break;
+    case IHttpServer::ThreadingMode::THREAD_POOL:
+        flags |= MHD_USE_EPOLL_INTERNAL_THREAD | MHD_ALLOW_SUSPEND_RESUME;
+        options.push_back({MHD_OPTION_THREAD_POOL_SIZE, static_cast<intptr_t>(threadPoolSize()), nullptr});
+        break;
+    case IHttpServer::ThreadingMode::EXTERNAL:
+        flags |= MHD_USE_EPOLL | MHD_ALLOW_SUSPEND_RESUME;
+        break;
     }
-    sockaddr_in *forcedAddressPtr = (_settings.address.empty()) ? nullptr : &forcedAddress;
 
     if (_settings.enableSecure)
     {
-        if (!common::system::readBinaryFileIntoBuffer(_settings.certFilePath, _certBuffer))
+        // the certificate is given to every handshake, so it can be replaced while the server runs
+        _tlsCredentials.reset(new TlsCredentials);
+        if (!_tlsCredentials->load(_settings.certFilePath, _settings.keyFilePath))
+        {
+            _tlsCredentials.reset();
+            return false;
+        }
+
+        flags |= MHD_USE_TLS;
+        options.push_back({MHD_OPTION_HTTPS_CERT_CALLBACK, 0,
+                           reinterpret_cast<void *>(&TlsCredentials::retrieve)});
+    }
+    else
+    {
+        _tlsCredentials.reset();
+    }
+
+    _openConnections = 0;
+    _listenSocket = _settings.listenSocket;
+    if (_listenSocket == -1 && _settings.socketActivation)
+    {
+        _listenSocket = activatedSocket();
+    }
+
+    std::vector<std::string> addresses{_settings.address};
+    addresses.insert(addresses.end(), _settings.extraAddresses.begin(), _settings.extraAddresses.end());
+    for (std::size_t i = 0; i < addresses.size(); ++i)
+    {
+        // an inherited socket replaces the main address
+        if (!startListener(flags, options, addresses[i], i == 0 ? _listenSocket : -1))
         {
-            LOGE(LOG_DOMAIN, "Couldn't load certificate from file %s.", _settings.certFilePath.c_str());
+            quiesceListeners();
+            closeListeners();
+            return false;
         }
+    }
 
-        if (!common::system::readBinaryFileIntoBuffer(_settings.keyFilePath, _keyBuffer))
+    if (_settings.threading == IHttpServer::ThreadingMode::EXTERNAL && _listeners.size() > 1)
+    {
+        // the application waits on a single descriptor
+        _pollFd = epoll_create1(EPOLL_CLOEXEC);
+        for (const Listener &listener : _listeners)
         {
-            LOGE(LOG_DOMAIN, "Couldn't load key from file %s.", _settings.keyFilePath.c_str());
+            const MHD_DaemonInfo *info = MHD_get_daemon_info(listener.daemon, MHD_DAEMON_INFO_EPOLL_FD);
+            epoll_event event = epoll_event();
+            event.events = EPOLLIN;
+            if (_pollFd == -1 || !info || epoll_ctl(_pollFd, EPOLL_CTL_ADD, info->epoll_fd, &event) != 0)
+            {
+                LOGE(LOG_DOMAIN, "Couldn't join the daemons for polling: %s", strerror(errno));
+                quiesceListeners();
+                closeListeners();
+                return false;
+            }
         }
+    }
+    return true;
+}
+
+bool HttpServerImpl::startListener(unsigned flags, std::vector<MHD_OptionItem> options, const std::string &address,
+                                   int listenSocket)
+{
+    Listener listener{nullptr, std::string(), MHD_INVALID_SOCKET};
+    sockaddr_in addressV4;
+    sockaddr_in6 addressV6;
 
-        // clang-format off
-        _server = MHD_start_daemon(
-            MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_DEBUG |
-            MHD_USE_ITC | MHD_USE_TLS,
-            _settings.port, nullptr, nullptr, &mhdEventHandler, this,
-            MHD_OPTION_EXTERNAL_LOGGER        , mhdLogger, nullptr,
-            MHD_OPTION_NOTIFY_COMPLETED       , mhdRequestCompleted, nullptr,
-            MHD_OPTION_CONNECTION_LIMIT       , cHttpDaemonConnectionsLimit,
-            MHD_OPTION_PER_IP_CONNECTION_LIMIT, cHttpDaemonConnectionsPerIPLimit,
-            MHD_OPTION_LISTENING_ADDRESS_REUSE, cHttpDaemonAddressReuse,
-            MHD_OPTION_SOCK_ADDR              , forcedAddressPtr,
-            MHD_OPTION_HTTPS_MEM_KEY          , _keyBuffer.get(),
-            MHD_OPTION_HTTPS_MEM_CERT         , _certBuffer.get(),
-            MHD_OPTION_END);
-        // clang-format on
+    if (listenSocket != -1)
+    {
+        LOGI(LOG_DOMAIN, "Serving the listening socket %d", listenSocket);
+        options.push_back({MHD_OPTION_LISTEN_SOCKET, listenSocket, nullptr});
+    }
+    else if (address.compare(0, cUnixAddressPrefix.size(), cUnixAddressPrefix) == 0)
+    {
+        const std::string path = address.substr(cUnixAddressPrefix.size());
+        listenSocket = openUnixSocket(path, _settings.listenBacklog ? _settings.listenBacklog : SOMAXCONN);
+        if (listenSocket == -1)
+        {
+            return false;
+        }
+        if (path[0] != '@')
+        {
+            listener.path = path;
+        }
+        options.push_back({MHD_OPTION_LISTEN_SOCKET, listenSocket, nullptr});
     }
     else
     {
-        // clang-format off
-        _server = MHD_start_daemon(
-            MHD_USE_THREAD_PER_CONNECTION | MHD_USE_INTERNAL_POLLING_THREAD | MHD_USE_DEBUG |
-            MHD_USE_ITC,
-            _settings.port, nullptr, nullptr, &mhdEventHandler, this,
-            MHD_OPTION_EXTERNAL_LOGGER        , mhdLogger, nullptr,
-            MHD_OPTION_NOTIFY_COMPLETED       , mhdRequestCompleted, nullptr,
-            MHD_OPTION_CONNECTION_LIMIT       , cHttpDaemonConnectionsLimit,
-            MHD_OPTION_PER_IP_CONNECTION_LIMIT, cHttpDaemonConnectionsPerIPLimit,
-            MHD_OPTION_LISTENING_ADDRESS_REUSE, cHttpDaemonAddressReuse,
-            MHD_OPTION_SOCK_ADDR              , forcedAddressPtr,
-            MHD_OPTION_END);
-        // clang-format on
+        if (_settings.reusePort)
+        {
+            options.push_back({MHD_OPTION_LISTENING_ADDRESS_REUSE, cHttpDaemonAddressReuse, nullptr});
+        }
+        if (address.find(':') != std::string::npos)
+        {
+            if (!createAddressFor(address, _settings.port, addressV6))
+            {
+                LOGE(LOG_DOMAIN, "Invalid IPv6 address '%s'", address.c_str());
+                return false;
+            }
+            // the unspecified address accepts IPv4 clients too
+            flags |= IN6_IS_ADDR_UNSPECIFIED(&addressV6.sin6_addr) ? MHD_USE_DUAL_STACK : MHD_USE_IPv6;
+            options.push_back({MHD_OPTION_SOCK_ADDR, 0, &addressV6});
+        }
+        else if (!address.empty())
+        {
+            if (!createAddressFor(address, _settings.port, addressV4))
+            {
+                LOGE(LOG_DOMAIN, "Invalid IPv4 address '%s'", address.c_str());
+                return false;
+            }
+            options.push_back({MHD_OPTION_SOCK_ADDR, 0, &addressV4});
+        }
+    }
+    options.push_back({MHD_OPTION_END, 0, nullptr});
+
+    listener.daemon = MHD_start_daemon(flags, _settings.port, nullptr, nullptr, &mhdEventHandler, this,
+                                       MHD_OPTION_ARRAY, options.data(), MHD_OPTION_END);
+    if (!listener.daemon)
+    {
+        // libmicrohttpd closes the given socket when it fails after taking it
+        LOGE(LOG_DOMAIN, "Couldn't listen on '%s'", address.c_str());
+        if (!listener.path.empty())
+        {
+            unlink(listener.path.c_str());
+        }
+        return false;
+    }
+    _listeners.push_back(listener);
+    return true;
+}
+
+unsigned HttpServerImpl::threadPoolSize() const
+{
+    if (_settings.threadPoolSize)
+    {
+        return _settings.threadPoolSize;
+    }
+    const unsigned cpus = std::thread::hardware_concurrency();
+    return cpus ? cpus : 1;
+}
+
+MHD_Response *HttpServerImpl::createResponseFromString(std::string &&content)
+{
+#if MHD_VERSION >= 0x00097300
+    // the response owns the string, its data is sent without being copied
+    std::string *body = new std::string(std::move(content));
+    MHD_Response *response =
+        MHD_create_response_from_buffer_with_free_callback_cls(body->size(), body->data(), &freeString, body);
+    if (!response)
+    {
+        delete body;
+    }
+    return response;
+#else
+    return MHD_create_response_from_buffer(content.size(), const_cast<char *>(content.data()), MHD_RESPMEM_MUST_COPY);
+#endif
+}
+
+void HttpServerImpl::freeString(void *cls)
+{
+    delete static_cast<std::string *>(cls);
+}
+
+MHD_Response *HttpServerImpl::createResponseFromCache(const std::shared_ptr<const std::string> &content,
+                                                      uint64_t offset, uint64_t length)
+{
+    char *data = const_cast<char *>(content->data()) + offset;
+#if MHD_VERSION >= 0x00097300
+    // the response keeps the cached contents alive while they are sent
+    auto *holder = new std::shared_ptr<const std::string>(content);
+    MHD_Response *response = MHD_create_response_from_buffer_with_free_callback_cls(length, data, &freeCached, holder);
+    if (!response)
+    {
+        delete holder;
+    }
+    return response;
+#else
+    return MHD_create_response_from_buffer(length, data, MHD_RESPMEM_MUST_COPY);
+#endif
+}
+
+void HttpServerImpl::freeCached(void *cls)
+{
+    delete static_cast<std::shared_ptr<const std::string> *>(cls);
+}
+
+MHD_Response *HttpServerImpl::createStreamResponse(HttpConnectionImpl &httpConn)
+{
+    const std::shared_ptr<HttpStreamImpl> &stream = httpConn.stream();
+    // the response keeps the stream alive, libmicrohttpd sends it chunked since its size is unknown
+    auto *holder = new std::shared_ptr<HttpStreamImpl>(stream);
+    MHD_Response *response = MHD_create_response_from_callback(MHD_SIZE_UNKNOWN, cFileBlockSize,
+                                                               &HttpStreamImpl::read, holder, &HttpStreamImpl::free);
+    if (!response)
+    {
+        delete holder;
+        stream->abort();
+        httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+        return nullptr;
+    }
+    stream->start(httpConn.takeResponse());
+
+    std::lock_guard<std::mutex> lock(_streamsMutex);
+    _streams.erase(std::remove_if(_streams.begin(), _streams.end(),
+                                  [](const std::weak_ptr<HttpStreamImpl> &stream) { return stream.expired(); }),
+                   _streams.end());
+    _streams.push_back(stream);
+    return response;
+}
+
+void HttpServerImpl::wakeStreams()
+{
+    std::lock_guard<std::mutex> lock(_streamsMutex);
+    for (const std::weak_ptr<HttpStreamImpl> &stream : _streams)
+    {
+        if (std::shared_ptr<HttpStreamImpl> alive = stream.lock())
+        {
+            alive->wake();
+        }
     }
+    _streams.clear();
+}
 
-    return _server != nullptr;
+MHD_Response *HttpServerImpl::createFileResponse(HttpConnectionImpl &httpConn, const std::string &filename)
+{
+    // the file may be replaced between the check of the cache and opening it
+    for (int attempt = 0; attempt < cFileAttempts; ++attempt)
+    {
+        bool stale = false;
+        MHD_Response *response = createFileResponse(httpConn, filename, stale);
+        if (!stale)
+        {
+            return response;
+        }
+        LOGD(LOG_DOMAIN, "File to send '%s' has changed, its cache entry is refreshed", filename.c_str());
+    }
+    LOGE(LOG_DOMAIN, "File to send '%s' keeps changing", filename.c_str());
+    httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+    return nullptr;
 }
 
-MHD_Response *HttpServerImpl::createResponseFromFilerange(const std::string &filename, const Range &file_range,
-                                                          const int filesize)
+MHD_Response *HttpServerImpl::createFileResponse(HttpConnectionImpl &httpConn, const std::string &filename,
+                                                 bool &stale)
 {
-    LOGT(LOG_DOMAIN, "Send portion of file content in range: %d-%d/%d", file_range._pos_begin, file_range._pos_end,
-         filesize);
+    const FileCache::EntrySPtr entry = _fileCache.get(filename);
+    if (!entry)
+    {
+        LOGE(LOG_DOMAIN, "File to send '%s' wasn't found", filename.c_str());
+        httpConn.setError(MHD_HTTP_NOT_FOUND);
+        return nullptr;
+    }
+    LOGD(LOG_DOMAIN, "Send file: %s", filename.c_str());
+    LOGT(LOG_DOMAIN, "File size %" PRIu64 "", entry->size);
+
+    // the range is ignored and the whole file is sent when it has changed since the client got a part of it
+    std::string rangeHeader = httpConn.header("Range");
+    const std::string ifRange = httpConn.header("If-Range");
+    if (!rangeHeader.empty() && !ifRange.empty() &&
+        !(ifRange.front() == '"' ? ifRange == entry->etag : FileCache::parseHttpDate(ifRange) == entry->mtime))
+    {
+        LOGD(LOG_DOMAIN, "If-Range '%s' doesn't match file %s", ifRange.c_str(), filename.c_str());
+        rangeHeader.clear();
+    }
+
+    // the file is sent as is or gzip-encoded, from its precompressed sibling or compressed in memory
+    FileCache::EntrySPtr sent = entry;
+    std::string path = filename;
+    uint64_t size = entry->size;
+    std::shared_ptr<const std::string> content = entry->content;
+    std::string etag = entry->etag;
+    const char *encoding = nullptr;
+    const bool negotiated = rangeHeader.empty() && (_settings.compressionLevel || _settings.precompressedFiles);
+    if (negotiated && negotiateContentCoding(httpConn.header("Accept-Encoding")) == ContentCoding::GZIP)
+    {
+        const FileCache::EntrySPtr precompressed =
+            _settings.precompressedFiles ? _fileCache.get(filename + cPrecompressedSuffix) : nullptr;
+        if (precompressed && precompressed->mtime >= entry->mtime)
+        {
+            sent = precompressed;
+            path += cPrecompressedSuffix;
+            size = precompressed->size;
+            content = precompressed->content;
+            etag = precompressed->etag;
+            encoding = "gzip";
+        }
+        else if (_settings.compressionLevel && size >= _settings.compressionMinSize &&
+                 isCompressibleType(responseHeader(httpConn, "Content-Type")))
+        {
+            std::shared_ptr<const std::string> gzipped = _fileCache.gzipped(filename, entry, compressionLevel());
+            if (gzipped)
+            {
+                size = gzipped->size();
+                content = gzipped;
+                etag.insert(etag.size() - 1, "-gzip");
+                encoding = "gzip";
+            }
+        }
+    }
 
     MHD_Response *response = nullptr;
-    FILE *file = ::fopen(filename.c_str(), "rb");
-    if (file != nullptr)
+    if (httpConn.method() == Method::GET || httpConn.method() == Method::HEAD)
+    {
+        // If-Modified-Since is ignored when If-None-Match is present (RFC 7232)
+        bool notModified = false;
+        const std::string ifNoneMatch = httpConn.header("If-None-Match");
+        if (!ifNoneMatch.empty())
+        {
+            notModified = etagMatches(ifNoneMatch, etag);
+        }
+        else
+        {
+            const std::time_t since = FileCache::parseHttpDate(httpConn.header("If-Modified-Since"));
+            notModified = since != -1 && entry->mtime <= since;
+        }
+        if (notModified)
+        {
+            LOGD(LOG_DOMAIN, "File '%s' is not modified", filename.c_str());
+            response = MHD_create_response_from_buffer(0, nullptr, MHD_RESPMEM_PERSISTENT);
+            if (!response)
+            {
+                httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+                return nullptr;
+            }
+            MHD_add_response_header(response, "ETag", etag.c_str());
+            MHD_add_response_header(response, "Last-Modified", entry->lastModified.c_str());
+            if (negotiated)
+            {
+                MHD_add_response_header(response, "Vary", "Accept-Encoding");
+            }
+            httpConn.setError(MHD_HTTP_NOT_MODIFIED);
+            return response;
+        }
+    }
+
+    std::vector<ByteRange> ranges;
+    if (!rangeHeader.empty())
+    {
+        LOGD(LOG_DOMAIN, "Requested range (as string): %s", rangeHeader.c_str());
+        if (!parseRanges(rangeHeader, size, ranges))
+        {
+            LOGE(LOG_DOMAIN, "Required range '%s' is invalid for file %s", rangeHeader.c_str(), filename.c_str());
+            httpConn.setError(MHD_HTTP_RANGE_NOT_SATISFIABLE);
+            return nullptr;
+        }
+    }
+
+    const ByteRange range = ranges.empty() ? ByteRange{0, size - 1} : ranges.front();
+    const uint64_t length = size ? range.length() : 0;
+    int fd = -1;
+    if (!content || ranges.size() > 1)
     {
-        FileReaderContext *fr_ctx = new FileReaderContext(file, file_range._pos_begin);
-        // maximal size to read is equal to length of range, the same for size of block to read
-        response = MHD_create_response_from_callback(file_range.length(), file_range.length(), &fileReader, fr_ctx,
-                                                     &fileFreeCallback);
+        fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+        {
+            // file exist but not accessible for read
+            LOGE(LOG_DOMAIN, "Couldn't open file to send '%s'", path.c_str());
+            httpConn.setError(ranges.empty() ? MHD_HTTP_NOT_ACCEPTABLE : MHD_HTTP_INTERNAL_SERVER_ERROR);
+            return nullptr;
+        }
+        // the size and the ETag sent must be the ones of the opened file
+        struct stat st;
+        if (fstat(fd, &st) != 0 || !sent->describes(st))
+        {
+            ::close(fd);
+            _fileCache.invalidate(path);
+            stale = true;
+            return nullptr;
+        }
+    }
+
+    if (ranges.size() > 1)
+    {
+        // parts take the type of the file, the response itself is multipart
+        std::string contentType = responseHeader(httpConn, "Content-Type");
+        if (contentType.empty())
+        {
+            contentType = "application/octet-stream";
+        }
+        else
+        {
+            httpConn.removeResponseHeader(responseHeaderName(httpConn, "Content-Type"));
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+        ByteRangesReader *reader = new ByteRangesReader(fd, size, ranges, contentType);
+        response = MHD_create_response_from_callback(reader->size(), cFileBlockSize, &ByteRangesReader::read, reader,
+                                                     &ByteRangesReader::free);
         if (!response)
-            delete fr_ctx;
+        {
+            delete reader;
+            httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+            return nullptr;
+        }
+        httpConn.setResponseHeader("Content-Type", "multipart/byteranges; boundary=" + reader->boundary());
+        MHD_add_response_header(response, "ETag", etag.c_str());
+        MHD_add_response_header(response, "Last-Modified", entry->lastModified.c_str());
+        httpConn.setError(MHD_HTTP_PARTIAL_CONTENT);
+        return response;
+    }
+
+    if (content)
+    {
+        response = createResponseFromCache(content, size ? range.first : 0, length);
     }
     else
     {
-        LOGE(LOG_DOMAIN, "Can't open file to read: %s", filename.c_str());
+        // the kernel sends the data with sendfile()
+        posix_fadvise(fd, static_cast<off_t>(range.first), static_cast<off_t>(length), POSIX_FADV_SEQUENTIAL);
+        response = MHD_create_response_from_fd_at_offset64(length, fd, range.first);
+        if (!response)
+        {
+            ::close(fd);
+        }
+    }
+    if (!response)
+    {
+        httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR);
+        return nullptr;
+    }
+    MHD_add_response_header(response, "Accept-Ranges", "bytes");
+    MHD_add_response_header(response, "ETag", etag.c_str());
+    MHD_add_response_header(response, "Last-Modified", entry->lastModified.c_str());
+    if (negotiated)
+    {
+        MHD_add_response_header(response, "Vary", "Accept-Encoding");
+    }
+    if (encoding)
+    {
+        MHD_add_response_header(response, "Content-Encoding", encoding);
+    }
+    if (!ranges.empty())
+    {
+        LOGD(LOG_DOMAIN, "Send portion of file content in range: %" PRIu64 "-%" PRIu64 "/%" PRIu64, range.first,
+             range.last, size);
+        const std::string contentRange = "bytes " + std::to_string(range.first) + "-" + std::to_string(range.last) +
+                                         "/" + std::to_string(size);
+        MHD_add_response_header(response, "Content-Range", contentRange.c_str());
+        httpConn.setError(MHD_HTTP_PARTIAL_CONTENT);
     }
     return response;
 }
 
+std::string HttpServerImpl::compressResponse(HttpConnectionImpl &httpConn, std::string &&content) const
+{
+    if (!_settings.compressionLevel || content.size() < _settings.compressionMinSize)
+    {
+        return std::move(content);
+    }
+    // the handler has encoded the data itself or it sends a part of it
+    if (!responseHeaderName(httpConn, "Content-Encoding").empty() ||
+        !responseHeaderName(httpConn, "Content-Range").empty() ||
+        !isCompressibleType(responseHeader(httpConn, "Content-Type")))
+    {
+        return std::move(content);
+    }
+
+    // the handler may vary the response on other headers too
+    const std::string varyName = responseHeaderName(httpConn, "Vary");
+    if (varyName.empty())
+    {
+        httpConn.setResponseHeader("Vary", "Accept-Encoding");
+    }
+    else
+    {
+        const std::string vary = httpConn.responseHeaders().at(varyName);
+        if (!varyLists(vary, "Accept-Encoding"))
+        {
+            httpConn.setResponseHeader(varyName, vary.empty() ? "Accept-Encoding" : vary + ", Accept-Encoding");
+        }
+    }
+    const ContentCoding coding = negotiateContentCoding(httpConn.header("Accept-Encoding"));
+    std::string compressed;
+    if (!compress(content.data(), content.size(), coding, compressionLevel(), compressed))
+    {
+        return std::move(content);
+    }
+    LOGT(LOG_DOMAIN, "Response is compressed from %zu to %zu bytes", content.size(), compressed.size());
+    httpConn.setResponseHeader("Content-Encoding", contentCodingName(coding));
+    return compressed;
+}
+
+int HttpServerImpl::compressionLevel() const
+{
+    return static_cast<int>(std::min(_settings.compressionLevel, 9U));
+}
+
+std::string HttpServerImpl::responseHeaderName(const HttpConnectionImpl &httpConn, const char *name)
+{
+    // handlers set headers in any case
+    for (const auto &header : httpConn.responseHeaders())
+    {
+        if (strcasecmp(header.first.c_str(), name) == 0)
+        {
+            return header.first;
+        }
+    }
+    return std::string();
+}
+
+std::string HttpServerImpl::responseHeader(const HttpConnectionImpl &httpConn, const char *name)
+{
+    const std::string actualName = responseHeaderName(httpConn, name);
+    return actualName.empty() ? std::string() : httpConn.responseHeaders().at(actualName);
+}
+
 int HttpServerImpl::handleHttpRequest(MHD_Connection *mhdConn, HttpConnectionImpl &httpConn)
 {
     // TODO: need RAII here
@@ -244,116 +960,53 @@ int HttpServerImpl::handleHttpRequest(MHD_Connection *mhdConn, HttpConnectionImp
     // disabled to prevent DOS attack
     httpConn.setResponseHeader("Access-Control-Allow-Origin", "*");
 #endif
-    if (handle(httpConn) && httpConn.error() == MHD_HTTP_OK)
+    bool handled = true;
+    if (!httpConn.resumed())
     {
-        if (auto s = httpConn.session().lock())
+        handled = httpConn.finishBody() && handle(httpConn);
+        if (handled && httpConn.suspendIfDeferred())
         {
-            auto iter = std::find_if(_sessions.begin(), _sessions.end(),
-                                     [&](HttpSession::SPtr &session) { return session->id() == s->id(); });
+            // the request is answered when libmicrohttpd calls back after the completion resumes it
+            return MHD_YES;
+        }
+    }
 
-            if (iter == _sessions.end())
-            {
-                _sessions.push_back(s);
-            }
+    if (handled && httpConn.error() == MHD_HTTP_OK)
+    {
+        if (auto s = httpConn.session().lock())
+        {
+            _sessions.insert(s);
             httpConn.setResponseHeader("X-Session", s->id());
             httpConn.setResponseHeader("X-Session-Expiry",
                                        softeq::common::stdutils::timestamp_to_string(s->expiration()));
         }
 
-        if (!httpConn.streamName().empty())
+        if (httpConn.stream())
         {
-            std::string filename(httpConn.streamName());
-            struct stat buf;
-
-            if (stat(filename.c_str(), &buf) == 0)
-            {
-                LOGD(LOG_DOMAIN, "Send file: %s", filename.c_str());
-                LOGT(LOG_DOMAIN, "File size %" PRId64 "", static_cast<int64_t>(buf.st_size));
-
-                // TODO: what if file size is zero
-                Range file_range(0, buf.st_size > 0 ? (int)buf.st_size - 1
-                                                    : 0); // _end is a number of the last byte (not file size)
-                std::string range_header_val = httpConn.header("Range");
-                LOGD(LOG_DOMAIN, "Requested range (as string): %s", range_header_val.c_str());
-                if (!range_header_val.empty())
-                {
-                    Range range;
-                    if (ParseRange(range_header_val, range))
-                    {
-                        LOGD(LOG_DOMAIN, "Requested range (parsed): %d-%d", range._pos_begin, range._pos_end);
-
-                        if (range._pos_begin < buf.st_size) // TODO: if file size is zero
-                        {
-                            if (range._pos_begin > file_range._pos_begin)
-                                file_range._pos_begin = range._pos_begin;
-                            if (range._pos_end <= file_range._pos_end)
-                                file_range._pos_end = range._pos_end;
-
-                            response = createResponseFromFilerange(filename, file_range, (int)buf.st_size);
-
-                            if (response)
-                                httpConn.setError(MHD_HTTP_PARTIAL_CONTENT);
-                            else
-                                httpConn.setError(MHD_HTTP_INTERNAL_SERVER_ERROR); /* Couldn't open file */
-
-                            std::string range_header_val2 = softeq::common::stdutils::string_format(
-                                "bytes %d-%d/%d", file_range._pos_begin,
-                                (file_range._pos_end > 0 ? file_range._pos_end : 0), buf.st_size);
-
-                            MHD_add_response_header(response, "Content-Range", range_header_val2.c_str());
-                            MHD_add_response_header(response, "Content-Length",
-                                                    std::to_string(file_range.length()).c_str());
-                        }
-                        else
-                        {
-                            // Not satisfiable range
-                            LOGE(LOG_DOMAIN, "Required range %d-%d is invalid for file %s", range._pos_begin,
-                                 range._pos_end, filename.c_str());
-                            httpConn.setError(MHD_HTTP_RANGE_NOT_SATISFIABLE);
-                        }
-                    }
-                    else
-                    {
-                        LOGE(LOG_DOMAIN, "Couldn't parse Range header.");
-                        httpConn.setError(MHD_HTTP_RANGE_NOT_SATISFIABLE);
-                    }
-                }
-                else
-                {
-                    int fd = ::open(filename.c_str(), O_RDONLY);
-                    if (fd != -1)
-                        response = MHD_create_response_from_fd(buf.st_size, fd);
-
-                    if (response == nullptr)
-                    {
-                        // file exist but not accessible for read
-                        LOGE(LOG_DOMAIN, "Couldn't open file to send '%s'", filename.c_str());
-                        httpConn.setError(MHD_HTTP_NOT_ACCEPTABLE);
-                    }
-                }
-            }
-            else
-            {
-                LOGE(LOG_DOMAIN, "File to send '%s' wasn't found", filename.c_str());
-                httpConn.setError(MHD_HTTP_NOT_FOUND);
-            }
+            response = createStreamResponse(httpConn);
+        }
+        else if (!httpConn.streamName().empty())
+        {
+            response = createFileResponse(httpConn, httpConn.streamName());
         }
         else
         {
             /* Execution of command was successful and don't needed to send any file */
-            std::string content(httpConn.strResponse());
+            std::string content(httpConn.takeResponse());
             LOGT(LOG_DOMAIN, "Output HTTP content: %s", content.c_str());
-            response = MHD_create_response_from_buffer(content.length(), const_cast<char *>(content.c_str()),
-                                                       MHD_RESPMEM_MUST_COPY);
+            response = createResponseFromString(compressResponse(httpConn, std::move(content)));
         }
     }
 
     if (httpConn.error() != MHD_HTTP_OK && !response)
     {
-        std::string content(httpConn.strResponse());
+        if (httpConn.stream())
+        {
+            httpConn.stream()->abort();
+        }
+        std::string content(httpConn.takeResponse());
         LOGT(LOG_DOMAIN, "Output HTTP content: %s", content.c_str());
-        response = MHD_create_response_from_buffer(content.length(), const_cast<char *>(content.c_str()),
-                                                   MHD_RESPMEM_MUST_COPY);
+        response = createResponseFromString(std::move(content));
     }
 
     for (const std::pair<const std::string, std::string> &header : httpConn.responseHeaders())
@@ -375,7 +1028,9 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
     (void)version;
 
     HttpServerImpl *httpServer = static_cast<HttpServerImpl *>(cls);
-    if (httpServer->_goingToStop)
+    HttpConnectionImpl *httpConn = static_cast<HttpConnectionImpl *>(*conCls);
+    // a deferred request completed during the shutdown is still answered
+    if (httpServer->_goingToStop && !(httpConn && httpConn->resumed()))
     {
         std::string content("The server is going to shut down");
 
@@ -387,7 +1042,6 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
         return MHD_NO;
     }
 
-    HttpConnectionImpl *httpConn = static_cast<HttpConnectionImpl *>(*conCls);
     Method methodType;
 
     try
@@ -402,6 +1056,30 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
 
     if (httpConn == nullptr)
     {
+        // connections in the slots keep being served while the extra ones are open
+        const AcceptedConnection *accepted = acceptedConnection(connection);
+        if (accepted && accepted->overloaded)
+        {
+            httpServer->_overloadedRequests.fetch_add(1, std::memory_order_relaxed);
+            LOGD(LOG_DOMAIN, "Too many connections, request (%s) %s is rejected", method, url);
+            return rejectOverloaded(connection, httpServer->_settings.overloadRetryAfter);
+        }
+        if (httpServer->shedLoad(connection))
+        {
+            httpServer->_shedRequests.fetch_add(1, std::memory_order_relaxed);
+            LOGD(LOG_DOMAIN, "Request (%s) %s has waited too long, it is shed", method, url);
+            return rejectOverloaded(connection, httpServer->_settings.overloadRetryAfter);
+        }
+
+        const unsigned retryAfter = httpServer->rateLimitRetryAfter(connection, url);
+        if (retryAfter)
+        {
+            httpServer->_rateLimitedRequests.fetch_add(1, std::memory_order_relaxed);
+            LOGD(LOG_DOMAIN, "Rate limit is exceeded, request (%s) %s is rejected", method, url);
+            return rejectRetryLater(connection, HttpStatusCode::STATUS_TOO_MANY_REQUESTS, "Too many requests",
+                                    retryAfter);
+        }
+
         LOGI(LOG_DOMAIN, "Got HTTP request (%s): %s", method, url);
         /* std::bad_alloc is possible */
 
@@ -411,7 +1089,7 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
 #ifndef NDEBUG
             MHD_add_response_header(response, "Access-Control-Allow-Origin", "*");
 #endif
-            MHD_add_response_header(response, "Access-Control-Allow-Methods", "GET, POST, PUT, OPTIONS, DELETE");
+            MHD_add_response_header(response, "Access-Control-Allow-Methods", "GET, HEAD, POST, PUT, OPTIONS, DELETE");
             MHD_add_response_header(response, "Access-Control-Allow-Headers",
                                     "authorization,cache-control,content-type,pragma,signature");
             MHD_add_response_header(response, "Access-Control-Allow-Credentials", "true");
@@ -422,11 +1100,27 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
         }
         else
         {
-            httpConn = new HttpConnectionImpl(connection, url, methodType, std::string(uploadData, *uploadDataSize),
-                                              *httpServer);
+            // a body known to be too large is refused before it is sent
+            const std::size_t maxBodySize = httpServer->_settings.maxBodySize;
+            const char *contentLength = MHD_lookup_connection_value(connection, MHD_HEADER_KIND, "Content-Length");
+            if (maxBodySize && contentLength && std::strtoull(contentLength, nullptr, 10) > maxBodySize)
+            {
+                LOGW(LOG_DOMAIN, "Request (%s) %s with body of %s bytes is rejected", method, url, contentLength);
+                return rejectRequest(connection, HttpStatusCode::STATUS_PAYLOAD_TOO_LARGE,
+                                     "The request body is too large");
+            }
+
+            // the first call never has a body
+            httpConn = new HttpConnectionImpl(connection, url, methodType, *httpServer);
             *conCls = httpConn;
 
             httpServer->processSession(*httpConn);
+            if (!httpServer->_dispatcher.prepare(*httpConn))
+            {
+                LOGW(LOG_DOMAIN, "Request (%s) %s is refused by the dispatcher", method, url);
+                const int error = httpConn->error() ? httpConn->error() : HttpStatusCode::STATUS_BAD_REQUEST;
+                return rejectRequest(connection, error, httpConn->takeResponse());
+            }
         }
 
         return MHD_YES;
@@ -438,9 +1132,10 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
 
     if (*uploadDataSize != 0)
     {
-        mhdPostProcess(httpConn, uploadData, *uploadDataSize);
+        const size_t size = *uploadDataSize;
         *uploadDataSize = 0;
-        return MHD_YES;
+        // a response can't be queued while the body is being received, the connection is closed
+        return mhdPostProcess(httpConn, uploadData, size) ? MHD_YES : MHD_NO;
     }
     else
     {
@@ -448,11 +1143,11 @@ int HttpServerImpl::mhdEventHandler(void *cls, MHD_Connection *connection, const
     }
 }
 
-void HttpServerImpl::mhdPostProcess(HttpConnectionImpl *http_conn, const char *data, size_t data_size)
+bool HttpServerImpl::mhdPostProcess(HttpConnectionImpl *http_conn, const char *data, size_t data_size)
 {
     assert(http_conn);
 
-    http_conn->appendBodyData(data, data_size);
+    return http_conn->appendBodyData(data, data_size);
 }
 
 void HttpServerImpl::processSession(HttpConnectionImpl &connection)
@@ -464,52 +1159,61 @@ void HttpServerImpl::processSession(HttpConnectionImpl &connection)
 
     std::string sessionId = connection.header("X-Session");
 
-    auto iter = std::find_if(_sessions.begin(), _sessions.end(),
-                             [&](HttpSession::SPtr &session) { return session->id() == sessionId; });
-
-    if (iter == _sessions.end())
+    HttpSession::SPtr session = _sessions.find(sessionId, system::TimeProvider::instance()->now());
+    if (!session)
     {
         LOGD(LOG_DOMAIN, "The session '%s' does not exist", sessionId.c_str());
         return;
     }
 
-    connection.attachSession(*iter);
+    connection.attachSession(session);
 }
 
 int HttpServerImpl::pruneSessionsOnExpiration()
 {
     std::time_t currentTime = system::TimeProvider::instance()->now();
 
-    _sessions.remove_if([currentTime](HttpSession::WPtr session) {
-        if (auto s = session.lock())
-        {
-            std::time_t sessionExpiration = s->expiration();
-            if (sessionExpiration <= currentTime)
-            {
-                s->onExpire();
-                return true;
-            }
-        }
-        return false;
-    });
+    // handlers may take their time, requests are not blocked meanwhile
+    for (HttpSession::SPtr &session : _sessions.expire(currentTime))
+    {
+        session->onExpire();
+    }
     return 0;
 }
 
-ssize_t HttpServerImpl::fileReader(void *cls, uint64_t pos, char *buf, size_t max)
+bool HttpServerImpl::reloadCertificate()
 {
-    FileReaderContext *ctx = static_cast<FileReaderContext *>(cls);
-
-    (void)::fseek(ctx->file(), ctx->offset() + pos, SEEK_SET);
-    size_t rd_count = ::fread(buf, 1, max, ctx->file());
+    return _tlsCredentials && _tlsCredentials->load(_settings.certFilePath, _settings.keyFilePath);
+}
 
-    LOGT(LOG_DOMAIN, "File reader callback has read %u bytes.", static_cast<uint32_t>(rd_count));
-    return rd_count;
+int HttpServerImpl::reloadChangedCertificate()
+{
+    if (_settings.reloadChangedCertificate && _tlsCredentials && _tlsCredentials->changed())
+    {
+        LOGI(LOG_DOMAIN, "TLS certificate '%s' has changed", _settings.certFilePath.c_str());
+        reloadCertificate();
+    }
+    return 0;
 }
 
-void HttpServerImpl::fileFreeCallback(void *cls)
+int HttpServerImpl::reportRejectedRequests()
 {
-    FileReaderContext *ctx = static_cast<FileReaderContext *>(cls);
-    delete ctx;
+    const unsigned overloaded = _overloadedRequests.exchange(0, std::memory_order_relaxed);
+    if (overloaded)
+    {
+        LOGW(LOG_DOMAIN, "Too many connections, %u requests are rejected", overloaded);
+    }
+    const unsigned rateLimited = _rateLimitedRequests.exchange(0, std::memory_order_relaxed);
+    if (rateLimited)
+    {
+        LOGW(LOG_DOMAIN, "Rate limit is exceeded, %u requests are rejected", rateLimited);
+    }
+    const unsigned shed = _shedRequests.exchange(0, std::memory_order_relaxed);
+    if (shed)
+    {
+        LOGW(LOG_DOMAIN, "Requests wait too long, %u of them are shed", shed);
+    }
+    return 0;
 }
 
 void HttpServerImpl::mhdLogger(void *cls, const char *fm, va_list ap)
@@ -530,6 +1234,113 @@ void HttpServerImpl::mhdRequestCompleted(void *cls, MHD_Connection *conn, void *
     *con_cls = nullptr;
 }
 
+void HttpServerImpl::mhdConnectionNotify(void *cls, MHD_Connection *conn, void **socket_context,
+                                         enum MHD_ConnectionNotificationCode code)
+{
+    HttpServerImpl *httpServer = static_cast<HttpServerImpl *>(cls);
+    if (code == MHD_CONNECTION_NOTIFY_STARTED)
+    {
+        const bool overloaded = ++httpServer->_openConnections > httpServer->_settings.maxConnections;
+        *socket_context = new AcceptedConnection{LoadShedder::Clock::now(), false, overloaded};
+        const MHD_ConnectionInfo *info =
+            httpServer->_tlsCredentials ? MHD_get_connection_info(conn, MHD_CONNECTION_INFO_GNUTLS_SESSION) : nullptr;
+        if (info && info->tls_session)
+        {
+            // the handshake has not started yet
+            httpServer->_tlsCredentials->attach(static_cast<gnutls_session_t>(info->tls_session),
+                                                httpServer->_settings.tlsSessionTickets);
+        }
+    }
+    else
+    {
+        httpServer->_openConnections--;
+        delete static_cast<AcceptedConnection *>(*socket_context);
+        *socket_context = nullptr;
+    }
+}
+
+bool HttpServerImpl::shedLoad(MHD_Connection *connection)
+{
+    AcceptedConnection *accepted = acceptedConnection(connection);
+    // the time a kept-alive connection waits for the next request is not known
+    if (!_loadShedder || !accepted || accepted->measured)
+    {
+        return false;
+    }
+    accepted->measured = true;
+    const LoadShedder::Clock::time_point now = LoadShedder::Clock::now();
+    return _loadShedder->shed(now - accepted->accepted, now);
+}
+
+int HttpServerImpl::rejectRequest(MHD_Connection *connection, int status, std::string &&content)
+{
+    MHD_Response *response = createResponseFromString(std::move(content));
+    // the body, if any, is not read
+    MHD_add_response_header(response, "Connection", "close");
+    int ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+int HttpServerImpl::rejectOverloaded(MHD_Connection *connection, unsigned retryAfter)
+{
+    return rejectRetryLater(connection, HttpStatusCode::STATUS_SERVICE_UNAVAILABLE, "The server is overloaded",
+                            retryAfter);
+}
+
+int HttpServerImpl::rejectRetryLater(MHD_Connection *connection, int status, const char *content, unsigned retryAfter)
+{
+    MHD_Response *response =
+        MHD_create_response_from_buffer(std::strlen(content), const_cast<char *>(content), MHD_RESPMEM_PERSISTENT);
+    MHD_add_response_header(response, "Retry-After", std::to_string(retryAfter).c_str());
+    // the slot is released as soon as the response is sent
+    MHD_add_response_header(response, "Connection", "close");
+    int ret = MHD_queue_response(connection, status, response);
+    MHD_destroy_response(response);
+    return ret;
+}
+
+unsigned HttpServerImpl::rateLimitRetryAfter(MHD_Connection *connection, const char *url)
+{
+    if (!_rateLimiter)
+    {
+        return 0;
+    }
+    const MHD_ConnectionInfo *info = MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS);
+    if (!info || !info->client_addr)
+    {
+        return 0;
+    }
+
+    // the port is not a part of the key, every connection of a client uses another one
+    std::uint64_t key;
+    switch (info->client_addr->sa_family)
+    {
+    case AF_INET:
+    {
+        const sockaddr_in *address = reinterpret_cast<const sockaddr_in *>(info->client_addr);
+        key = stdutils::fnv1a(&address->sin_addr, sizeof(address->sin_addr));
+        break;
+    }
+    case AF_INET6:
+    {
+        const sockaddr_in6 *address = reinterpret_cast<const sockaddr_in6 *>(info->client_addr);
+        key = stdutils::fnv1a(&address->sin6_addr, sizeof(address->sin6_addr));
+        break;
+    }
+    default:
+        return 0;
+    }
+    if (_settings.rateLimitPerPath)
+    {
+        key = stdutils::fnv1a(url, std::strcspn(url, "?"), key);
+    }
+
+    const long long delay = _rateLimiter->admit(key).count();
+    // whole seconds, at least one
+    return static_cast<unsigned>((delay + 999999) / 1000000);
+}
+
 } // namespace http
 } // namespace net
 } // namespace common
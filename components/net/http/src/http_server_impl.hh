@@ -1,4 +1,9 @@
 #pragma once
+#include "file_cache.hh"
+#include "load_shedder.hh"
+#include "rate_limiter.hh"
+#include "session_store.hh"
+#include "tls_credentials.hh"
 #include "utils.hh"
 
 #include <common/system/cron.hh>
@@ -6,7 +11,10 @@
 
 #include <atomic>
 #include <cassert>
-#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
 
 namespace softeq
 {
@@ -17,6 +25,7 @@ namespace net
 namespace http
 {
 class HttpConnectionImpl;
+class HttpStreamImpl;
 
 class HttpServerImpl final
 {
@@ -29,6 +38,12 @@ public:
 
     void stop();
 
+    int pollDescriptor() const;
+
+    long pollTimeout() const;
+
+    bool run();
+
     void incConnectionCounter()
     {
         _connectionsCounter++;
@@ -37,9 +52,21 @@ public:
     {
         _connectionsCounter--;
     }
+    const IHttpServer::settings_t &settings() const
+    {
+        return _settings;
+    }
+    HttpLoadStats loadStats() const;
+
+    bool reloadCertificate();
+
+    const std::atomic<bool> &goingToStop() const
+    {
+        return _goingToStop;
+    }
 
 private:
-    bool handle(IHttpConnection &connection);
+    bool handle(HttpConnectionImpl &connection);
 
     static void mhdLogger(void *cls, const char *fm, va_list ap);
 
@@ -47,37 +74,111 @@ private:
 
     void processSession(HttpConnectionImpl &connection);
     int pruneSessionsOnExpiration();
+    int reloadChangedCertificate();
+    // one warning a second summarizes the rejected requests, a message per request would flood the log
+    int reportRejectedRequests();
 
     bool startServerHttp();
 
-    static ssize_t fileReader(void *cls, uint64_t pos, char *buf, size_t max);
+    /*!
+      Starts a daemon serving the address
+      \param[in] listenSocket Socket to serve instead of the address, -1 if there is none
+    */
+    bool startListener(unsigned flags, std::vector<MHD_OptionItem> options, const std::string &address,
+                       int listenSocket);
+
+    /*!
+      Makes the daemons stop accepting connections
+    */
+    void quiesceListeners();
+
+    void closeListeners();
+
+    unsigned threadPoolSize() const;
+
+    static MHD_Response *createResponseFromString(std::string &&content);
+
+    static void freeString(void *cls);
 
-    static void fileFreeCallback(void *cls);
+    static MHD_Response *createResponseFromCache(const std::shared_ptr<const std::string> &content, uint64_t offset,
+                                                 uint64_t length);
 
-    static bool parseRange(const std::string &str, Range &range);
+    static void freeCached(void *cls);
 
-    static MHD_Response *createResponseFromFilerange(const std::string &filename, const Range &file_range,
-                                                     const int filesize);
+    MHD_Response *createStreamResponse(HttpConnectionImpl &httpConn);
+
+    // resumes the streams suspended waiting for data, so they see the server is going to stop
+    void wakeStreams();
+
+    MHD_Response *createFileResponse(HttpConnectionImpl &httpConn, const std::string &filename);
+    // stale is set when the opened file differs from its cache entry, the entry is refreshed then
+    MHD_Response *createFileResponse(HttpConnectionImpl &httpConn, const std::string &filename, bool &stale);
+
+    std::string compressResponse(HttpConnectionImpl &httpConn, std::string &&content) const;
+
+    int compressionLevel() const;
+
+    static std::string responseHeaderName(const HttpConnectionImpl &httpConn, const char *name);
+
+    static std::string responseHeader(const HttpConnectionImpl &httpConn, const char *name);
 
     int handleHttpRequest(MHD_Connection *mhd_conn, HttpConnectionImpl &http_conn);
 
-    static void mhdPostProcess(HttpConnectionImpl *http_conn, const char *data, size_t data_size);
+    static bool mhdPostProcess(HttpConnectionImpl *http_conn, const char *data, size_t data_size);
 
     static void mhdRequestCompleted(void *cls, MHD_Connection *conn, void **con_cls, enum MHD_RequestTerminationCode);
 
+    static void mhdConnectionNotify(void *cls, MHD_Connection *conn, void **socket_context,
+                                    enum MHD_ConnectionNotificationCode code);
+
+    static int rejectRequest(MHD_Connection *connection, int status, std::string &&content);
+
+    static int rejectOverloaded(MHD_Connection *connection, unsigned retryAfter);
+
+    static int rejectRetryLater(MHD_Connection *connection, int status, const char *content, unsigned retryAfter);
+
+    /*!
+      Takes a token of the client of the request
+      \return 0 if the request is admitted, otherwise seconds the client has to wait
+    */
+    unsigned rateLimitRetryAfter(MHD_Connection *connection, const char *url);
+
+    /*!
+      Accounts the first request of the connection in the load shedding
+      \return true if the request has to be refused
+    */
+    bool shedLoad(MHD_Connection *connection);
+
     static int mhdEventHandler(void *cls, MHD_Connection *connection, const char *url, const char *method,
                                const char *version, const char *upload_data, size_t *upload_data_size,
                                void **conCls) noexcept;
 
     const IHttpServer::settings_t &_settings;
     IHttpConnectionDispatcher &_dispatcher;
-    struct MHD_Daemon *_server{nullptr};
+    struct Listener
+    {
+        struct MHD_Daemon *daemon;
+        std::string path;  // of the Unix domain socket file to remove
+        MHD_socket socket; // taken from the quiesced daemon
+    };
+    std::vector<Listener> _listeners;
+    int _listenSocket{-1}; // not opened by the server
+    int _pollFd{-1};       // joins the daemons of the EXTERNAL mode when there are several
+    mutable std::mutex _runMutex; // serializes run() and pollTimeout() of the application with stop()
     std::atomic<bool> _goingToStop{false};
     std::atomic<unsigned> _connectionsCounter{0};
-
-    std::unique_ptr<char[]> _keyBuffer;
-    std::unique_ptr<char[]> _certBuffer;
-    std::list<HttpSession::SPtr> _sessions;
+    std::atomic<unsigned> _openConnections{0}; // accepted sockets, including the ones of rejected requests
+    std::atomic<unsigned> _overloadedRequests{0};  // since the last report
+    std::atomic<unsigned> _rateLimitedRequests{0}; // since the last report
+    std::atomic<unsigned> _shedRequests{0};        // since the last report
+    std::mutex _streamsMutex;
+    std::vector<std::weak_ptr<HttpStreamImpl>> _streams; // of the streamed responses
+
+    std::unique_ptr<TlsCredentials> _tlsCredentials;
+    SessionStore _sessions;
+    FileCache _fileCache;
+    std::unique_ptr<RateLimiter> _rateLimiter;
+    std::unique_ptr<LoadShedder> _loadShedder;
     softeq::common::system::Cron::UPtr _cron;
 };
 
@@ -4,6 +4,44 @@
 
 #include <uuid/uuid.h>
 
+#include <cstring>
+
+#include <sys/random.h>
+
+namespace
+{
+/*
+  Random bytes fetched from the kernel in batches, so that creating a session doesn't cost a system call
+*/
+class RandomPool final
+{
+public:
+    bool fill(unsigned char *data, std::size_t length)
+    {
+        if (_position + length > sizeof(_buffer))
+        {
+            ssize_t received = getrandom(_buffer, sizeof(_buffer), 0);
+            if (received != static_cast<ssize_t>(sizeof(_buffer)))
+            {
+                return false;
+            }
+            _position = 0;
+        }
+        std::memcpy(data, _buffer + _position, length);
+        // the bytes are not kept once they are used
+        std::memset(_buffer + _position, 0, length);
+        _position += length;
+        return true;
+    }
+
+private:
+    unsigned char _buffer[4096];
+    std::size_t _position{sizeof(_buffer)};
+};
+
+thread_local RandomPool tRandomPool;
+} // namespace
+
 namespace softeq
 {
 namespace common
@@ -17,7 +55,16 @@ HttpSession::HttpSession()
     uuid_t nId;
 
     // ASSUMPTION: uuid is generated as an unique value for each session
-    uuid_generate(nId);
+    if (tRandomPool.fill(nId, sizeof(nId)))
+    {
+        // random UUID (version 4, RFC 4122 variant)
+        nId[6] = (nId[6] & 0x0F) | 0x40;
+        nId[8] = (nId[8] & 0x3F) | 0x80;
+    }
+    else
+    {
+        uuid_generate(nId);
+    }
     std::string tmp(UUID_STR_LEN, '\0');
     uuid_unparse(nId, &tmp[0]);
     _id.assign(tmp, 0, UUID_STR_LEN - 1);
@@ -0,0 +1,228 @@
+#include "http_stream_impl.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <cstring>
+
+#include <microhttpd.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+// the reader of a connection with its own thread returns nothing after that, it is called again
+constexpr std::chrono::milliseconds cReadWait{100};
+// writers check the state of the server that often
+constexpr std::chrono::milliseconds cWriteWait{100};
+} // namespace
+
+HttpStreamImpl::HttpStreamImpl(Producer producer, std::size_t capacity, const std::atomic<bool> &stopping,
+                               MHD_Connection *connection)
+    : _producer(std::move(producer))
+    , _capacity(capacity)
+    , _stopping(stopping)
+    , _connection(connection)
+{
+}
+
+bool HttpStreamImpl::write(std::string &&data)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    // the reader can't wait for itself, and nobody reads before the response is queued
+    while (_started && !_closed && !_aborted && !_stopping && _buffered >= _capacity &&
+           std::this_thread::get_id() != _readerThread)
+    {
+        _cv.wait_for(lock, cWriteWait);
+    }
+    if (_closed || _aborted || _stopping)
+    {
+        return false;
+    }
+    if (!data.empty())
+    {
+        _buffered += data.size();
+        _chunks.push_back(std::move(data));
+        _cv.notify_all();
+        resume();
+    }
+    return true;
+}
+
+bool HttpStreamImpl::write(const char *data, std::size_t size)
+{
+    return write(std::string(data, size));
+}
+
+bool HttpStreamImpl::sendEvent(const std::string &data, const std::string &event, const std::string &id)
+{
+    std::string message;
+    message.reserve(data.size() + event.size() + id.size() + 32);
+    if (!event.empty())
+    {
+        message.append("event: ").append(event).append("\n");
+    }
+    if (!id.empty())
+    {
+        message.append("id: ").append(id).append("\n");
+    }
+    std::size_t pos = 0;
+    do
+    {
+        std::size_t end = data.find('\n', pos);
+        if (end == std::string::npos)
+        {
+            end = data.size();
+        }
+        message.append("data: ").append(data, pos, end - pos).append("\n");
+        pos = end + 1;
+    } while (pos <= data.size());
+    message.append("\n");
+    return write(std::move(message));
+}
+
+void HttpStreamImpl::close()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _closed = true;
+    _cv.notify_all();
+    resume();
+}
+
+bool HttpStreamImpl::isOpen() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return !_closed && !_aborted && !_stopping;
+}
+
+void HttpStreamImpl::start(std::string &&head)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (!head.empty())
+    {
+        _buffered += head.size();
+        _chunks.push_front(std::move(head));
+    }
+    _started = true;
+}
+
+void HttpStreamImpl::abort()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _aborted = true;
+    _cv.notify_all();
+}
+
+void HttpStreamImpl::wake()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    resume();
+}
+
+void HttpStreamImpl::resume()
+{
+    if (_suspended)
+    {
+        _suspended = false;
+        MHD_resume_connection(_connection);
+    }
+}
+
+ssize_t HttpStreamImpl::read(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    (void)pos;
+    return (*static_cast<std::shared_ptr<HttpStreamImpl> *>(cls))->read(buf, max);
+}
+
+void HttpStreamImpl::free(void *cls)
+{
+    std::shared_ptr<HttpStreamImpl> *stream = static_cast<std::shared_ptr<HttpStreamImpl> *>(cls);
+    (*stream)->abort();
+    delete stream;
+}
+
+ssize_t HttpStreamImpl::read(char *buf, std::size_t max)
+{
+    std::unique_lock<std::mutex> lock(_mutex);
+    if (_chunks.empty() && !_closed && !_aborted && _producer)
+    {
+        _readerThread = std::this_thread::get_id();
+        lock.unlock();
+        bool more = false;
+        try
+        {
+            more = _producer(*this);
+        }
+        catch (const std::exception &ex)
+        {
+            LOGE(LOG_DOMAIN, "Producer of the stream failed: %s", ex.what());
+        }
+        lock.lock();
+        _readerThread = std::thread::id();
+        if (!more)
+        {
+            _closed = true;
+        }
+    }
+
+    if (_connection && _chunks.empty() && !_closed && !_aborted && !_stopping)
+    {
+        // libmicrohttpd calls again at once when nothing is returned, a write or close() resumes the connection
+        MHD_suspend_connection(_connection);
+        _suspended = true;
+        return 0;
+    }
+    const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + cReadWait;
+    while (_chunks.empty() && !_closed && !_aborted && !_stopping)
+    {
+        const std::chrono::steady_clock::duration left = deadline - std::chrono::steady_clock::now();
+        if (left <= std::chrono::steady_clock::duration::zero())
+        {
+            break;
+        }
+        _cv.wait_for(lock, left);
+    }
+
+    if (_aborted)
+    {
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+    }
+    if (_stopping && !_closed)
+    {
+        // the queued data is still sent
+        _closed = true;
+        _cv.notify_all();
+    }
+    if (_chunks.empty())
+    {
+        return _closed ? MHD_CONTENT_READER_END_OF_STREAM : 0;
+    }
+
+    std::size_t copied = 0;
+    while (copied < max && !_chunks.empty())
+    {
+        const std::string &chunk = _chunks.front();
+        const std::size_t length = std::min(chunk.size() - _offset, max - copied);
+        std::memcpy(buf + copied, chunk.data() + _offset, length);
+        copied += length;
+        _offset += length;
+        if (_offset == chunk.size())
+        {
+            _chunks.pop_front();
+            _offset = 0;
+        }
+    }
+    _buffered -= copied;
+    _cv.notify_all();
+    return static_cast<ssize_t>(copied);
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
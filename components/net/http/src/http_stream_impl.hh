@@ -0,0 +1,101 @@
+#pragma once
+
+#include <common/net/http/http_stream.hh>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#include <sys/types.h>
+
+struct MHD_Connection;
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Queue of the chunks of a streamed response between writers and libmicrohttpd, which reads it with the
+  content reader callback. The response owns the stream through a shared pointer given as the callback
+  argument, so a producer thread may outlive the request safely: its writes fail once the response is gone.
+
+  While there is nothing to send the reader suspends the connection instead of waiting, writes and close()
+  resume it. A connection which has its own thread can't be suspended, its reader waits for the data.
+*/
+class HttpStreamImpl final : public IHttpStream
+{
+public:
+    /*!
+      \param[in] producer Function writing the next part of the body, may be empty
+      \param[in] capacity Bytes queued before writers wait for the client
+      \param[in] stopping Flag of the server going to stop, the stream is ended when it is set
+      \param[in] connection Connection to suspend while there is no data, nullptr if it has its own thread
+    */
+    HttpStreamImpl(Producer producer, std::size_t capacity, const std::atomic<bool> &stopping,
+                   struct MHD_Connection *connection = nullptr);
+
+    bool write(std::string &&data) override;
+    bool write(const char *data, std::size_t size) override;
+    bool sendEvent(const std::string &data, const std::string &event, const std::string &id) override;
+    void close() override;
+    bool isOpen() const override;
+
+    /*!
+      Marks the response as queued, writers wait for the client from now on
+      \param[in] head Data written by the handler to the connection, it is sent first
+    */
+    void start(std::string &&head);
+
+    /*!
+      Fails the stream, the connection is closed without the end of the body
+    */
+    void abort();
+
+    /*!
+      Resumes the connection waiting for data, so the reader sees the server is going to stop
+    */
+    void wake();
+
+    /*!
+      MHD_ContentReaderCallback, the argument is a pointer to HttpStreamImpl::SPtr
+    */
+    static ssize_t read(void *cls, uint64_t pos, char *buf, size_t max);
+
+    /*!
+      MHD_ContentReaderFreeCallback
+    */
+    static void free(void *cls);
+
+private:
+    ssize_t read(char *buf, std::size_t max);
+    void resume(); // called with _mutex locked
+
+    const Producer _producer;
+    const std::size_t _capacity;
+    const std::atomic<bool> &_stopping;
+    struct MHD_Connection *const _connection;
+
+    mutable std::mutex _mutex;
+    std::condition_variable _cv;
+    std::deque<std::string> _chunks;
+    std::size_t _offset{0}; // sent bytes of the first chunk
+    std::size_t _buffered{0};
+    bool _started{false};
+    bool _closed{false};
+    bool _aborted{false};
+    bool _suspended{false};
+    std::thread::id _readerThread; // the producer writes from it without waiting
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
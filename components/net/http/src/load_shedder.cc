@@ -0,0 +1,61 @@
+#include "load_shedder.hh"
+
+#include <algorithm>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+LoadShedder::LoadShedder(Clock::duration target, Clock::duration interval)
+    : _target(target)
+    , _interval(interval)
+{
+}
+
+bool LoadShedder::shed(Clock::duration delay, Clock::time_point now)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (now >= _intervalEnd)
+    {
+        // an idle interval in between means the queue has drained
+        const bool recent = now < _intervalEnd + _interval;
+        _overloaded = recent && _requests && _minDelay > _target;
+        _shedRate = recent && _requests ? static_cast<double>(_shed) / _requests : 0;
+        _intervalEnd = now + _interval;
+        _minDelay = delay;
+        _requests = 0;
+        _shed = 0;
+    }
+    else
+    {
+        _minDelay = std::min(_minDelay, delay);
+    }
+
+    ++_requests;
+    if (_overloaded && delay > 2 * _target)
+    {
+        ++_shed;
+        ++_shedRequests;
+        return true;
+    }
+    return false;
+}
+
+LoadShedder::Stats LoadShedder::stats(Clock::time_point now) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (now >= _intervalEnd + _interval)
+    {
+        return Stats{false, 0, _shedRequests};
+    }
+    return Stats{_overloaded, _shedRate, _shedRequests};
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Refuses requests which have waited too long while the server is overloaded, after CoDel.
+
+  The server is overloaded when even the smallest queueing delay of an interval was above the target,
+  i.e. the queue has not drained once during it. While it is, requests delayed by more than twice the
+  target are refused, so the latency stays bounded and the rejections are fast. A short burst never
+  sheds anything since some request of the interval is served quickly.
+*/
+class LoadShedder final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        bool overloaded;
+        double shedRate; // share of the requests refused in the last interval
+        std::uint64_t shedRequests;
+    };
+
+    LoadShedder(Clock::duration target, Clock::duration interval);
+
+    /*!
+      Accounts the request
+      \param[in] delay Time the request has waited before it is served
+      \return true if the request has to be refused
+    */
+    bool shed(Clock::duration delay, Clock::time_point now = Clock::now());
+
+    Stats stats(Clock::time_point now = Clock::now()) const;
+
+private:
+    const Clock::duration _target;
+    const Clock::duration _interval;
+
+    mutable std::mutex _mutex;
+    Clock::time_point _intervalEnd;
+    Clock::duration _minDelay{Clock::duration::zero()};
+    bool _overloaded{false};
+    std::uint64_t _requests{0}; // of the current interval
+    std::uint64_t _shed{0};     // of the current interval
+    double _shedRate{0};        // of the last interval
+    std::uint64_t _shedRequests{0};
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,44 @@
+#include "rate_limiter.hh"
+
+#include <algorithm>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+std::size_t roundUpToPowerOfTwo(std::size_t value)
+{
+    std::size_t result = 1;
+    while (result < value)
+    {
+        result <<= 1;
+    }
+    return result;
+}
+} // namespace
+
+RateLimiter::RateLimiter(unsigned rate, unsigned burst, std::size_t buckets)
+    : _interval(1000000 / std::max(rate, 1u))
+    , _tolerance(stdutils::Gcra::tolerance(_interval, burst))
+    , _mask(roundUpToPowerOfTwo(std::max<std::size_t>(buckets, 1)) - 1)
+    , _buckets(new stdutils::Gcra[_mask + 1])
+{
+}
+
+std::chrono::microseconds RateLimiter::admit(std::uint64_t key, Clock::time_point now)
+{
+    const std::int64_t time =
+        std::chrono::duration_cast<std::chrono::microseconds>(now.time_since_epoch()).count();
+    return std::chrono::microseconds(_buckets[key & _mask].take(time, _interval, _tolerance));
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
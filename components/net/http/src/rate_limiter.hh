@@ -0,0 +1,57 @@
+#pragma once
+
+#include <common/stdutils/gcra.hh>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Token buckets of the clients (GCRA).
+
+  A key is hashed to one of a fixed number of buckets, every bucket is a lock-free stdutils::Gcra, so
+  a request costs O(1) without locks or allocations whatever the number of clients. A full bucket needs
+  no state, so nothing has to be expired. Keys sharing a bucket share the limit, the table is large
+  enough for that to be rare.
+*/
+class RateLimiter final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    /*!
+      \param[in] rate Requests per second a key may send on average
+      \param[in] burst Requests a key may send at once, at least 1
+      \param[in] buckets Number of buckets, it is rounded up to a power of two
+    */
+    RateLimiter(unsigned rate, unsigned burst, std::size_t buckets);
+
+    RateLimiter(const RateLimiter &) = delete;
+    RateLimiter &operator=(const RateLimiter &) = delete;
+
+    /*!
+      Takes a token of the key
+      \return Zero if the request is admitted, otherwise the time until it would be
+    */
+    std::chrono::microseconds admit(std::uint64_t key, Clock::time_point now = Clock::now());
+
+private:
+    const std::int64_t _interval; // microseconds between two requests
+    const std::int64_t _tolerance; // microseconds a key may be ahead of the rate
+    const std::size_t _mask;
+    std::unique_ptr<stdutils::Gcra[]> _buckets;
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
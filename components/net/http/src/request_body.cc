@@ -0,0 +1,128 @@
+#include "request_body.hh"
+#include "utils.hh"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+RequestBody::RequestBody(std::size_t spoolThreshold, const std::string &spoolDirectory)
+    : _spoolThreshold(spoolThreshold)
+    , _spoolDirectory(spoolDirectory)
+{
+}
+
+RequestBody::~RequestBody()
+{
+    if (_map)
+    {
+        munmap(_map, _size);
+    }
+    if (_fd != -1)
+    {
+        ::close(_fd);
+    }
+}
+
+bool RequestBody::append(const char *data, std::size_t size)
+{
+    if (_fd == -1 && _spoolThreshold && _size + size > _spoolThreshold && !spool())
+    {
+        return false;
+    }
+    if (_fd != -1)
+    {
+        if (!writeAll(data, size))
+        {
+            LOGE(LOG_DOMAIN, "Couldn't write the request body to the file: %s", strerror(errno));
+            return false;
+        }
+    }
+    else
+    {
+        _memory.append(data, size);
+    }
+    _size += size;
+    return true;
+}
+
+bool RequestBody::finish()
+{
+    if (_fd == -1 || _map || _size == 0)
+    {
+        return true;
+    }
+    void *map = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+    if (map == MAP_FAILED)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't map the request body: %s", strerror(errno));
+        return false;
+    }
+    madvise(map, _size, MADV_SEQUENTIAL);
+    _map = map;
+    return true;
+}
+
+DataView RequestBody::view() const
+{
+    if (_fd != -1)
+    {
+        return _map ? DataView{static_cast<const char *>(_map), _size} : DataView{nullptr, 0};
+    }
+    return DataView{_memory.data(), _memory.size()};
+}
+
+bool RequestBody::spool()
+{
+    std::string path = _spoolDirectory + "/http-body-XXXXXX";
+    int fd = mkostemp(&path[0], O_CLOEXEC);
+    if (fd == -1)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't create a file for the request body in '%s': %s", _spoolDirectory.c_str(),
+             strerror(errno));
+        return false;
+    }
+    // the file lives while it is open
+    unlink(path.c_str());
+    _fd = fd;
+    LOGD(LOG_DOMAIN, "Request body of more than %zu bytes goes to a file", _spoolThreshold);
+
+    const bool result = writeAll(_memory.data(), _memory.size());
+    std::string().swap(_memory);
+    return result;
+}
+
+bool RequestBody::writeAll(const char *data, std::size_t size)
+{
+    while (size)
+    {
+        ssize_t length = ::write(_fd, data, size);
+        if (length < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += length;
+        size -= static_cast<std::size_t>(length);
+    }
+    return true;
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
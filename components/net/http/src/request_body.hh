@@ -0,0 +1,77 @@
+#pragma once
+
+#include <common/net/http/http_connection.hh>
+
+#include <cstddef>
+#include <string>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Body of a request collected while it arrives.
+
+  Small bodies are kept in memory. When a body grows beyond the threshold it is moved to a temporary file,
+  which is unlinked at once and mapped to memory when the body is complete, so a large upload takes
+  neither RAM nor reallocations and leaves nothing behind.
+*/
+class RequestBody final
+{
+public:
+    /*!
+      \param[in] spoolThreshold Bodies larger than that go to a file, 0 keeps them in memory
+      \param[in] spoolDirectory Directory of the temporary file
+    */
+    RequestBody(std::size_t spoolThreshold, const std::string &spoolDirectory);
+    ~RequestBody();
+
+    RequestBody(const RequestBody &) = delete;
+    RequestBody &operator=(const RequestBody &) = delete;
+
+    /*!
+      \return false if the temporary file couldn't be written
+    */
+    bool append(const char *data, std::size_t size);
+
+    /*!
+      Makes the whole body available with view()
+      \return false if the temporary file couldn't be mapped
+    */
+    bool finish();
+
+    /*!
+      \return Body, it is complete after finish()
+    */
+    DataView view() const;
+
+    std::size_t size() const
+    {
+        return _size;
+    }
+
+    bool spooled() const
+    {
+        return _fd != -1;
+    }
+
+private:
+    bool spool();
+    bool writeAll(const char *data, std::size_t size);
+
+    const std::size_t _spoolThreshold;
+    const std::string _spoolDirectory;
+    std::string _memory;
+    std::size_t _size{0};
+    int _fd{-1};
+    void *_map{nullptr};
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
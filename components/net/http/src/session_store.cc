@@ -0,0 +1,95 @@
+#include "session_store.hh"
+
+#include <functional>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+constexpr std::size_t SessionStore::cShards;
+
+SessionStore::SessionStore(std::time_t now)
+    : _wheel(now)
+{
+}
+
+HttpSession::SPtr SessionStore::find(const std::string &id, std::time_t now) const
+{
+    Shard &s = shard(id);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    auto iter = s.sessions.find(id);
+    if (iter == s.sessions.end() || iter->second->expiration() <= now)
+    {
+        return nullptr;
+    }
+    return iter->second;
+}
+
+void SessionStore::insert(const HttpSession::SPtr &session)
+{
+    const std::string id = session->id();
+    Shard &s = shard(id);
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.sessions.emplace(id, session).second)
+    {
+        std::lock_guard<std::mutex> wheelLock(_wheelMutex);
+        _wheel.schedule(id, session->expiration());
+    }
+}
+
+std::vector<HttpSession::SPtr> SessionStore::expire(std::time_t now)
+{
+    std::vector<std::string> due;
+    {
+        std::lock_guard<std::mutex> wheelLock(_wheelMutex);
+        due = _wheel.advance(now);
+    }
+
+    std::vector<HttpSession::SPtr> expired;
+    for (const std::string &id : due)
+    {
+        Shard &s = shard(id);
+        std::lock_guard<std::mutex> lock(s.mutex);
+        auto iter = s.sessions.find(id);
+        if (iter == s.sessions.end())
+        {
+            continue;
+        }
+        const std::time_t expiration = iter->second->expiration();
+        if (expiration > now)
+        {
+            // the session has been used since it was scheduled
+            std::lock_guard<std::mutex> wheelLock(_wheelMutex);
+            _wheel.schedule(id, expiration);
+            continue;
+        }
+        expired.push_back(std::move(iter->second));
+        s.sessions.erase(iter);
+    }
+    return expired;
+}
+
+std::size_t SessionStore::size() const
+{
+    std::size_t count = 0;
+    for (const Shard &s : _shards)
+    {
+        std::lock_guard<std::mutex> lock(s.mutex);
+        count += s.sessions.size();
+    }
+    return count;
+}
+
+SessionStore::Shard &SessionStore::shard(const std::string &id) const
+{
+    return _shards[std::hash<std::string>()(id) % cShards];
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "timer_wheel.hh"
+
+#include <common/net/http/http_session.hh>
+
+#include <array>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Sessions of the server looked up by id from many threads.
+
+  The sessions are spread over shards with own locks, so requests of different sessions rarely wait for
+  each other. Expiration is tracked by a timer wheel; a session extended after it was scheduled is
+  scheduled again when its old deadline comes, so the work of expire() depends on the number of
+  deadlines reached rather than on the number of sessions.
+*/
+class SessionStore final
+{
+public:
+    explicit SessionStore(std::time_t now);
+
+    /*!
+      \param[in] id Session id
+      \param[in] now Current time, an expired session is not returned even before expire() removes it
+      \return Session or nullptr
+    */
+    HttpSession::SPtr find(const std::string &id, std::time_t now) const;
+
+    /*!
+      Adds the session, nothing is done if a session with the id exists
+      \param[in] session Session with the expiration time set
+    */
+    void insert(const HttpSession::SPtr &session);
+
+    /*!
+      Removes the sessions which have expired
+      \param[in] now Current time
+      \return Removed sessions, the caller notifies them without the store being locked
+    */
+    std::vector<HttpSession::SPtr> expire(std::time_t now);
+
+    std::size_t size() const;
+
+private:
+    static constexpr std::size_t cShards = 16;
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string, HttpSession::SPtr> sessions;
+    };
+
+    Shard &shard(const std::string &id) const;
+
+    mutable std::array<Shard, cShards> _shards;
+    std::mutex _wheelMutex; // taken after a shard lock, never before
+    TimerWheel _wheel;
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,140 @@
+#include "timer_wheel.hh"
+
+#include <utility>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+// a longer jump of the clock is handled by placing all keys again instead of ticking through it
+constexpr std::time_t cMaxTicksPerAdvance = 4096;
+} // namespace
+
+constexpr unsigned TimerWheel::cLevelBits;
+constexpr unsigned TimerWheel::cSlots;
+constexpr unsigned TimerWheel::cLevels;
+
+TimerWheel::TimerWheel(std::time_t now)
+    : _current(now)
+{
+}
+
+void TimerWheel::schedule(const std::string &key, std::time_t when)
+{
+    place(Entry{key, when});
+    ++_size;
+}
+
+std::vector<std::string> TimerWheel::advance(std::time_t now)
+{
+    std::vector<std::string> due;
+    if (now < _current)
+    {
+        return due;
+    }
+
+    if (now - _current >= cMaxTicksPerAdvance)
+    {
+        std::vector<Entry> entries;
+        for (auto &level : _levels)
+        {
+            for (Slot &slot : level)
+            {
+                for (Entry &entry : slot)
+                {
+                    entries.push_back(std::move(entry));
+                }
+                slot.clear();
+            }
+        }
+        _current = now + 1;
+        for (Entry &entry : entries)
+        {
+            if (entry.when <= now)
+            {
+                due.push_back(std::move(entry.key));
+                --_size;
+            }
+            else
+            {
+                place(std::move(entry));
+            }
+        }
+        return due;
+    }
+
+    for (; _current <= now; ++_current)
+    {
+        if ((_current & (cSlots - 1)) == 0)
+        {
+            cascade(1);
+        }
+
+        Slot slot;
+        slot.swap(_levels[0][_current & (cSlots - 1)]);
+        for (Entry &entry : slot)
+        {
+            // a deadline beyond the wheel comes around before it is reached
+            if (entry.when <= _current)
+            {
+                due.push_back(std::move(entry.key));
+                --_size;
+            }
+            else
+            {
+                place(std::move(entry));
+            }
+        }
+    }
+    return due;
+}
+
+void TimerWheel::place(Entry &&entry)
+{
+    const std::time_t when = entry.when < _current ? _current : entry.when;
+    const std::time_t delta = when - _current;
+
+    unsigned level = 0;
+    while (level + 1 < cLevels && delta >= (std::time_t(1) << (cLevelBits * (level + 1))))
+    {
+        ++level;
+    }
+    std::time_t tick = when;
+    if (delta >= (std::time_t(1) << (cLevelBits * (level + 1))))
+    {
+        // the farthest slot of the last level
+        tick = _current + (std::time_t(1) << (cLevelBits * cLevels)) - 1;
+    }
+    _levels[level][(tick >> (cLevelBits * level)) & (cSlots - 1)].push_back(std::move(entry));
+}
+
+void TimerWheel::cascade(unsigned level)
+{
+    if (level >= cLevels)
+    {
+        return;
+    }
+    const std::size_t index = (_current >> (cLevelBits * level)) & (cSlots - 1);
+    if (index == 0)
+    {
+        cascade(level + 1);
+    }
+
+    Slot slot;
+    slot.swap(_levels[level][index]);
+    for (Entry &entry : slot)
+    {
+        place(std::move(entry));
+    }
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
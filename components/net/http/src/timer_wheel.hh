@@ -0,0 +1,72 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <vector>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Hierarchical timer wheel with the resolution of one second.
+
+  A key is placed into one of 64 slots of the level which covers its deadline: the first level spans
+  64 seconds, every next one is 64 times longer. A slot of an upper level is moved down when the wheel
+  reaches it, so advancing by a tick costs time proportional to the keys which become due only.
+  Deadlines beyond the last level are kept in it and placed again until they are reached.
+*/
+class TimerWheel final
+{
+public:
+    explicit TimerWheel(std::time_t now);
+
+    /*!
+      Adds the key, a deadline in the past makes it due on the next advance()
+      \param[in] key Key to return once the deadline is reached
+      \param[in] when Deadline
+    */
+    void schedule(const std::string &key, std::time_t when);
+
+    /*!
+      Moves the wheel to the time, the time going back is ignored
+      \param[in] now Current time
+      \return Keys with the deadline reached, every key is returned once
+    */
+    std::vector<std::string> advance(std::time_t now);
+
+    std::size_t size() const noexcept
+    {
+        return _size;
+    }
+
+private:
+    struct Entry
+    {
+        std::string key;
+        std::time_t when;
+    };
+    using Slot = std::vector<Entry>;
+
+    static constexpr unsigned cLevelBits = 6;
+    static constexpr unsigned cSlots = 1 << cLevelBits;
+    static constexpr unsigned cLevels = 4;
+
+    void place(Entry &&entry);
+    void cascade(unsigned level);
+
+    std::array<std::array<Slot, cSlots>, cLevels> _levels;
+    std::time_t _current; // the tick processed next
+    std::size_t _size{0};
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -0,0 +1,230 @@
+#include "tls_credentials.hh"
+#include "utils.hh"
+
+#include <common/system/fsutils.hh>
+
+#include <cstring>
+
+#include <sys/stat.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+namespace
+{
+// certificates of a chain
+constexpr unsigned cMaxChainLength = 16;
+
+bool readFile(const std::string &path, gnutls_datum_t &data, std::unique_ptr<char[]> &buffer)
+{
+    const int64_t size = common::system::filesize(path);
+    if (size <= 0 || !common::system::readBinaryFileIntoBuffer(path, buffer))
+    {
+        return false;
+    }
+    data.data = reinterpret_cast<unsigned char *>(buffer.get());
+    data.size = static_cast<unsigned int>(size);
+    return true;
+}
+
+// the key has to be the one of the certificate the chain starts with
+bool keyMatches(const gnutls_pcert_st &certificate, gnutls_privkey_t key)
+{
+    gnutls_pubkey_t publicKey;
+    if (gnutls_pubkey_init(&publicKey) < 0)
+    {
+        return false;
+    }
+    gnutls_datum_t fromKey{nullptr, 0};
+    gnutls_datum_t fromCertificate{nullptr, 0};
+    const bool result = gnutls_pubkey_import_privkey(publicKey, key, 0, 0) >= 0 &&
+                        gnutls_pubkey_export2(publicKey, GNUTLS_X509_FMT_DER, &fromKey) >= 0 &&
+                        gnutls_pubkey_export2(certificate.pubkey, GNUTLS_X509_FMT_DER, &fromCertificate) >= 0 &&
+                        fromKey.size == fromCertificate.size &&
+                        std::memcmp(fromKey.data, fromCertificate.data, fromKey.size) == 0;
+    gnutls_free(fromKey.data);
+    gnutls_free(fromCertificate.data);
+    gnutls_pubkey_deinit(publicKey);
+    return result;
+}
+} // namespace
+
+TlsCredentials::TlsCredentials()
+{
+    if (gnutls_session_ticket_key_generate(&_ticketKey) != GNUTLS_E_SUCCESS)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't generate the key of TLS session tickets");
+        _ticketKey = gnutls_datum_t{nullptr, 0};
+    }
+}
+
+TlsCredentials::~TlsCredentials()
+{
+    for (std::unique_ptr<Credentials> &credentials : _loaded)
+    {
+        release(*credentials);
+    }
+    if (_ticketKey.data)
+    {
+        gnutls_memset(_ticketKey.data, 0, _ticketKey.size);
+        gnutls_free(_ticketKey.data);
+    }
+}
+
+bool TlsCredentials::load(const std::string &certFile, const std::string &keyFile)
+{
+    FileVersion certVersion;
+    FileVersion keyVersion;
+    gnutls_datum_t certData;
+    gnutls_datum_t keyData;
+    std::unique_ptr<char[]> certBuffer;
+    std::unique_ptr<char[]> keyBuffer;
+    // versions go first, a file replaced meanwhile is loaded again
+    if (!version(certFile, certVersion) || !version(keyFile, keyVersion) ||
+        !readFile(certFile, certData, certBuffer) || !readFile(keyFile, keyData, keyBuffer))
+    {
+        LOGE(LOG_DOMAIN, "Couldn't read the certificate '%s' or the key '%s'", certFile.c_str(), keyFile.c_str());
+        return false;
+    }
+
+    std::unique_ptr<Credentials> credentials(new Credentials);
+    credentials->chain.resize(cMaxChainLength);
+    unsigned int chainLength = cMaxChainLength;
+    int result = gnutls_pcert_list_import_x509_raw(credentials->chain.data(), &chainLength, &certData,
+                                                   GNUTLS_X509_FMT_PEM, 0);
+    if (result < 0)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't load the certificate '%s': %s", certFile.c_str(), gnutls_strerror(result));
+        return false;
+    }
+    credentials->chain.resize(chainLength);
+
+    result = gnutls_privkey_init(&credentials->key);
+    if (result >= 0)
+    {
+        result = gnutls_privkey_import_x509_raw(credentials->key, &keyData, GNUTLS_X509_FMT_PEM, nullptr, 0);
+    }
+    gnutls_memset(keyBuffer.get(), 0, keyData.size);
+    if (result < 0)
+    {
+        LOGE(LOG_DOMAIN, "Couldn't load the key '%s': %s", keyFile.c_str(), gnutls_strerror(result));
+        release(*credentials);
+        return false;
+    }
+    if (credentials->chain.empty() || !keyMatches(credentials->chain.front(), credentials->key))
+    {
+        LOGE(LOG_DOMAIN, "The key '%s' doesn't match the certificate '%s'", keyFile.c_str(), certFile.c_str());
+        release(*credentials);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _loaded.push_back(std::move(credentials));
+    _certFile = certFile;
+    _keyFile = keyFile;
+    _certVersion = certVersion;
+    _keyVersion = keyVersion;
+    LOGI(LOG_DOMAIN, "TLS certificate '%s' is loaded", certFile.c_str());
+    return true;
+}
+
+bool TlsCredentials::changed() const
+{
+    std::string certFile;
+    std::string keyFile;
+    FileVersion certVersion;
+    FileVersion keyVersion;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_loaded.empty())
+        {
+            return false;
+        }
+        certFile = _certFile;
+        keyFile = _keyFile;
+        certVersion = _certVersion;
+        keyVersion = _keyVersion;
+    }
+
+    // a file being replaced may be missing for a moment
+    FileVersion current;
+    return (version(certFile, current) && !sameVersion(current, certVersion)) ||
+           (version(keyFile, current) && !sameVersion(current, keyVersion));
+}
+
+void TlsCredentials::attach(gnutls_session_t session, bool tickets)
+{
+    // libmicrohttpd keeps its connection in the session pointer, the one of the session cache is free
+    gnutls_db_set_ptr(session, this);
+    if (tickets && _ticketKey.data)
+    {
+        gnutls_session_ticket_enable_server(session, &_ticketKey);
+    }
+}
+
+int TlsCredentials::retrieve(gnutls_session_t session, const gnutls_datum_t *reqCaDn, int reqCaDnCount,
+                             const gnutls_pk_algorithm_t *pkAlgorithms, int pkAlgorithmsCount,
+                             gnutls_pcert_st **pcert, unsigned int *pcertCount, gnutls_privkey_t *privateKey)
+{
+    (void)reqCaDn;
+    (void)reqCaDnCount;
+    (void)pkAlgorithms;
+    (void)pkAlgorithmsCount;
+
+    const TlsCredentials *self = static_cast<const TlsCredentials *>(gnutls_db_get_ptr(session));
+    if (!self)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(self->_mutex);
+    if (self->_loaded.empty())
+    {
+        return -1;
+    }
+    Credentials &credentials = *self->_loaded.back();
+    *pcert = credentials.chain.data();
+    *pcertCount = static_cast<unsigned int>(credentials.chain.size());
+    *privateKey = credentials.key;
+    return 0;
+}
+
+bool TlsCredentials::version(const std::string &path, FileVersion &result)
+{
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    result = FileVersion{st.st_ino, st.st_size, st.st_mtim};
+    return true;
+}
+
+bool TlsCredentials::sameVersion(const FileVersion &lhs, const FileVersion &rhs)
+{
+    return lhs.inode == rhs.inode && lhs.size == rhs.size && lhs.mtime.tv_sec == rhs.mtime.tv_sec &&
+           lhs.mtime.tv_nsec == rhs.mtime.tv_nsec;
+}
+
+void TlsCredentials::release(Credentials &credentials)
+{
+    for (gnutls_pcert_st &pcert : credentials.chain)
+    {
+        gnutls_pcert_deinit(&pcert);
+    }
+    credentials.chain.clear();
+    if (credentials.key)
+    {
+        gnutls_privkey_deinit(credentials.key);
+        credentials.key = nullptr;
+    }
+}
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
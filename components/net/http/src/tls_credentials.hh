@@ -0,0 +1,95 @@
+#pragma once
+
+#include <gnutls/abstract.h>
+#include <gnutls/gnutls.h>
+
+#include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Certificate and key of the HTTPS server, given to GnuTLS during every handshake, so they can be replaced
+  while the server runs.
+
+  A handshake may use the credentials which are being replaced, so the loaded ones are freed with the object
+  only; certificates are replaced rarely. The object also issues the session tickets, their key lives as long
+  as the object, returning clients resume their sessions without a full handshake.
+*/
+class TlsCredentials final
+{
+public:
+    TlsCredentials();
+    ~TlsCredentials();
+
+    TlsCredentials(const TlsCredentials &) = delete;
+    TlsCredentials &operator=(const TlsCredentials &) = delete;
+
+    /*!
+      Loads the files, the current credentials are kept if they can't be loaded
+      \param[in] certFile PEM file with the certificate chain, the server's certificate goes first
+      \param[in] keyFile PEM file with the private key
+      \return false if the files can't be loaded
+    */
+    bool load(const std::string &certFile, const std::string &keyFile);
+
+    /*!
+      \return true if a file has been replaced or modified since it was loaded
+    */
+    bool changed() const;
+
+    /*!
+      Makes the handshake of the session use the credentials
+      \param[in] tickets Should the client get a ticket to resume the session
+    */
+    void attach(gnutls_session_t session, bool tickets);
+
+    /*!
+      gnutls_certificate_retrieve_function2 of the sessions the credentials are attached to
+    */
+    static int retrieve(gnutls_session_t session, const gnutls_datum_t *reqCaDn, int reqCaDnCount,
+                        const gnutls_pk_algorithm_t *pkAlgorithms, int pkAlgorithmsCount, gnutls_pcert_st **pcert,
+                        unsigned int *pcertCount, gnutls_privkey_t *privateKey);
+
+private:
+    struct Credentials
+    {
+        std::vector<gnutls_pcert_st> chain;
+        gnutls_privkey_t key{nullptr};
+    };
+
+    struct FileVersion
+    {
+        ino_t inode;
+        off_t size;
+        struct timespec mtime;
+    };
+
+    static bool version(const std::string &path, FileVersion &result);
+    static bool sameVersion(const FileVersion &lhs, const FileVersion &rhs);
+    static void release(Credentials &credentials);
+
+    mutable std::mutex _mutex;
+    std::vector<std::unique_ptr<Credentials>> _loaded; // the last one is used
+    std::string _certFile;
+    std::string _keyFile;
+    FileVersion _certVersion{};
+    FileVersion _keyVersion{};
+    gnutls_datum_t _ticketKey{nullptr, 0};
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
@@ -1,5 +1,15 @@
 #include "utils.hh"
 
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include <fcntl.h>
+#include <unistd.h>
+
 int MHD_getParamsIter(void *cls, enum MHD_ValueKind kind, const char *key, const char *value)
 {
     // DO TO: does the kind parameter make any sence here?
@@ -16,32 +26,203 @@ int MHD_getParamsIter(void *cls, enum MHD_ValueKind kind, const char *key, const
     return MHD_YES; // continue iteration)
 }
 
-// TODO move somewhere
-bool ParseRange(const std::string &str, Range &range) noexcept
+namespace
+{
+// a client asking for more is likely to abuse the server
+constexpr std::size_t cMaxRanges = 16;
+const char *const cRangesUnit = "bytes=";
+
+uint64_t parseOffset(const std::string &str)
+{
+    if (str.empty() || str.find_first_not_of("0123456789") != std::string::npos)
+    {
+        throw std::invalid_argument("invalid offset '" + str + "'");
+    }
+    return std::stoull(str);
+}
+
+std::string trim(const std::string &str)
+{
+    const std::size_t first = str.find_first_not_of(" \t");
+    if (first == std::string::npos)
+    {
+        return std::string();
+    }
+    return str.substr(first, str.find_last_not_of(" \t") - first + 1);
+}
+} // namespace
+
+int activatedSocket()
+{
+    // sockets of sd_listen_fds() start from this descriptor
+    constexpr int listenFdsStart = 3;
+
+    const char *pid = std::getenv("LISTEN_PID");
+    const char *fds = std::getenv("LISTEN_FDS");
+    if (!pid || !fds || std::strtol(pid, nullptr, 10) != getpid() || std::strtol(fds, nullptr, 10) < 1)
+    {
+        return -1;
+    }
+    // children of the process must not inherit it
+    fcntl(listenFdsStart, F_SETFD, FD_CLOEXEC);
+    return listenFdsStart;
+}
+
+bool parseRanges(const std::string &str, uint64_t size, std::vector<ByteRange> &ranges) noexcept
 {
-    range = Range();
+    ranges.clear();
     try
     {
-        std::size_t p = str.find('=');
-        if (p != std::string::npos)
+        if (str.compare(0, strlen(cRangesUnit), cRangesUnit) != 0)
         {
-            std::string s(str.substr(p + 1));
-            if ((p = s.find('-')) != std::string::npos)
-            {
-                range._pos_begin = std::stol(s.substr(0, p));
-                if (p + 1 < s.length())
-                    range._pos_end = std::stol(s.substr(p + 1));
-            }
+            throw std::invalid_argument("Range string without 'bytes=' prefix");
         }
-        else
+        std::size_t count = 0;
+        std::size_t begin = strlen(cRangesUnit);
+        while (begin <= str.size())
         {
-            throw std::invalid_argument("Range string without 'Range' prefix");
+            std::size_t end = str.find(',', begin);
+            if (end == std::string::npos)
+            {
+                end = str.size();
+            }
+            const std::string spec = trim(str.substr(begin, end - begin));
+            begin = end + 1;
+            if (++count > cMaxRanges)
+            {
+                throw std::invalid_argument("too many ranges");
+            }
+
+            const std::size_t dash = spec.find('-');
+            if (dash == std::string::npos)
+            {
+                throw std::invalid_argument("range without '-'");
+            }
+            ByteRange range;
+            if (dash == 0)
+            {
+                // the last bytes of the file
+                const uint64_t suffix = parseOffset(spec.substr(1));
+                if (!suffix || !size)
+                {
+                    continue;
+                }
+                range.first = suffix < size ? size - suffix : 0;
+                range.last = size - 1;
+            }
+            else
+            {
+                range.first = parseOffset(spec.substr(0, dash));
+                range.last = dash + 1 < spec.size() ? parseOffset(spec.substr(dash + 1)) : UINT64_MAX;
+                if (range.last < range.first)
+                {
+                    throw std::invalid_argument("range ends before it starts");
+                }
+                if (range.first >= size)
+                {
+                    continue;
+                }
+                if (range.last >= size)
+                {
+                    range.last = size - 1;
+                }
+            }
+            ranges.push_back(range);
         }
     }
     catch (std::exception &ex)
     {
         LOGE(LOG_DOMAIN, "Parsing of range string '%s' failed.\nReason: %s", str.c_str(), ex.what());
+        ranges.clear();
         return false;
     }
-    return true;
-};
+    return !ranges.empty();
+}
+
+ByteRangesReader::ByteRangesReader(int fd, uint64_t size, const std::vector<ByteRange> &ranges,
+                                   const std::string &contentType)
+    : _fd(fd)
+{
+    std::random_device random;
+    char boundary[32];
+    snprintf(boundary, sizeof(boundary), "%08x%08x", random(), random());
+    _boundary = boundary;
+
+    for (const ByteRange &range : ranges)
+    {
+        Part part;
+        part.header = "\r\n--" + _boundary + "\r\nContent-Type: " + contentType + "\r\nContent-Range: bytes " +
+                      std::to_string(range.first) + "-" + std::to_string(range.last) + "/" + std::to_string(size) +
+                      "\r\n\r\n";
+        part.offset = range.first;
+        part.length = range.length();
+        part.position = _size;
+        _size += part.header.size() + part.length;
+        _parts.push_back(std::move(part));
+    }
+    _trailer = "\r\n--" + _boundary + "--\r\n";
+    _size += _trailer.size();
+}
+
+ByteRangesReader::~ByteRangesReader()
+{
+    ::close(_fd);
+}
+
+ssize_t ByteRangesReader::read(void *cls, uint64_t pos, char *buf, size_t max)
+{
+    return static_cast<ByteRangesReader *>(cls)->read(pos, buf, max);
+}
+
+void ByteRangesReader::free(void *cls)
+{
+    delete static_cast<ByteRangesReader *>(cls);
+}
+
+ssize_t ByteRangesReader::read(uint64_t pos, char *buf, size_t max)
+{
+    if (pos >= _size)
+    {
+        return MHD_CONTENT_READER_END_OF_STREAM;
+    }
+    if (_current >= _parts.size() || pos < _parts[_current].position)
+    {
+        _current = 0;
+    }
+    while (_current < _parts.size() &&
+           pos >= _parts[_current].position + _parts[_current].header.size() + _parts[_current].length)
+    {
+        ++_current;
+    }
+
+    if (_current == _parts.size())
+    {
+        const uint64_t offset = pos - (_size - _trailer.size());
+        const std::size_t length = std::min<uint64_t>(max, _trailer.size() - offset);
+        memcpy(buf, _trailer.data() + offset, length);
+        return static_cast<ssize_t>(length);
+    }
+
+    const Part &part = _parts[_current];
+    const uint64_t offset = pos - part.position;
+    if (offset < part.header.size())
+    {
+        const std::size_t length = std::min<uint64_t>(max, part.header.size() - offset);
+        memcpy(buf, part.header.data() + offset, length);
+        return static_cast<ssize_t>(length);
+    }
+
+    const uint64_t dataOffset = offset - part.header.size();
+    const std::size_t length = std::min<uint64_t>(max, part.length - dataOffset);
+    ssize_t received;
+    do
+    {
+        received = pread(_fd, buf, length, static_cast<off_t>(part.offset + dataOffset));
+    } while (received < 0 && errno == EINTR);
+    if (received <= 0)
+    {
+        LOGE(LOG_DOMAIN, "Reading of file range failed: %s", received ? strerror(errno) : "unexpected end of file");
+        return MHD_CONTENT_READER_END_WITH_ERROR;
+    }
+    return received;
+}
@@ -5,67 +5,105 @@
 
 #include <microhttpd.h>
 
+#include <cstdint>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 const char *const LOG_DOMAIN = "HttpServerMHD";
 
 constexpr int cHttpDaemonAddressReuse = 1;
-constexpr int cHttpDaemonConnectionsLimit = 50;
-constexpr int cHttpDaemonConnectionsPerIPLimit = cHttpDaemonConnectionsLimit / 2;
+// size of blocks of generated responses
+constexpr size_t cFileBlockSize = 64 * 1024;
 
 using ParamsMap = std::map<std::string, softeq::common::stdutils::Optional<std::string>>;
 
 int MHD_getParamsIter(void *cls, enum MHD_ValueKind kind, const char *key, const char *value);
 
-// TODO move somewhere
-struct Range final
-{
-    Range()
-    {
-    }
-    Range(int pos_begin, int pos_end)
-        : _pos_begin(pos_begin)
-        , _pos_end(pos_end)
-    {
-    }
+/*!
+  \return First socket passed to the process by systemd socket activation, or -1 if there is none
+*/
+int activatedSocket();
 
-    int _pos_begin = 0;
-    int _pos_end = 0;
+/*!
+  Range of bytes of a file, both offsets are included
+*/
+struct ByteRange final
+{
+    uint64_t first;
+    uint64_t last;
 
-    int length() const noexcept
+    uint64_t length() const noexcept
     {
-        return (_pos_end >= _pos_begin) ? (_pos_end - _pos_begin + 1) : 0;
+        return last - first + 1;
     }
 };
 
-// TODO move somewhere
-bool ParseRange(const std::string &str, Range &range) noexcept;
+/*!
+  Parses the value of Range header, unsatisfiable ranges are dropped and the rest is clipped to the file
+  \param[in] str "bytes=<first>-[<last>][,<first>-[<last>]|,-<suffix length>]..."
+  \param[in] size Size of the file
+  \param[out] ranges Ranges in the order of the request
+  \return false if the header is malformed, too many ranges are requested or none of them is satisfiable
+*/
+bool parseRanges(const std::string &str, uint64_t size, std::vector<ByteRange> &ranges) noexcept;
 
-class FileReaderContext final
+/*!
+  Source of a multipart/byteranges response, parts are read from the file with pread()
+*/
+class ByteRangesReader final
 {
-    FILE *_file = nullptr;
-    int64_t _offset = 0;
-
 public:
-    FileReaderContext(FILE *file, int64_t offset)
-        : _file(file)
-        , _offset(offset)
-    {
-        if (!file)
-            throw std::invalid_argument(std::string(__func__) + "(): file");
-    }
+    /*!
+      \param[in] fd Descriptor of the file, the reader closes it
+      \param[in] size Size of the file
+      \param[in] ranges Ranges to send
+      \param[in] contentType Type of the parts
+    */
+    ByteRangesReader(int fd, uint64_t size, const std::vector<ByteRange> &ranges, const std::string &contentType);
+    ~ByteRangesReader();
+
+    ByteRangesReader(const ByteRangesReader &) = delete;
+    ByteRangesReader &operator=(const ByteRangesReader &) = delete;
 
-    ~FileReaderContext()
+    const std::string &boundary() const noexcept
     {
-        ::fclose(_file);
+        return _boundary;
     }
 
-    FILE *file() const noexcept
+    /*!
+      \return Size of the whole body
+    */
+    uint64_t size() const noexcept
     {
-        return _file;
+        return _size;
     }
-    int64_t offset() const noexcept
+
+    /*!
+      MHD_ContentReaderCallback
+    */
+    static ssize_t read(void *cls, uint64_t pos, char *buf, size_t max);
+
+    /*!
+      MHD_ContentReaderFreeCallback
+    */
+    static void free(void *cls);
+
+private:
+    struct Part
     {
-        return _offset;
-    }
+        std::string header; // boundary and headers of the part, it precedes the data
+        uint64_t offset;    // in the file
+        uint64_t length;
+        uint64_t position;  // of the header in the body
+    };
+
+    ssize_t read(uint64_t pos, char *buf, size_t max);
+
+    int _fd;
+    std::string _boundary;
+    std::vector<Part> _parts;
+    std::string _trailer;
+    uint64_t _size{0};
+    std::size_t _current{0}; // the part read last, reads are sequential
 };
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "compression.hh"
+
+#include <cstring>
+#include <string>
+
+#include <zlib.h>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+std::string inflate(const std::string &data, ContentCoding coding)
+{
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    // +16 expects the gzip header
+    EXPECT_EQ(inflateInit2(&stream, coding == ContentCoding::GZIP ? 15 + 16 : 15), Z_OK);
+    std::string output(1024 * 1024, '\0');
+    stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data()));
+    stream.avail_in = static_cast<uInt>(data.size());
+    stream.next_out = reinterpret_cast<Bytef *>(&output[0]);
+    stream.avail_out = static_cast<uInt>(output.size());
+    EXPECT_EQ(::inflate(&stream, Z_FINISH), Z_STREAM_END);
+    output.resize(stream.total_out);
+    inflateEnd(&stream);
+    return output;
+}
+} // namespace
+
+TEST(Compression, Negotiation)
+{
+    EXPECT_EQ(negotiateContentCoding(""), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiateContentCoding("identity"), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiateContentCoding("gzip"), ContentCoding::GZIP);
+    EXPECT_EQ(negotiateContentCoding("deflate, gzip"), ContentCoding::GZIP);
+    EXPECT_EQ(negotiateContentCoding("br, deflate"), ContentCoding::DEFLATE);
+    EXPECT_EQ(negotiateContentCoding("gzip;q=0.5, deflate"), ContentCoding::DEFLATE);
+    EXPECT_EQ(negotiateContentCoding("GZIP ; q=0"), ContentCoding::IDENTITY);
+    EXPECT_EQ(negotiateContentCoding("*"), ContentCoding::GZIP);
+    EXPECT_EQ(negotiateContentCoding("gzip;q=0, *"), ContentCoding::DEFLATE);
+    EXPECT_EQ(negotiateContentCoding("*;q=0"), ContentCoding::IDENTITY);
+}
+
+TEST(Compression, CompressibleTypes)
+{
+    EXPECT_TRUE(isCompressibleType(""));
+    EXPECT_TRUE(isCompressibleType("application/json"));
+    EXPECT_TRUE(isCompressibleType("text/html; charset=utf-8"));
+    EXPECT_FALSE(isCompressibleType("image/png"));
+    EXPECT_FALSE(isCompressibleType("Video/mp4"));
+    EXPECT_FALSE(isCompressibleType("application/gzip"));
+}
+
+TEST(Compression, RoundTrip)
+{
+    std::string data;
+    for (int i = 0; i < 1000; ++i)
+    {
+        data += "{\"id\":" + std::to_string(i) + ",\"name\":\"value\"},";
+    }
+
+    for (ContentCoding coding : {ContentCoding::GZIP, ContentCoding::DEFLATE})
+    {
+        std::string compressed;
+        ASSERT_TRUE(compress(data.data(), data.size(), coding, 6, compressed));
+        EXPECT_LT(compressed.size(), data.size() / 4);
+        EXPECT_EQ(inflate(compressed, coding), data);
+    }
+
+    std::string compressed;
+    EXPECT_FALSE(compress(data.data(), data.size(), ContentCoding::IDENTITY, 6, compressed));
+    // the data which doesn't get smaller is sent as is
+    EXPECT_FALSE(compress("abc", 3, ContentCoding::GZIP, 6, compressed));
+    EXPECT_TRUE(compressed.empty());
+}
@@ -0,0 +1,152 @@
+#include <gtest/gtest.h>
+
+#include "file_cache.hh"
+
+#include <fstream>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+const std::string cFirstFile{"/tmp/file_cache_test_1.txt"};
+const std::string cSecondFile{"/tmp/file_cache_test_2.txt"};
+
+void writeFile(const std::string &path, const std::string &data)
+{
+    std::ofstream file(path);
+    file << data;
+}
+
+class FileCacheTest : public ::testing::Test
+{
+protected:
+    void TearDown() override
+    {
+        unlink(cFirstFile.c_str());
+        unlink(cSecondFile.c_str());
+    }
+};
+} // namespace
+
+TEST_F(FileCacheTest, KeepsContents)
+{
+    writeFile(cFirstFile, "0123456789");
+    FileCache cache(100, 50, std::chrono::hours(1));
+
+    FileCache::EntrySPtr entry = cache.get(cFirstFile);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->size, 10U);
+    ASSERT_NE(entry->content, nullptr);
+    EXPECT_EQ(*entry->content, "0123456789");
+    EXPECT_EQ(entry->etag.front(), '"');
+    EXPECT_EQ(entry->etag.back(), '"');
+    EXPECT_EQ(cache.memoryUsage(), 10U);
+
+    // the file is not checked again within the period
+    unlink(cFirstFile.c_str());
+    EXPECT_EQ(cache.get(cFirstFile), entry);
+    EXPECT_EQ(cache.get("/tmp/file_cache_test_absent"), nullptr);
+}
+
+TEST_F(FileCacheTest, LargeFileWithoutContents)
+{
+    writeFile(cFirstFile, std::string(60, 'x'));
+    FileCache cache(100, 50);
+
+    FileCache::EntrySPtr entry = cache.get(cFirstFile);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->size, 60U);
+    EXPECT_EQ(entry->content, nullptr);
+    EXPECT_EQ(cache.memoryUsage(), 0U);
+}
+
+TEST_F(FileCacheTest, Revalidation)
+{
+    writeFile(cFirstFile, "first");
+    FileCache cache(100, 50, std::chrono::milliseconds(0));
+
+    FileCache::EntrySPtr first = cache.get(cFirstFile);
+    ASSERT_NE(first, nullptr);
+    // unchanged file keeps its entry
+    EXPECT_EQ(cache.get(cFirstFile), first);
+
+    writeFile(cFirstFile, "second file");
+    FileCache::EntrySPtr second = cache.get(cFirstFile);
+    ASSERT_NE(second, nullptr);
+    EXPECT_NE(second->etag, first->etag);
+    EXPECT_EQ(*second->content, "second file");
+    // the replaced contents stay valid while they are used
+    EXPECT_EQ(*first->content, "first");
+    EXPECT_EQ(cache.memoryUsage(), 11U);
+
+    unlink(cFirstFile.c_str());
+    EXPECT_EQ(cache.get(cFirstFile), nullptr);
+    EXPECT_EQ(cache.memoryUsage(), 0U);
+}
+
+TEST_F(FileCacheTest, Invalidation)
+{
+    writeFile(cFirstFile, "first");
+    FileCache cache(100, 50, std::chrono::hours(1));
+
+    FileCache::EntrySPtr first = cache.get(cFirstFile);
+    ASSERT_NE(first, nullptr);
+    struct stat st;
+    ASSERT_EQ(stat(cFirstFile.c_str(), &st), 0);
+    EXPECT_TRUE(first->describes(st));
+
+    // the change is not noticed within the period unless the entry is invalidated
+    writeFile(cFirstFile, "second file");
+    ASSERT_EQ(stat(cFirstFile.c_str(), &st), 0);
+    EXPECT_FALSE(first->describes(st));
+    EXPECT_EQ(cache.get(cFirstFile), first);
+    cache.invalidate(cFirstFile);
+    FileCache::EntrySPtr second = cache.get(cFirstFile);
+    ASSERT_NE(second, nullptr);
+    EXPECT_TRUE(second->describes(st));
+    EXPECT_EQ(*second->content, "second file");
+}
+
+TEST_F(FileCacheTest, LeastRecentlyUsedEviction)
+{
+    writeFile(cFirstFile, std::string(40, '1'));
+    writeFile(cSecondFile, std::string(40, '2'));
+    FileCache cache(60, 50, std::chrono::hours(1));
+
+    FileCache::EntrySPtr first = cache.get(cFirstFile);
+    ASSERT_NE(first, nullptr);
+    FileCache::EntrySPtr second = cache.get(cSecondFile);
+    ASSERT_NE(second, nullptr);
+    EXPECT_EQ(cache.memoryUsage(), 40U);
+
+    // the first file has been dropped and it is read again
+    EXPECT_NE(cache.get(cFirstFile), first);
+    EXPECT_EQ(cache.memoryUsage(), 40U);
+}
+
+TEST_F(FileCacheTest, CompressedVariant)
+{
+    writeFile(cFirstFile, std::string(1000, 'x'));
+    FileCache cache(2000, 1000, std::chrono::hours(1));
+
+    FileCache::EntrySPtr entry = cache.get(cFirstFile);
+    ASSERT_NE(entry, nullptr);
+    std::shared_ptr<const std::string> gzipped = cache.gzipped(cFirstFile, entry, 6);
+    ASSERT_NE(gzipped, nullptr);
+    EXPECT_LT(gzipped->size(), 100U);
+    EXPECT_EQ(cache.memoryUsage(), 1000U + gzipped->size());
+    // it is compressed once
+    EXPECT_EQ(cache.gzipped(cFirstFile, entry, 6), gzipped);
+}
+
+TEST(FileCache, HttpDate)
+{
+    EXPECT_EQ(FileCache::httpDate(784111777), "Sun, 06 Nov 1994 08:49:37 GMT");
+    EXPECT_EQ(FileCache::parseHttpDate("Sun, 06 Nov 1994 08:49:37 GMT"), 784111777);
+    EXPECT_EQ(FileCache::parseHttpDate("06 Nov 1994"), -1);
+    EXPECT_EQ(FileCache::parseHttpDate(""), -1);
+}
@@ -1,3 +1,5 @@
+#include <cstddef>
+#include <cstring>
 #include <ctime>
 #include <gtest/gtest.h>
 
@@ -8,6 +10,7 @@
 #include <common/logging/log.hh>
 #include <system/testtimeprovider.hh>
 
+#include <map>
 #include <memory>
 #include <stdexcept>
 #include <string>
@@ -17,15 +20,25 @@
 #include <future>
 #include <chrono>
 #include <utility>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include <sys/stat.h>
 #include <uuid/uuid.h>
+#include <zlib.h>
 
 #include <ifaddrs.h>
 #include <sys/types.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <netdb.h>
+#include <netinet/in.h>
 #include <net/if.h>
 
 using namespace softeq::common;
@@ -46,6 +59,18 @@ const std::string endpointDownloadFile{"/download_file.txt"};
 const std::string endpointCreateSession{"/create_session"};
 const std::string endpointSessionData{"/session_data"};
 const std::string endpointCreateSessionWithSleep{"/create_session_with_sleep"};
+const std::string endpointEcho{"/echo"};
+const std::string endpointLarge{"/large"};
+constexpr std::size_t cLargeResponseSize = 4 * 1024 * 1024;
+const std::string endpointStream{"/stream"};
+const std::string endpointEvents{"/events"};
+const std::string endpointIdleEvents{"/idle_events"};
+const std::string endpointConsumedUpload{"/consumed_upload"};
+const std::string endpointForm{"/form"};
+const std::string endpointRefused{"/refused"};
+const std::string endpointAsync{"/async"};
+const std::string endpointAbandoned{"/abandoned"};
+const std::chrono::milliseconds cAsyncDelay{300};
 
 const std::string headerXSession{"X-Session"};
 const std::string headerXSessionExpiry{"X-Session-Expiry"};
@@ -53,6 +78,72 @@ const std::string headerXSessionExpiry{"X-Session-Expiry"};
 
 std::string execCmdInTerminal(const char *cmd);
 
+// path starting with '@' is the name of an abstract socket
+std::string requestOverUnixSocket(const std::string &path, const std::string &endpoint)
+{
+    sockaddr_un address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, path.data(), path.size());
+    socklen_t length = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + path.size());
+    if (path[0] == '@')
+    {
+        address.sun_path[0] = '\0';
+    }
+    else
+    {
+        ++length;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    std::string response;
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address), length) == 0)
+    {
+        const std::string request = "GET " + endpoint + " HTTP/1.0\r\nHost: localhost\r\n\r\n";
+        if (write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()))
+        {
+            char buffer[4096];
+            ssize_t size;
+            while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+            {
+                response.append(buffer, static_cast<std::size_t>(size));
+            }
+        }
+    }
+    close(fd);
+    return response;
+}
+
+/* connects to the server on the first address, -1 on error */
+int connectToServer()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(8080);
+    inet_pton(AF_INET, firstIpAddr.c_str(), &address.sin_addr);
+    if (fd != -1 && connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0)
+    {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}
+
+/* sends a request over a kept-alive connection and returns what the server has answered */
+std::string requestOverConnection(int fd, const std::string &endpoint)
+{
+    const std::string request = "GET " + endpoint + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    std::string response;
+    pollfd pfd{fd, POLLIN, 0};
+    if (write(fd, request.data(), request.size()) == static_cast<ssize_t>(request.size()) && poll(&pfd, 1, 5000) == 1)
+    {
+        char buffer[4096];
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        response.assign(buffer, size > 0 ? static_cast<std::size_t>(size) : 0);
+    }
+    return response;
+}
+
 class TestHttpDispatcher final : public IHttpConnectionDispatcher
 {
 public:
@@ -65,6 +156,42 @@ public:
         }
     };
 
+    bool prepare(IHttpConnection &connection) override
+    {
+        if (connection.path() == endpointConsumedUpload)
+        {
+            _uploadedContent.clear();
+            connection.consumeBody([this](DataView chunk) {
+                _uploadedContent.append(chunk.data, chunk.size);
+                return true;
+            });
+        }
+        else if (connection.path() == endpointForm)
+        {
+            _formFields.clear();
+            _formFileName.clear();
+            const bool form = connection.consumeForm([this](const FormChunk &chunk) {
+                _formFields[chunk.name].append(chunk.data.data, chunk.data.size);
+                if (chunk.filename)
+                {
+                    _formFileName = chunk.filename;
+                }
+                return true;
+            });
+            if (!form)
+            {
+                connection.setError(415);
+                return false;
+            }
+        }
+        else if (connection.path() == endpointRefused)
+        {
+            connection.setError(HttpStatusCode::STATUS_FORBIDDEN);
+            return false;
+        }
+        return true;
+    }
+
     bool handle(IHttpConnection &connection) override
     {
         if (connection.path() == endpointRoot)
@@ -109,6 +236,83 @@ public:
             connection << session->data;
             return true;
         }
+        if (connection.path() == endpointEcho)
+        {
+            // the request is answered with its own parts, taken without copies
+            DataView path = connection.pathView();
+            DataView header = connection.headerView("X-Echo");
+            DataView body = connection.bodyView();
+            connection.reserveResponse(path.size + header.size + body.size + 2);
+            connection << path.str() << "|" << header.str() << "|" << body.str();
+            EXPECT_TRUE(connection.headerView("X-Absent").empty());
+            return true;
+        }
+        if (connection.path() == endpointLarge)
+        {
+            std::string data(cLargeResponseSize, 'x');
+            const std::string vary = connection.header("X-Vary");
+            if (!vary.empty())
+            {
+                connection.setResponseHeader("Vary", vary);
+            }
+            connection << std::move(data);
+            // the response took the string over
+            EXPECT_TRUE(data.empty());
+            return true;
+        }
+        if (connection.path() == endpointStream)
+        {
+            // parts are produced on demand of the client
+            std::shared_ptr<int> part = std::make_shared<int>(0);
+            connection << "head|";
+            connection.startStream([part](IHttpStream &stream) {
+                stream.write(std::string(1000, static_cast<char>('a' + *part)));
+                return ++*part < 10;
+            });
+            return true;
+        }
+        if (connection.path() == endpointEvents)
+        {
+            IHttpStream::SPtr stream = connection.startEventStream();
+            std::thread([stream] {
+                for (int i = 0; i < 3; ++i)
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+                    stream->sendEvent("tick " + std::to_string(i), "tick", std::to_string(i));
+                }
+                stream->close();
+            })
+                .detach();
+            return true;
+        }
+        if (connection.path() == endpointIdleEvents)
+        {
+            // nobody sends events, the stream ends when the server stops
+            connection.startEventStream();
+            return true;
+        }
+        if (connection.path() == endpointAsync || connection.path() == endpointAbandoned)
+        {
+            // a worker answers later while the server thread is free
+            IHttpCompletion::SPtr completion = connection.defer();
+            const bool abandon = connection.path() == endpointAbandoned;
+            std::thread([completion, abandon] {
+                std::this_thread::sleep_for(cAsyncDelay);
+                if (!abandon)
+                {
+                    EXPECT_TRUE(completion->complete([](IHttpConnection &connection) { connection << "async"; }));
+                    EXPECT_FALSE(completion->complete([](IHttpConnection &connection) { connection << "again"; }));
+                }
+            })
+                .detach();
+            return true;
+        }
+        if (connection.path() == endpointConsumedUpload || connection.path() == endpointForm)
+        {
+            // the body has been taken over
+            connection << std::to_string(connection.bodyView().size);
+            return true;
+        }
         if (connection.path() == endpointCreateSessionWithSleep)
         {
             auto session(std::make_shared<TestSession>());
@@ -130,8 +334,20 @@ public:
         return _uploadedContent;
     }
 
+    std::map<std::string, std::string> formFields()
+    {
+        return _formFields;
+    }
+
+    std::string formFileName()
+    {
+        return _formFileName;
+    }
+
 private:
     std::string _uploadedContent;
+    std::map<std::string, std::string> _formFields;
+    std::string _formFileName;
 };
 
 class HttpServerTest : public testing::Test
@@ -242,6 +458,25 @@ protected:
         ASSERT_TRUE(curl.responseText() == data);
     }
 
+    void checkConcurrentRequests(int count)
+    {
+        std::vector<std::future<std::pair<bool, std::string>>> requests;
+        for (int i = 0; i < count; ++i)
+        {
+            requests.push_back(std::async(std::launch::async, [] {
+                CurlHelper curl(firstIpAddr + ":8080" + endpointClient);
+                bool success = curl.doGet() && curl.responseCode() == HttpStatusCode::STATUS_OK;
+                return std::make_pair(success, curl.responseText());
+            }));
+        }
+        for (auto &request : requests)
+        {
+            auto result = request.get();
+            EXPECT_TRUE(result.first);
+            EXPECT_EQ(result.second, firstIpAddr);
+        }
+    }
+
     std::string _testFileName = "";
     IHttpServer::settings_t _serverSettings;
     TestHttpDispatcher _dispatcher;
@@ -297,6 +532,313 @@ TEST_F(HttpServerTest, ClientData)
     checkClientInfo(firstIpAddr);
 }
 
+TEST_F(HttpServerTest, ThreadPerConnection_ConcurrentRequests)
+{
+    EXPECT_EQ(_server->pollDescriptor(), -1);
+    EXPECT_FALSE(_server->run());
+    checkConcurrentRequests(16);
+}
+
+TEST_F(HttpServerTest, ThreadPool_ConcurrentRequests)
+{
+    _server->stop();
+    _serverSettings.threading = IHttpServer::ThreadingMode::THREAD_POOL;
+    _serverSettings.threadPoolSize = 4;
+    ASSERT_TRUE(_server->start());
+    EXPECT_EQ(_server->pollDescriptor(), -1);
+    checkConcurrentRequests(16);
+
+    // the pool size defaults to the number of CPUs
+    _server->stop();
+    _serverSettings.threadPoolSize = 0;
+    ASSERT_TRUE(_server->start());
+    checkConcurrentRequests(16);
+}
+
+TEST_F(HttpServerTest, ExternalLoop_ConcurrentRequests)
+{
+    _server->stop();
+    _serverSettings.threading = IHttpServer::ThreadingMode::EXTERNAL;
+    ASSERT_TRUE(_server->start());
+    ASSERT_GE(_server->pollDescriptor(), 0);
+
+    std::atomic<bool> stop{false};
+    std::thread loop([this, &stop] {
+        pollfd fd{_server->pollDescriptor(), POLLIN, 0};
+        while (!stop)
+        {
+            long timeout = _server->pollTimeout();
+            poll(&fd, 1, (timeout < 0 || timeout > 100) ? 100 : static_cast<int>(timeout));
+            _server->run();
+        }
+    });
+    checkConcurrentRequests(16);
+    stop = true;
+    loop.join();
+}
+
+TEST_F(HttpServerTest, DeferredResponse)
+{
+    CurlHelper curl(_serverUrl + endpointAsync);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseText(), "async");
+
+    CurlHelper abandoned(_serverUrl + endpointAbandoned);
+    ASSERT_TRUE(abandoned.doGet());
+    EXPECT_EQ(abandoned.responseCode(), HttpStatusCode::STATUS_INTERNAL_ERROR);
+}
+
+TEST_F(HttpServerTest, ThreadPool_DeferredResponses)
+{
+    _server->stop();
+    _serverSettings.threading = IHttpServer::ThreadingMode::THREAD_POOL;
+    _serverSettings.threadPoolSize = 2;
+    ASSERT_TRUE(_server->start());
+
+    // suspended requests take no thread, so they wait for their workers together
+    constexpr int count = 8;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::future<std::pair<bool, std::string>>> requests;
+    for (int i = 0; i < count; ++i)
+    {
+        requests.push_back(std::async(std::launch::async, [this] {
+            CurlHelper curl(_serverUrl + endpointAsync);
+            bool success = curl.doGet() && curl.responseCode() == HttpStatusCode::STATUS_OK;
+            return std::make_pair(success, curl.responseText());
+        }));
+    }
+    for (auto &request : requests)
+    {
+        auto result = request.get();
+        EXPECT_TRUE(result.first);
+        EXPECT_EQ(result.second, "async");
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, cAsyncDelay * count / 2);
+
+    CurlHelper abandoned(_serverUrl + endpointAbandoned);
+    ASSERT_TRUE(abandoned.doGet());
+    EXPECT_EQ(abandoned.responseCode(), HttpStatusCode::STATUS_INTERNAL_ERROR);
+}
+
+TEST_F(HttpServerTest, Overload_ServiceUnavailable)
+{
+    _server->stop();
+    _serverSettings.maxConnections = 2;
+    _serverSettings.overloadConnections = 4;
+    _serverSettings.overloadRetryAfter = 5;
+    ASSERT_TRUE(_server->start());
+
+    // both slots are busy for a while
+    std::vector<std::future<bool>> slowRequests;
+    for (int i = 0; i < 2; ++i)
+    {
+        slowRequests.push_back(std::async(std::launch::async, [this] {
+            CurlHelper curl(_serverUrl + endpointCreateSessionWithSleep);
+            return curl.doPost("data");
+        }));
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    CurlHelper rejected(_serverUrl + endpointClient);
+    ASSERT_TRUE(rejected.doGet());
+    EXPECT_EQ(rejected.responseCode(), HttpStatusCode::STATUS_SERVICE_UNAVAILABLE);
+    EXPECT_EQ(rejected.responseHeader("Retry-After"), "5");
+
+    for (auto &request : slowRequests)
+    {
+        EXPECT_TRUE(request.get());
+    }
+    // closing of the sockets is noticed by the server asynchronously
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    checkClientInfo(firstIpAddr);
+}
+
+TEST_F(HttpServerTest, Overload_KeptAliveConnectionServed)
+{
+    _server->stop();
+    _serverSettings.maxConnections = 1;
+    _serverSettings.overloadConnections = 2;
+    ASSERT_TRUE(_server->start());
+
+    int slot = connectToServer();
+    ASSERT_NE(slot, -1);
+    EXPECT_EQ(requestOverConnection(slot, endpointClient).compare(8, 5, " 200 "), 0);
+
+    // only the connection accepted beyond the limit is rejected
+    int extra = connectToServer();
+    ASSERT_NE(extra, -1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_EQ(requestOverConnection(slot, endpointClient).compare(8, 5, " 200 "), 0);
+    EXPECT_EQ(requestOverConnection(extra, endpointClient).compare(8, 5, " 503 "), 0);
+    close(extra);
+    close(slot);
+}
+
+TEST_F(HttpServerTest, RateLimit_TooManyRequests)
+{
+    _server->stop();
+    _serverSettings.rateLimit = 1;
+    _serverSettings.rateLimitBurst = 3;
+    ASSERT_TRUE(_server->start());
+
+    for (int i = 0; i < 3; ++i)
+    {
+        CurlHelper curl(_serverUrl + endpointLarge);
+        ASSERT_TRUE(curl.doGet());
+        EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    }
+    // the limit is shared by all paths of the client
+    CurlHelper curl(_serverUrl + endpointStream);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_TOO_MANY_REQUESTS);
+    EXPECT_EQ(curl.responseHeader("Retry-After"), "1");
+
+    _server->stop();
+    _serverSettings.rateLimitPerPath = true;
+    ASSERT_TRUE(_server->start());
+    for (int i = 0; i < 3; ++i)
+    {
+        CurlHelper curl(_serverUrl + endpointLarge);
+        ASSERT_TRUE(curl.doGet());
+        EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    }
+    CurlHelper limited(_serverUrl + endpointLarge + "?again");
+    ASSERT_TRUE(limited.doGet());
+    EXPECT_EQ(limited.responseCode(), HttpStatusCode::STATUS_TOO_MANY_REQUESTS);
+    CurlHelper other(_serverUrl + endpointStream);
+    ASSERT_TRUE(other.doGet());
+    EXPECT_EQ(other.responseCode(), HttpStatusCode::STATUS_OK);
+}
+
+TEST_F(HttpServerTest, LoadShedding_LightLoad)
+{
+    EXPECT_EQ(_server->loadStats().shedRequests, 0U);
+
+    _server->stop();
+    _serverSettings.shedTargetDelay = 50;
+    ASSERT_TRUE(_server->start());
+    checkConcurrentRequests(16);
+    const HttpLoadStats stats = _server->loadStats();
+    EXPECT_FALSE(stats.overloaded);
+    EXPECT_EQ(stats.shedRequests, 0U);
+}
+
+TEST_F(HttpServerTest, ListenSocket_RestartWithoutRefusing)
+{
+    // the socket is opened by somebody else, e.g. the parent process
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_NE(fd, -1);
+    int reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(8081);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+    ASSERT_EQ(listen(fd, 16), 0);
+
+    _server->stop();
+    _serverSettings.listenSocket = fd;
+    ASSERT_TRUE(_server->start());
+    {
+        CurlHelper curl("http://127.0.0.1:8081" + endpointLarge);
+        ASSERT_TRUE(curl.doGet());
+        EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    }
+
+    // a client connecting while the server is down waits in the backlog
+    _server->stop();
+    EXPECT_NE(fcntl(fd, F_GETFD), -1);
+    std::future<int> request = std::async(std::launch::async, [] {
+        CurlHelper curl("http://127.0.0.1:8081" + endpointLarge);
+        return curl.doGet() ? static_cast<int>(curl.responseCode()) : 0;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    ASSERT_TRUE(_server->start());
+    EXPECT_EQ(request.get(), HttpStatusCode::STATUS_OK);
+
+    // the server doesn't close the socket
+    _server->stop();
+    close(fd);
+}
+
+TEST_F(HttpServerTest, ReusePort)
+{
+    // another process could serve the port too
+    HttpServer second(_serverSettings, _dispatcher);
+    EXPECT_TRUE(second.start());
+    second.stop();
+
+    IHttpServer::settings_t exclusiveSettings = _serverSettings;
+    exclusiveSettings.reusePort = false;
+    HttpServer exclusive(exclusiveSettings, _dispatcher);
+    EXPECT_FALSE(exclusive.start());
+}
+
+TEST_F(HttpServerTest, ExtraAddresses)
+{
+    const std::string socketPath = "/tmp/http-server-test.sock";
+    _server->stop();
+    _serverSettings.extraAddresses = {"::1", "unix:" + socketPath, "unix:@http-server-test"};
+    ASSERT_TRUE(_server->start());
+
+    CurlHelper ipv6("http://[::1]:8080" + endpointLarge);
+    ASSERT_TRUE(ipv6.doGet());
+    EXPECT_EQ(ipv6.responseCode(), HttpStatusCode::STATUS_OK);
+
+    for (const std::string &path : {socketPath, std::string("@http-server-test")})
+    {
+        const std::string response = requestOverUnixSocket(path, endpointLarge);
+        EXPECT_EQ(response.compare(8, 5, " 200 "), 0) << response.substr(0, 100);
+        EXPECT_NE(response.find(std::string(cLargeResponseSize, 'x')), std::string::npos);
+    }
+
+    // the socket file is removed
+    _server->stop();
+    EXPECT_NE(access(socketPath.c_str(), F_OK), 0);
+}
+
+TEST_F(HttpServerTest, DualStack)
+{
+    _server->stop();
+    _serverSettings.address = "::";
+    ASSERT_TRUE(_server->start());
+
+    for (const char *host : {"http://127.0.0.1:8080", "http://[::1]:8080"})
+    {
+        CurlHelper curl(std::string(host) + endpointLarge);
+        ASSERT_TRUE(curl.doGet());
+        EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    }
+
+    _server->stop();
+    _serverSettings.address = "[::1";
+    EXPECT_FALSE(_server->start());
+}
+
+TEST_F(HttpServerTest, IdleConnectionTimeout)
+{
+    _server->stop();
+    _serverSettings.connectionTimeout = 1;
+    ASSERT_TRUE(_server->start());
+
+    // a client which connects and sends nothing
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(8080);
+    inet_pton(AF_INET, firstIpAddr.c_str(), &address.sin_addr);
+    ASSERT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+
+    pollfd pfd{fd, POLLIN, 0};
+    ASSERT_EQ(poll(&pfd, 1, 5000), 1);
+    char byte;
+    EXPECT_EQ(read(fd, &byte, 1), 0);
+    close(fd);
+}
+
 TEST_F(HttpServerTest, StartOnSecondIpAddress)
 {
     _server->stop();
@@ -335,6 +877,269 @@ TEST_F(HttpServerTest, UploadContent)
     ASSERT_TRUE(_dispatcher.uploadedContent() == _uploadContent);
 }
 
+TEST_F(HttpServerTest, UploadSpooledContent)
+{
+    _server->stop();
+    _serverSettings.bodySpoolThreshold = 1024;
+    ASSERT_TRUE(_server->start());
+
+    std::string content = getRandomString(100000);
+    CurlHelper curl(_serverUrl + _endpointUpload);
+    ASSERT_TRUE(curl.doPost(content));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(_dispatcher.uploadedContent(), content);
+}
+
+TEST_F(HttpServerTest, UploadConsumedContent)
+{
+    std::string content = getRandomString(100000);
+    CurlHelper curl(_serverUrl + endpointConsumedUpload);
+    ASSERT_TRUE(curl.doPost(content));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseText(), "0");
+    EXPECT_EQ(_dispatcher.uploadedContent(), content);
+}
+
+TEST_F(HttpServerTest, UploadTooLarge)
+{
+    _server->stop();
+    _serverSettings.maxBodySize = 1000;
+    ASSERT_TRUE(_server->start());
+
+    CurlHelper accepted(_serverUrl + _endpointUpload);
+    ASSERT_TRUE(accepted.doPost(std::string(1000, 'x')));
+    EXPECT_EQ(accepted.responseCode(), HttpStatusCode::STATUS_OK);
+
+    CurlHelper rejected(_serverUrl + _endpointUpload);
+    ASSERT_TRUE(rejected.doPost(std::string(1001, 'x')));
+    EXPECT_EQ(rejected.responseCode(), HttpStatusCode::STATUS_PAYLOAD_TOO_LARGE);
+}
+
+TEST_F(HttpServerTest, UploadUrlEncodedForm)
+{
+    CurlHelper curl(_serverUrl + endpointForm);
+    curl.addRequestHeader("Content-Type", "application/x-www-form-urlencoded");
+    ASSERT_TRUE(curl.doPost("a=1&b=two+words"));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    const std::map<std::string, std::string> expected{{"a", "1"}, {"b", "two words"}};
+    EXPECT_EQ(_dispatcher.formFields(), expected);
+}
+
+TEST_F(HttpServerTest, UploadMultipartForm)
+{
+    const std::string file = getRandomString(10000);
+    const std::string body = "--XyZ\r\n"
+                             "Content-Disposition: form-data; name=\"title\"\r\n\r\n"
+                             "report\r\n"
+                             "--XyZ\r\n"
+                             "Content-Disposition: form-data; name=\"file\"; filename=\"data.txt\"\r\n"
+                             "Content-Type: text/plain\r\n\r\n" +
+                             file + "\r\n--XyZ--\r\n";
+
+    CurlHelper curl(_serverUrl + endpointForm);
+    curl.addRequestHeader("Content-Type", "multipart/form-data; boundary=XyZ");
+    ASSERT_TRUE(curl.doPost(body));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    const std::map<std::string, std::string> expected{{"title", "report"}, {"file", file}};
+    EXPECT_EQ(_dispatcher.formFields(), expected);
+    EXPECT_EQ(_dispatcher.formFileName(), "data.txt");
+
+    // the body is not a form
+    CurlHelper plain(_serverUrl + endpointForm);
+    plain.addRequestHeader("Content-Type", "text/plain");
+    ASSERT_TRUE(plain.doPost("text"));
+    EXPECT_EQ(plain.responseCode(), 415);
+}
+
+TEST_F(HttpServerTest, RefusedBeforeBody)
+{
+    CurlHelper curl(_serverUrl + endpointRefused);
+    ASSERT_TRUE(curl.doPost(std::string(10000, 'x')));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_FORBIDDEN);
+}
+
+TEST_F(HttpServerTest, RequestViews)
+{
+    CurlHelper curl(_serverUrl + endpointEcho);
+    curl.addRequestHeader("X-Echo", "header value");
+    ASSERT_TRUE(curl.doPost("body"));
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseText(), endpointEcho + "|header value|body");
+}
+
+TEST_F(HttpServerTest, LargeResponse)
+{
+    CurlHelper curl(_serverUrl + endpointLarge);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseText(), std::string(cLargeResponseSize, 'x'));
+}
+
+TEST_F(HttpServerTest, StreamedResponse)
+{
+    CurlHelper curl(_serverUrl + endpointStream);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseHeader("Transfer-Encoding"), "chunked");
+    std::string expected = "head|";
+    for (char c = 'a'; c < 'a' + 10; ++c)
+    {
+        expected += std::string(1000, c);
+    }
+    EXPECT_EQ(curl.responseText(), expected);
+}
+
+TEST_F(HttpServerTest, ServerSentEvents)
+{
+    CurlHelper curl(_serverUrl + endpointEvents);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseHeader("Content-Type"), "text/event-stream");
+    EXPECT_EQ(curl.responseText(), "event: tick\nid: 0\ndata: tick 0\n\n"
+                                   "event: tick\nid: 1\ndata: tick 1\n\n"
+                                   "event: tick\nid: 2\ndata: tick 2\n\n");
+}
+
+TEST_F(HttpServerTest, ThreadPool_IdleEventStream)
+{
+    _server->stop();
+    _serverSettings.threading = IHttpServer::ThreadingMode::THREAD_POOL;
+    _serverSettings.threadPoolSize = 1;
+    ASSERT_TRUE(_server->start());
+
+    // the stream waits for events without holding the only thread of the server
+    std::future<bool> events = std::async(std::launch::async, [this] {
+        CurlHelper curl(_serverUrl + endpointIdleEvents);
+        return curl.doGet() && curl.responseCode() == HttpStatusCode::STATUS_OK;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 5; ++i)
+    {
+        CurlHelper curl(_serverUrl + endpointClient);
+        EXPECT_TRUE(curl.doGet());
+        EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    }
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+
+    // the stopping server ends the stream
+    _server->stop();
+    EXPECT_TRUE(events.get());
+}
+
+TEST_F(HttpServerTest, CompressedResponse)
+{
+    _server->stop();
+    _serverSettings.compressionLevel = 6;
+    ASSERT_TRUE(_server->start());
+
+    CurlHelper deflated(_serverUrl + endpointLarge);
+    deflated.addRequestHeader("Accept-Encoding", "deflate");
+    ASSERT_TRUE(deflated.doGet());
+    EXPECT_EQ(deflated.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(deflated.responseHeader("Content-Encoding"), "deflate");
+    EXPECT_EQ(deflated.responseHeader("Vary"), "Accept-Encoding");
+    const std::string compressed = deflated.responseText();
+    EXPECT_LT(compressed.size(), cLargeResponseSize / 100);
+    std::string data(cLargeResponseSize, '\0');
+    uLongf length = static_cast<uLongf>(data.size());
+    ASSERT_EQ(uncompress(reinterpret_cast<Bytef *>(&data[0]), &length,
+                         reinterpret_cast<const Bytef *>(compressed.data()), static_cast<uLong>(compressed.size())),
+              Z_OK);
+    EXPECT_EQ(length, cLargeResponseSize);
+    EXPECT_EQ(data, std::string(cLargeResponseSize, 'x'));
+
+    CurlHelper gzipped(_serverUrl + endpointLarge);
+    gzipped.addRequestHeader("Accept-Encoding", "gzip, deflate");
+    ASSERT_TRUE(gzipped.doGet());
+    EXPECT_EQ(gzipped.responseHeader("Content-Encoding"), "gzip");
+    ASSERT_GT(gzipped.responseText().size(), 2U);
+    EXPECT_EQ(gzipped.responseText().substr(0, 2), "\x1f\x8b");
+
+    // Vary of the handler is kept
+    CurlHelper varying(_serverUrl + endpointLarge);
+    varying.addRequestHeader("Accept-Encoding", "gzip");
+    varying.addRequestHeader("X-Vary", "Origin");
+    ASSERT_TRUE(varying.doGet());
+    EXPECT_EQ(varying.responseHeader("Content-Encoding"), "gzip");
+    EXPECT_EQ(varying.responseHeader("Vary"), "Origin, Accept-Encoding");
+
+    CurlHelper listed(_serverUrl + endpointLarge);
+    listed.addRequestHeader("Accept-Encoding", "gzip");
+    listed.addRequestHeader("X-Vary", "Origin, accept-encoding");
+    ASSERT_TRUE(listed.doGet());
+    EXPECT_EQ(listed.responseHeader("Vary"), "Origin, accept-encoding");
+
+    CurlHelper plain(_serverUrl + endpointLarge);
+    ASSERT_TRUE(plain.doGet());
+    EXPECT_FALSE(plain.responseHasHeader("Content-Encoding"));
+    EXPECT_EQ(plain.responseText().size(), cLargeResponseSize);
+
+    // short responses are sent as is
+    CurlHelper small(_serverUrl + endpointClient);
+    small.addRequestHeader("Accept-Encoding", "gzip");
+    ASSERT_TRUE(small.doGet());
+    EXPECT_EQ(small.responseText(), firstIpAddr);
+}
+
+TEST_F(HttpServerTest, CompressedFile)
+{
+    _server->stop();
+    _serverSettings.compressionLevel = 6;
+    ASSERT_TRUE(_server->start());
+
+    std::string data = createTestFile(16384);
+
+    CurlHelper gzipped(_serverUrl + endpointDownloadFile);
+    gzipped.addRequestHeader("Accept-Encoding", "gzip");
+    ASSERT_TRUE(gzipped.doGet());
+    EXPECT_EQ(gzipped.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(gzipped.responseHeader("Content-Encoding"), "gzip");
+    EXPECT_LT(gzipped.responseText().size(), data.size());
+    const std::string etag = gzipped.responseHeader("ETag");
+    EXPECT_NE(etag.find("-gzip\""), std::string::npos);
+
+    // the compressed variant has own validator
+    CurlHelper notModified(_serverUrl + endpointDownloadFile);
+    notModified.addRequestHeader("Accept-Encoding", "gzip");
+    notModified.addRequestHeader("If-None-Match", etag);
+    ASSERT_TRUE(notModified.doGet());
+    EXPECT_EQ(notModified.responseCode(), 304);
+
+    // ranges are taken from the file itself
+    CurlHelper range(_serverUrl + endpointDownloadFile);
+    range.addRequestHeader("Accept-Encoding", "gzip");
+    range.addRequestHeader("Range", "bytes=0-9");
+    ASSERT_TRUE(range.doGet());
+    EXPECT_EQ(range.responseCode(), 206);
+    EXPECT_FALSE(range.responseHasHeader("Content-Encoding"));
+    EXPECT_EQ(range.responseText(), data.substr(0, 10));
+}
+
+TEST_F(HttpServerTest, PrecompressedFile)
+{
+    std::string data = createTestFile(100);
+    const std::string precompressedName = _testFileName + ".gz";
+    {
+        std::ofstream file(precompressedName);
+        file << "precompressed";
+    }
+
+    CurlHelper gzipped(_serverUrl + endpointDownloadFile);
+    gzipped.addRequestHeader("Accept-Encoding", "gzip");
+    ASSERT_TRUE(gzipped.doGet());
+    EXPECT_EQ(gzipped.responseHeader("Content-Encoding"), "gzip");
+    EXPECT_EQ(gzipped.responseHeader("Vary"), "Accept-Encoding");
+    EXPECT_EQ(gzipped.responseText(), "precompressed");
+
+    CurlHelper plain(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(plain.doGet());
+    EXPECT_FALSE(plain.responseHasHeader("Content-Encoding"));
+    EXPECT_EQ(plain.responseText(), data);
+
+    remove(precompressedName.c_str());
+}
+
 TEST_F(HttpServerTest, DownloadFile)
 {
     std::string data = createTestFile(16384);
@@ -425,9 +1230,27 @@ public:
     }
 
     bool doOptionsMethod()
+    {
+        return doMethod("OPTIONS");
+    }
+
+    bool doHeadMethod()
+    {
+        return doMethod("HEAD");
+    }
+
+    bool doMethod(const std::string &method)
     {
         curl_easy_setopt(_curl_handle, CURLOPT_URL, _url.c_str());
-        curl_easy_setopt(_curl_handle, CURLOPT_CUSTOMREQUEST, "OPTIONS");
+        if (method == "HEAD")
+        {
+            // a custom HEAD request would wait for the body
+            curl_easy_setopt(_curl_handle, CURLOPT_NOBODY, 1L);
+        }
+        else
+        {
+            curl_easy_setopt(_curl_handle, CURLOPT_CUSTOMREQUEST, method.c_str());
+        }
         curl_easy_setopt(_curl_handle, CURLOPT_NOSIGNAL, 1);
         if (_verbose)
         {
@@ -722,6 +1545,151 @@ TEST_F(HttpServerTest, DownloadFileWithRange8_FileNotAccessible)
     ASSERT_TRUE(curl.errorString().empty());
 }
 
+TEST_F(HttpServerTest, DownloadFileWithRange9_ok_Suffix)
+{
+    std::string data = createTestFile(100);
+
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    curl.addRequestHeader("Range", "bytes=-10");
+    ASSERT_TRUE(curl.doGet());
+
+    EXPECT_EQ(curl.responseCode(), 206);
+    EXPECT_EQ(curl.responseText(), data.substr(90));
+    EXPECT_EQ(curl.responseHeader("Content-Range"), "bytes 90-99/100");
+}
+
+TEST_F(HttpServerTest, DownloadFileWithRange10_ok_Multipart)
+{
+    std::string data = createTestFile(100);
+
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    curl.addRequestHeader("Range", "bytes=0-4,-5");
+    ASSERT_TRUE(curl.doGet());
+
+    EXPECT_EQ(curl.responseCode(), 206);
+    const std::string contentType = curl.responseHeader("Content-Type");
+    const std::string prefix = "multipart/byteranges; boundary=";
+    ASSERT_EQ(contentType.compare(0, prefix.size(), prefix), 0);
+    const std::string boundary = contentType.substr(prefix.size());
+
+    const std::string expected = "\r\n--" + boundary +
+                                 "\r\nContent-Type: application/octet-stream\r\nContent-Range: bytes 0-4/100\r\n\r\n" +
+                                 data.substr(0, 5) + "\r\n--" + boundary +
+                                 "\r\nContent-Type: application/octet-stream\r\nContent-Range: bytes 95-99/100\r\n\r\n" +
+                                 data.substr(95) + "\r\n--" + boundary + "--\r\n";
+    EXPECT_EQ(curl.responseText(), expected);
+}
+
+TEST_F(HttpServerTest, DownloadFile_Validators)
+{
+    std::string data = createTestFile(100);
+
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(curl.doGet());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(curl.responseText(), data);
+    const std::string etag = curl.responseHeader("ETag");
+    const std::string lastModified = curl.responseHeader("Last-Modified");
+    ASSERT_FALSE(etag.empty());
+    ASSERT_FALSE(lastModified.empty());
+
+    // the file is sent from memory the second time, the validators stay the same
+    CurlHelper again(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(again.doGet());
+    EXPECT_EQ(again.responseText(), data);
+    EXPECT_EQ(again.responseHeader("ETag"), etag);
+}
+
+TEST_F(HttpServerTest, DownloadFile_NotModified)
+{
+    createTestFile(100);
+
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(curl.doGet());
+    const std::string etag = curl.responseHeader("ETag");
+    const std::string lastModified = curl.responseHeader("Last-Modified");
+
+    CurlHelper byEtag(_serverUrl + endpointDownloadFile);
+    byEtag.addRequestHeader("If-None-Match", "\"other\", W/" + etag);
+    ASSERT_TRUE(byEtag.doGet());
+    EXPECT_EQ(byEtag.responseCode(), 304);
+    EXPECT_TRUE(byEtag.responseText().empty());
+    EXPECT_EQ(byEtag.responseHeader("ETag"), etag);
+
+    CurlHelper byDate(_serverUrl + endpointDownloadFile);
+    byDate.addRequestHeader("If-Modified-Since", lastModified);
+    ASSERT_TRUE(byDate.doGet());
+    EXPECT_EQ(byDate.responseCode(), 304);
+
+    // If-Modified-Since is not checked when the tag doesn't match
+    CurlHelper changed(_serverUrl + endpointDownloadFile);
+    changed.addRequestHeader("If-None-Match", "\"other\"");
+    changed.addRequestHeader("If-Modified-Since", lastModified);
+    ASSERT_TRUE(changed.doGet());
+    EXPECT_EQ(changed.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(changed.responseText().size(), 100U);
+}
+
+TEST_F(HttpServerTest, DownloadFile_IfRange)
+{
+    std::string data = createTestFile(100);
+
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(curl.doGet());
+    const std::string etag = curl.responseHeader("ETag");
+    const std::string lastModified = curl.responseHeader("Last-Modified");
+
+    for (const std::string &validator : {etag, lastModified})
+    {
+        CurlHelper range(_serverUrl + endpointDownloadFile);
+        range.addRequestHeader("Range", "bytes=0-9");
+        range.addRequestHeader("If-Range", validator);
+        ASSERT_TRUE(range.doGet());
+        EXPECT_EQ(range.responseCode(), 206);
+        EXPECT_EQ(range.responseText(), data.substr(0, 10));
+    }
+
+    // the whole file is sent when the part the client has is outdated, weak tags never match
+    for (const std::string &validator : {std::string("\"other\""), "W/" + etag, std::string("Thu, 01 Jan 1970 00:00:00 GMT")})
+    {
+        CurlHelper changed(_serverUrl + endpointDownloadFile);
+        changed.addRequestHeader("Range", "bytes=0-9");
+        changed.addRequestHeader("If-Range", validator);
+        ASSERT_TRUE(changed.doGet());
+        EXPECT_EQ(changed.responseCode(), HttpStatusCode::STATUS_OK);
+        EXPECT_EQ(changed.responseText(), data);
+    }
+}
+
+TEST_F(HttpServerTest, DownloadFile_ReplacedFile)
+{
+    // the files are too large to be kept in memory
+    createTestFile(cLargeResponseSize);
+    CurlHelper curl(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(curl.doGet());
+    const std::string etag = curl.responseHeader("ETag");
+
+    // the cache entry is not revalidated yet, the opened file is sent with its own size and tag
+    std::string data = createTestFile(cLargeResponseSize / 2);
+    CurlHelper replaced(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(replaced.doGet());
+    EXPECT_EQ(replaced.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_EQ(replaced.responseText(), data);
+    EXPECT_NE(replaced.responseHeader("ETag"), etag);
+}
+
+TEST_F(HttpServerTest, HeadHttpMethod)
+{
+    createTestFile(100);
+
+    CurlHelperExt curl(_serverUrl + endpointDownloadFile);
+    ASSERT_TRUE(curl.doHeadMethod());
+    EXPECT_EQ(curl.responseCode(), HttpStatusCode::STATUS_OK);
+    EXPECT_TRUE(curl.responseText().empty());
+    EXPECT_EQ(curl.responseHeader("Content-Length"), "100");
+    EXPECT_FALSE(curl.responseHeader("ETag").empty());
+}
+
 TEST_F(HttpServerTest, Session_UpdateExpirationTime)
 {
     std::string id1;
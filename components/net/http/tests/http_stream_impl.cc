@@ -0,0 +1,112 @@
+#include <gtest/gtest.h>
+
+#include "http_stream_impl.hh"
+
+#include <microhttpd.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+// reads the stream as libmicrohttpd does until its end
+std::string readAll(HttpStreamImpl &stream, std::size_t block)
+{
+    std::shared_ptr<HttpStreamImpl> holder(&stream, [](HttpStreamImpl *) {});
+    std::string body;
+    std::string buffer(block, '\0');
+    for (;;)
+    {
+        ssize_t length = HttpStreamImpl::read(&holder, body.size(), &buffer[0], buffer.size());
+        if (length == MHD_CONTENT_READER_END_OF_STREAM)
+        {
+            return body;
+        }
+        EXPECT_GE(length, 0);
+        if (length < 0)
+        {
+            return body;
+        }
+        body.append(buffer, 0, static_cast<std::size_t>(length));
+    }
+}
+} // namespace
+
+TEST(HttpStreamImpl, Producer)
+{
+    std::atomic<bool> stopping{false};
+    int part = 0;
+    HttpStreamImpl stream(
+        [&part](IHttpStream &out) {
+            out.write("part" + std::to_string(part));
+            return ++part < 3;
+        },
+        16, stopping);
+    stream.start("head|");
+
+    EXPECT_EQ(readAll(stream, 4), "head|part0part1part2");
+    EXPECT_FALSE(stream.isOpen());
+}
+
+TEST(HttpStreamImpl, WriterWaitsForReader)
+{
+    std::atomic<bool> stopping{false};
+    HttpStreamImpl stream(nullptr, 10, stopping);
+    stream.start(std::string());
+
+    std::atomic<int> written{0};
+    std::thread writer([&stream, &written] {
+        for (int i = 0; i < 100; ++i)
+        {
+            ASSERT_TRUE(stream.write("0123456789", 10));
+            ++written;
+        }
+        stream.close();
+    });
+    // the buffer takes one write at a time
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    EXPECT_LE(written, 2);
+
+    const std::string body = readAll(stream, 7);
+    writer.join();
+    EXPECT_EQ(body.size(), 1000U);
+    EXPECT_EQ(body.substr(990), "0123456789");
+}
+
+TEST(HttpStreamImpl, EndsOnAbortAndStop)
+{
+    std::atomic<bool> stopping{false};
+    auto holder = std::make_shared<HttpStreamImpl>(nullptr, 10, stopping);
+    holder->start(std::string());
+    EXPECT_TRUE(holder->write("data"));
+
+    // the client has gone
+    HttpStreamImpl::free(new std::shared_ptr<HttpStreamImpl>(holder));
+    EXPECT_FALSE(holder->isOpen());
+    EXPECT_FALSE(holder->write("more"));
+    char buffer[16];
+    EXPECT_EQ(HttpStreamImpl::read(&holder, 0, buffer, sizeof(buffer)), MHD_CONTENT_READER_END_WITH_ERROR);
+
+    HttpStreamImpl stream(nullptr, 10, stopping);
+    stream.start("queued");
+    stopping = true;
+    EXPECT_FALSE(stream.write("late"));
+    EXPECT_EQ(readAll(stream, 16), "queued");
+}
+
+TEST(HttpStreamImpl, ServerSentEvents)
+{
+    std::atomic<bool> stopping{false};
+    HttpStreamImpl stream(nullptr, 1024, stopping);
+    stream.start(std::string());
+
+    IHttpStream &events = stream;
+    EXPECT_TRUE(events.sendEvent("first"));
+    EXPECT_TRUE(events.sendEvent("two\nlines", "update", "7"));
+    stream.close();
+    EXPECT_EQ(readAll(stream, 1024), "data: first\n\nevent: update\nid: 7\ndata: two\ndata: lines\n\n");
+}
@@ -0,0 +1,67 @@
+#include <gtest/gtest.h>
+
+#include "load_shedder.hh"
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+const LoadShedder::Clock::time_point cStart{std::chrono::hours(1)};
+const std::chrono::milliseconds cTarget{10};
+const std::chrono::milliseconds cInterval{100};
+} // namespace
+
+TEST(LoadShedder, BurstIsNotShed)
+{
+    LoadShedder shedder(cTarget, cInterval);
+    // one quick request in the interval shows the queue drains
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(1), cStart));
+    for (int i = 1; i < 10; ++i)
+    {
+        EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(50), cStart + std::chrono::milliseconds(i)));
+    }
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(50), cStart + cInterval));
+    EXPECT_FALSE(shedder.stats(cStart + cInterval).overloaded);
+}
+
+TEST(LoadShedder, StandingQueueIsShed)
+{
+    LoadShedder shedder(cTarget, cInterval);
+    for (int i = 0; i < 10; ++i)
+    {
+        EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(15), cStart + std::chrono::milliseconds(i * 10)));
+    }
+
+    const LoadShedder::Clock::time_point next = cStart + cInterval;
+    // only the requests waiting more than twice the target are refused
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(15), next));
+    EXPECT_TRUE(shedder.shed(std::chrono::milliseconds(25), next));
+    EXPECT_TRUE(shedder.shed(std::chrono::milliseconds(30), next));
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(20), next));
+
+    LoadShedder::Stats stats = shedder.stats(next);
+    EXPECT_TRUE(stats.overloaded);
+    EXPECT_EQ(stats.shedRequests, 2U);
+
+    // the rate is of the last complete interval
+    stats = shedder.stats(next);
+    EXPECT_EQ(stats.shedRate, 0);
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(1), next + cInterval));
+    stats = shedder.stats(next + cInterval);
+    EXPECT_TRUE(stats.overloaded);
+    EXPECT_DOUBLE_EQ(stats.shedRate, 0.5);
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(1), next + 2 * cInterval));
+    EXPECT_FALSE(shedder.stats(next + 2 * cInterval).overloaded);
+}
+
+TEST(LoadShedder, IdleResets)
+{
+    LoadShedder shedder(cTarget, cInterval);
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(50), cStart));
+    EXPECT_TRUE(shedder.shed(std::chrono::milliseconds(50), cStart + cInterval));
+    EXPECT_TRUE(shedder.stats(cStart + cInterval).overloaded);
+
+    // nothing has arrived for a whole interval
+    EXPECT_FALSE(shedder.stats(cStart + 3 * cInterval).overloaded);
+    EXPECT_FALSE(shedder.shed(std::chrono::milliseconds(50), cStart + 3 * cInterval));
+}
@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include "rate_limiter.hh"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+const RateLimiter::Clock::time_point cStart{std::chrono::hours(1)};
+} // namespace
+
+TEST(RateLimiter, Burst)
+{
+    RateLimiter limiter(10, 3, 16);
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(limiter.admit(1, cStart).count(), 0);
+    }
+    EXPECT_EQ(limiter.admit(1, cStart), std::chrono::milliseconds(100));
+    // another key has its own bucket
+    EXPECT_EQ(limiter.admit(2, cStart).count(), 0);
+}
+
+TEST(RateLimiter, Refill)
+{
+    RateLimiter limiter(10, 1, 16);
+    EXPECT_EQ(limiter.admit(1, cStart).count(), 0);
+    EXPECT_EQ(limiter.admit(1, cStart + std::chrono::milliseconds(40)), std::chrono::milliseconds(60));
+    EXPECT_EQ(limiter.admit(1, cStart + std::chrono::milliseconds(100)).count(), 0);
+
+    // an idle key gets the whole burst back, but no more
+    RateLimiter burst(10, 2, 16);
+    EXPECT_EQ(burst.admit(1, cStart).count(), 0);
+    const RateLimiter::Clock::time_point later = cStart + std::chrono::seconds(10);
+    EXPECT_EQ(burst.admit(1, later).count(), 0);
+    EXPECT_EQ(burst.admit(1, later).count(), 0);
+    EXPECT_NE(burst.admit(1, later).count(), 0);
+}
+
+TEST(RateLimiter, Concurrent)
+{
+    RateLimiter limiter(1, 100, 16);
+    std::atomic<int> admitted{0};
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i)
+    {
+        threads.emplace_back([&limiter, &admitted] {
+            for (int j = 0; j < 1000; ++j)
+            {
+                if (limiter.admit(7, cStart).count() == 0)
+                {
+                    ++admitted;
+                }
+            }
+        });
+    }
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+    EXPECT_EQ(admitted, 100);
+}
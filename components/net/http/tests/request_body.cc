@@ -0,0 +1,78 @@
+#include <gtest/gtest.h>
+
+#include "request_body.hh"
+
+#include <dirent.h>
+
+#include <string>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+const std::string cSpoolDirectory{"/tmp"};
+
+std::size_t spoolFiles()
+{
+    std::size_t count = 0;
+    DIR *dir = opendir(cSpoolDirectory.c_str());
+    while (dirent *entry = readdir(dir))
+    {
+        if (std::string(entry->d_name).compare(0, 10, "http-body-") == 0)
+        {
+            ++count;
+        }
+    }
+    closedir(dir);
+    return count;
+}
+} // namespace
+
+TEST(RequestBody, InMemory)
+{
+    RequestBody body(100, cSpoolDirectory);
+    EXPECT_TRUE(body.append("abc", 3));
+    EXPECT_TRUE(body.append("def", 3));
+    EXPECT_TRUE(body.finish());
+    EXPECT_FALSE(body.spooled());
+    EXPECT_EQ(body.size(), 6U);
+    EXPECT_EQ(body.view().str(), "abcdef");
+}
+
+TEST(RequestBody, Spooled)
+{
+    const std::size_t filesBefore = spoolFiles();
+    std::string expected;
+    {
+        RequestBody body(1000, cSpoolDirectory);
+        for (int i = 0; i < 100; ++i)
+        {
+            const std::string chunk(100, static_cast<char>('a' + i % 26));
+            expected += chunk;
+            ASSERT_TRUE(body.append(chunk.data(), chunk.size()));
+        }
+        EXPECT_TRUE(body.spooled());
+        ASSERT_TRUE(body.finish());
+        EXPECT_EQ(body.size(), expected.size());
+        EXPECT_EQ(body.view().str(), expected);
+        // the file has no name
+        EXPECT_EQ(spoolFiles(), filesBefore);
+    }
+}
+
+TEST(RequestBody, SpoolingFails)
+{
+    RequestBody body(4, "/nonexistent/directory");
+    EXPECT_TRUE(body.append("abc", 3));
+    EXPECT_FALSE(body.append("def", 3));
+}
+
+TEST(RequestBody, NoThreshold)
+{
+    RequestBody body(0, cSpoolDirectory);
+    const std::string data(100000, 'x');
+    EXPECT_TRUE(body.append(data.data(), data.size()));
+    EXPECT_FALSE(body.spooled());
+    EXPECT_TRUE(body.finish());
+    EXPECT_EQ(body.view().size, data.size());
+}
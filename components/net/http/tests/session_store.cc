@@ -0,0 +1,174 @@
+#include <gtest/gtest.h>
+
+#include "session_store.hh"
+#include "timer_wheel.hh"
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+class TestSession : public HttpSession
+{
+public:
+    explicit TestSession(std::time_t expiration)
+    {
+        extendExpiration(expiration);
+    }
+
+    void onExpire() override
+    {
+    }
+};
+} // namespace
+
+TEST(TimerWheel, ReturnsKeysOnDeadline)
+{
+    TimerWheel wheel(1000);
+    wheel.schedule("a", 1001);
+    wheel.schedule("b", 1063);
+    wheel.schedule("c", 1064);
+    wheel.schedule("d", 1000 + 5000);
+    wheel.schedule("past", 900);
+    EXPECT_EQ(wheel.size(), 5U);
+
+    EXPECT_EQ(wheel.advance(1000), std::vector<std::string>{"past"});
+    EXPECT_EQ(wheel.advance(1001), std::vector<std::string>{"a"});
+    EXPECT_TRUE(wheel.advance(1062).empty());
+    EXPECT_EQ(wheel.advance(1063), std::vector<std::string>{"b"});
+    EXPECT_EQ(wheel.advance(1064), std::vector<std::string>{"c"});
+    EXPECT_TRUE(wheel.advance(5999).empty());
+    EXPECT_EQ(wheel.advance(6000), std::vector<std::string>{"d"});
+    EXPECT_EQ(wheel.size(), 0U);
+
+    // time going back changes nothing
+    EXPECT_TRUE(wheel.advance(10).empty());
+}
+
+TEST(TimerWheel, EveryTickOfLevels)
+{
+    const std::time_t start = 12345;
+    TimerWheel wheel(start);
+    // deadlines on the borders of the levels and the slots
+    std::vector<std::time_t> deadlines;
+    for (std::time_t delta : {1, 63, 64, 65, 127, 128, 4095, 4096, 4097, 70000})
+    {
+        deadlines.push_back(start + delta);
+        wheel.schedule(std::to_string(start + delta), start + delta);
+    }
+
+    std::size_t fired = 0;
+    for (std::time_t now = start; now <= start + 70000; ++now)
+    {
+        for (const std::string &key : wheel.advance(now))
+        {
+            EXPECT_EQ(std::stoll(key), now);
+            ++fired;
+        }
+    }
+    EXPECT_EQ(fired, deadlines.size());
+}
+
+TEST(TimerWheel, ClockJump)
+{
+    TimerWheel wheel(0);
+    wheel.schedule("soon", 10);
+    wheel.schedule("later", 1000000);
+    wheel.schedule("beyond the wheel", 100000000);
+
+    EXPECT_EQ(wheel.advance(500000), std::vector<std::string>{"soon"});
+    EXPECT_EQ(wheel.advance(1000000), std::vector<std::string>{"later"});
+    EXPECT_TRUE(wheel.advance(99999999).empty());
+    EXPECT_EQ(wheel.advance(100000000), std::vector<std::string>{"beyond the wheel"});
+}
+
+TEST(SessionStore, FindAndExpire)
+{
+    SessionStore store(100);
+    auto first = std::make_shared<TestSession>(110);
+    auto second = std::make_shared<TestSession>(120);
+    store.insert(first);
+    store.insert(second);
+    store.insert(first);
+    EXPECT_EQ(store.size(), 2U);
+    EXPECT_NE(first->id(), second->id());
+
+    EXPECT_EQ(store.find(first->id(), 105), first);
+    EXPECT_EQ(store.find("unknown", 105), nullptr);
+    // an expired session is not found even before it is removed
+    EXPECT_EQ(store.find(first->id(), 110), nullptr);
+
+    EXPECT_TRUE(store.expire(109).empty());
+    std::vector<HttpSession::SPtr> expired = store.expire(110);
+    ASSERT_EQ(expired.size(), 1U);
+    EXPECT_EQ(expired.front(), first);
+    EXPECT_EQ(store.size(), 1U);
+
+    // the session is used before its deadline
+    second->extendExpiration(200);
+    EXPECT_TRUE(store.expire(150).empty());
+    EXPECT_EQ(store.find(second->id(), 150), second);
+    EXPECT_EQ(store.expire(200).size(), 1U);
+    EXPECT_EQ(store.size(), 0U);
+}
+
+TEST(SessionStore, ConcurrentAccess)
+{
+    SessionStore store(0);
+    constexpr int cThreads = 4;
+    constexpr int cSessions = 1000;
+    std::atomic<int> found{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < cThreads; ++t)
+    {
+        threads.emplace_back([&store, &found] {
+            for (int i = 0; i < cSessions; ++i)
+            {
+                auto session = std::make_shared<TestSession>(1 + i % 10);
+                store.insert(session);
+                if (store.find(session->id(), 0) == session)
+                {
+                    ++found;
+                }
+            }
+        });
+    }
+    // nothing is due yet, the wheel is only contended
+    std::thread expiring([&store] {
+        for (int i = 0; i < 100; ++i)
+        {
+            EXPECT_TRUE(store.expire(0).empty());
+        }
+    });
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    expiring.join();
+
+    EXPECT_EQ(found, cThreads * cSessions);
+    EXPECT_EQ(store.size(), static_cast<std::size_t>(cThreads * cSessions));
+    std::size_t expired = 0;
+    for (std::time_t now = 1; now <= 10; ++now)
+    {
+        expired += store.expire(now).size();
+    }
+    EXPECT_EQ(expired, static_cast<std::size_t>(cThreads * cSessions));
+}
+
+TEST(HttpSession, UniqueIds)
+{
+    std::set<std::string> ids;
+    for (int i = 0; i < 10000; ++i)
+    {
+        TestSession session(0);
+        ASSERT_EQ(session.id().size(), 36U);
+        EXPECT_EQ(session.id()[14], '4');
+        EXPECT_TRUE(ids.insert(session.id()).second);
+    }
+}
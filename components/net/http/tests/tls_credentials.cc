@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+
+#include "tls_credentials.hh"
+
+#include <gnutls/x509.h>
+
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+using namespace softeq::common::net::http;
+
+namespace
+{
+const std::string cCertFile{"/tmp/http-test-cert.pem"};
+const std::string cKeyFile{"/tmp/http-test-key.pem"};
+
+std::string exportPem(int result, gnutls_datum_t &data)
+{
+    EXPECT_EQ(result, GNUTLS_E_SUCCESS);
+    std::string pem(reinterpret_cast<const char *>(data.data), data.size);
+    gnutls_free(data.data);
+    return pem;
+}
+
+// writes a self-signed certificate and its key
+void writeCredentials(const std::string &commonName)
+{
+    gnutls_x509_privkey_t key;
+    gnutls_x509_crt_t crt;
+    ASSERT_EQ(gnutls_x509_privkey_init(&key), GNUTLS_E_SUCCESS);
+    ASSERT_EQ(gnutls_x509_privkey_generate(key, GNUTLS_PK_ECDSA, GNUTLS_CURVE_TO_BITS(GNUTLS_ECC_CURVE_SECP256R1), 0),
+              GNUTLS_E_SUCCESS);
+    ASSERT_EQ(gnutls_x509_crt_init(&crt), GNUTLS_E_SUCCESS);
+    gnutls_x509_crt_set_version(crt, 3);
+    const unsigned char serial = 1;
+    gnutls_x509_crt_set_serial(crt, &serial, sizeof(serial));
+    gnutls_x509_crt_set_activation_time(crt, std::time(nullptr) - 60);
+    gnutls_x509_crt_set_expiration_time(crt, std::time(nullptr) + 3600);
+    gnutls_x509_crt_set_dn_by_oid(crt, GNUTLS_OID_X520_COMMON_NAME, 0, commonName.data(),
+                                  static_cast<unsigned>(commonName.size()));
+    gnutls_x509_crt_set_key(crt, key);
+    ASSERT_EQ(gnutls_x509_crt_sign2(crt, crt, key, GNUTLS_DIG_SHA256, 0), GNUTLS_E_SUCCESS);
+
+    gnutls_datum_t data;
+    std::ofstream(cCertFile) << exportPem(gnutls_x509_crt_export2(crt, GNUTLS_X509_FMT_PEM, &data), data);
+    std::ofstream(cKeyFile) << exportPem(gnutls_x509_privkey_export2(key, GNUTLS_X509_FMT_PEM, &data), data);
+    gnutls_x509_crt_deinit(crt);
+    gnutls_x509_privkey_deinit(key);
+}
+
+// common name of the certificate given to a handshake
+std::string handshakeCommonName(gnutls_session_t session)
+{
+    gnutls_pcert_st *pcert = nullptr;
+    unsigned int count = 0;
+    gnutls_privkey_t key = nullptr;
+    if (TlsCredentials::retrieve(session, nullptr, 0, nullptr, 0, &pcert, &count, &key) != 0 || count != 1 ||
+        !key)
+    {
+        return std::string();
+    }
+    gnutls_x509_crt_t crt;
+    gnutls_x509_crt_init(&crt);
+    gnutls_x509_crt_import(crt, &pcert->cert, GNUTLS_X509_FMT_DER);
+    char name[256];
+    size_t size = sizeof(name);
+    gnutls_x509_crt_get_dn_by_oid(crt, GNUTLS_OID_X520_COMMON_NAME, 0, 0, name, &size);
+    gnutls_x509_crt_deinit(crt);
+    return std::string(name, size);
+}
+
+class TlsCredentialsTest : public testing::Test
+{
+protected:
+    void SetUp() override
+    {
+        ASSERT_EQ(gnutls_init(&_session, GNUTLS_SERVER), GNUTLS_E_SUCCESS);
+    }
+
+    void TearDown() override
+    {
+        gnutls_deinit(_session);
+        std::remove(cCertFile.c_str());
+        std::remove(cKeyFile.c_str());
+    }
+
+    gnutls_session_t _session;
+};
+} // namespace
+
+TEST_F(TlsCredentialsTest, Load)
+{
+    TlsCredentials credentials;
+    EXPECT_FALSE(credentials.load(cCertFile, cKeyFile));
+
+    writeCredentials("first");
+    ASSERT_TRUE(credentials.load(cCertFile, cKeyFile));
+    EXPECT_FALSE(credentials.changed());
+
+    // a session without the credentials gets no certificate
+    gnutls_pcert_st *pcert = nullptr;
+    unsigned int count = 0;
+    gnutls_privkey_t key = nullptr;
+    EXPECT_NE(TlsCredentials::retrieve(_session, nullptr, 0, nullptr, 0, &pcert, &count, &key), 0);
+
+    credentials.attach(_session, true);
+    EXPECT_EQ(handshakeCommonName(_session), "first");
+}
+
+TEST_F(TlsCredentialsTest, Reload)
+{
+    TlsCredentials credentials;
+    writeCredentials("first");
+    ASSERT_TRUE(credentials.load(cCertFile, cKeyFile));
+    credentials.attach(_session, false);
+
+    writeCredentials("second certificate");
+    EXPECT_TRUE(credentials.changed());
+    ASSERT_TRUE(credentials.load(cCertFile, cKeyFile));
+    EXPECT_FALSE(credentials.changed());
+    EXPECT_EQ(handshakeCommonName(_session), "second certificate");
+
+    // broken files don't replace the working credentials
+    std::ofstream(cCertFile) << "broken";
+    EXPECT_TRUE(credentials.changed());
+    EXPECT_FALSE(credentials.load(cCertFile, cKeyFile));
+    EXPECT_EQ(handshakeCommonName(_session), "second certificate");
+}
+
+TEST_F(TlsCredentialsTest, KeyMismatch)
+{
+    TlsCredentials credentials;
+    writeCredentials("first");
+    ASSERT_TRUE(credentials.load(cCertFile, cKeyFile));
+    credentials.attach(_session, false);
+    std::ifstream firstKeyFile(cKeyFile);
+    const std::string firstKey((std::istreambuf_iterator<char>(firstKeyFile)), std::istreambuf_iterator<char>());
+
+    // a new certificate with the old key is refused, the working credentials are kept
+    writeCredentials("second");
+    std::ofstream(cKeyFile) << firstKey;
+    EXPECT_FALSE(credentials.load(cCertFile, cKeyFile));
+    EXPECT_EQ(handshakeCommonName(_session), "first");
+}
@@ -0,0 +1,143 @@
+#include <gtest/gtest.h>
+
+#include "utils.hh"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace
+{
+std::vector<ByteRange> ranges(const std::string &header, uint64_t size)
+{
+    std::vector<ByteRange> result;
+    EXPECT_TRUE(parseRanges(header, size, result)) << header;
+    return result;
+}
+
+void expectRange(const ByteRange &range, uint64_t first, uint64_t last)
+{
+    EXPECT_EQ(range.first, first);
+    EXPECT_EQ(range.last, last);
+}
+} // namespace
+
+TEST(HttpUtils, ParseRanges)
+{
+    std::vector<ByteRange> result = ranges("bytes=0-1023", 16384);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 0, 1023);
+    EXPECT_EQ(result[0].length(), 1024U);
+
+    // open and clipped ranges
+    result = ranges("bytes=10-", 100);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 10, 99);
+    result = ranges("bytes=90-200", 100);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 90, 99);
+
+    // suffixes
+    result = ranges("bytes=-10", 100);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 90, 99);
+    result = ranges("bytes=-1000", 100);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 0, 99);
+
+    // offsets beyond 4 GiB
+    const uint64_t large = 6ULL * 1024 * 1024 * 1024;
+    result = ranges("bytes=5368709120-, 0-0", large);
+    ASSERT_EQ(result.size(), 2U);
+    expectRange(result[0], 5ULL * 1024 * 1024 * 1024, large - 1);
+    expectRange(result[1], 0, 0);
+
+    // unsatisfiable ranges are dropped
+    result = ranges("bytes=200-300,1-2", 100);
+    ASSERT_EQ(result.size(), 1U);
+    expectRange(result[0], 1, 2);
+}
+
+TEST(HttpUtils, ParseRangesFailures)
+{
+    std::vector<ByteRange> result;
+    EXPECT_FALSE(parseRanges("0-1", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=a-b", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=5-1", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=100-200", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=-0", 100, result));
+    EXPECT_FALSE(parseRanges("bytes=0-0", 0, result));
+    EXPECT_FALSE(parseRanges("bytes=-5-6", 100, result));
+    EXPECT_TRUE(result.empty());
+
+    std::string many = "bytes=0-0";
+    for (int i = 1; i < 20; ++i)
+    {
+        many += "," + std::to_string(i) + "-" + std::to_string(i);
+    }
+    EXPECT_FALSE(parseRanges(many, 100, result));
+}
+
+TEST(HttpUtils, ByteRangesReader)
+{
+    const std::string data = "0123456789abcdefghij";
+    char path[] = "/tmp/byteranges_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(write(fd, data.data(), data.size()), static_cast<ssize_t>(data.size()));
+    unlink(path);
+
+    ByteRangesReader *reader = new ByteRangesReader(fd, data.size(), {{0, 1}, {15, 19}}, "text/plain");
+    const std::string boundary = reader->boundary();
+    const std::string expected = "\r\n--" + boundary +
+                                 "\r\nContent-Type: text/plain\r\nContent-Range: bytes 0-1/20\r\n\r\n01"
+                                 "\r\n--" +
+                                 boundary +
+                                 "\r\nContent-Type: text/plain\r\nContent-Range: bytes 15-19/20\r\n\r\nfghij"
+                                 "\r\n--" +
+                                 boundary + "--\r\n";
+    ASSERT_EQ(reader->size(), expected.size());
+
+    // small blocks cross the borders of the parts
+    std::string body;
+    char block[7];
+    ssize_t received;
+    while ((received = ByteRangesReader::read(reader, body.size(), block, sizeof(block))) > 0)
+    {
+        body.append(block, static_cast<std::size_t>(received));
+    }
+    EXPECT_EQ(received, MHD_CONTENT_READER_END_OF_STREAM);
+    EXPECT_EQ(body, expected);
+
+    // a repeated read
+    ASSERT_EQ(ByteRangesReader::read(reader, 0, block, 2), 2);
+    EXPECT_EQ(std::string(block, 2), "\r\n");
+    ByteRangesReader::free(reader);
+}
+
+TEST(HttpUtils, ActivatedSocket)
+{
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+    EXPECT_EQ(activatedSocket(), -1);
+
+    // the sockets are passed to another process
+    setenv("LISTEN_PID", std::to_string(getpid() + 1).c_str(), 1);
+    setenv("LISTEN_FDS", "1", 1);
+    EXPECT_EQ(activatedSocket(), -1);
+
+    setenv("LISTEN_PID", std::to_string(getpid()).c_str(), 1);
+    setenv("LISTEN_FDS", "0", 1);
+    EXPECT_EQ(activatedSocket(), -1);
+
+    setenv("LISTEN_FDS", "2", 1);
+    EXPECT_EQ(activatedSocket(), 3);
+
+    unsetenv("LISTEN_PID");
+    unsetenv("LISTEN_FDS");
+}
@@ -0,0 +1,35 @@
+#include <gtest/gtest.h>
+
+#include <common/stdutils/gcra.hh>
+
+using namespace softeq::common::stdutils;
+
+namespace
+{
+const int64_t cStart = 1000000;
+const int64_t cInterval = 100;
+} // namespace
+
+TEST(Gcra, Burst)
+{
+    Gcra bucket;
+    const int64_t tolerance = Gcra::tolerance(cInterval, 3);
+    for (int i = 0; i < 3; ++i)
+    {
+        EXPECT_EQ(bucket.take(cStart, cInterval, tolerance), 0);
+    }
+    EXPECT_EQ(bucket.take(cStart, cInterval, tolerance), cInterval);
+    EXPECT_EQ(bucket.take(cStart + 40, cInterval, tolerance), cInterval - 40);
+    EXPECT_EQ(bucket.take(cStart + cInterval, cInterval, tolerance), 0);
+}
+
+TEST(Gcra, Refill)
+{
+    Gcra bucket;
+    EXPECT_EQ(Gcra::tolerance(cInterval, 0), 0);
+    EXPECT_EQ(bucket.take(cStart, cInterval, 0), 0);
+    EXPECT_EQ(bucket.take(cStart, cInterval, 0), cInterval);
+    // an idle bucket refills up to its burst only
+    EXPECT_EQ(bucket.take(cStart + 100 * cInterval, cInterval, 0), 0);
+    EXPECT_EQ(bucket.take(cStart + 100 * cInterval, cInterval, 0), cInterval);
+}
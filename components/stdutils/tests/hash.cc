@@ -0,0 +1,24 @@
+#include <gtest/gtest.h>
+
+#include <common/stdutils/hash.hh>
+
+using namespace softeq::common::stdutils;
+
+TEST(Hash, Fnv1a)
+{
+    // reference values of the 64-bit FNV-1a
+    EXPECT_EQ(fnv1a("", 0), 0xcbf29ce484222325ULL);
+    EXPECT_EQ(fnv1a("a", 1), 0xaf63dc4c8601ec8cULL);
+    EXPECT_NE(fnv1a("abc", 3), fnv1a("abd", 3));
+    EXPECT_NE(fnv1a("/b", 2, fnv1a("a", 1)), fnv1a("/b", 2));
+    EXPECT_EQ(fnv1a("/b", 2, fnv1a("a", 1)), fnv1a("a/b", 3));
+}
+
+TEST(Hash, Fnv1aString)
+{
+    std::size_t length = 1;
+    EXPECT_EQ(fnv1a("abc", length), fnv1a("abc", 3));
+    EXPECT_EQ(length, 3u);
+    EXPECT_EQ(fnv1a(static_cast<const char *>(nullptr), length), fnv1a("", 0));
+    EXPECT_EQ(length, 0u);
+}
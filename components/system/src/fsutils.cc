@@ -3,6 +3,7 @@
 #include <common/logging/log.hh>
 #include <common/stdutils/scope_guard.hh>
 
+#include <array>
 #include <fstream>
 #include <stack>
 #include <climits>
@@ -118,6 +118,36 @@ int createPidFile(const char *procname, const char *pidfile)
     return fd;
 }
 
+/*
+  SC_LOG_FILTER_FILE names a file which contains a log filter of SC_LOG_FILTER format,
+  it is applied when the service starts and every time it is reconfigured by SIGHUP
+*/
+void reloadLogFilter()
+{
+    const char *path = getenv("SC_LOG_FILTER_FILE");
+    if (path == nullptr)
+    {
+        return;
+    }
+
+    std::ifstream file(path);
+    std::string filter;
+    if (!std::getline(file, filter))
+    {
+        LOGE(LOG_DOMAIN, "Could not read log filter from '%s'", path);
+        return;
+    }
+    try
+    {
+        softeq::common::logging::log().filter(filter);
+        LOGI(LOG_DOMAIN, "Log filter is set to '%s'", filter.c_str());
+    }
+    catch (const std::exception &ex)
+    {
+        LOGE(LOG_DOMAIN, "Invalid log filter '%s' in '%s': %s", filter.c_str(), path, ex.what());
+    }
+}
+
 [[noreturn]] void terminateHandler()
 {
     std::exception_ptr exptr{std::current_exception()};
@@ -140,6 +170,8 @@ int createPidFile(const char *procname, const char *pidfile)
     {
         LOGF(LOG_DOMAIN, "Terminated due to unknown reason");
     }
+    /* recent messages of all levels, including filtered ones, explain what led to it */
+    softeq::common::logging::log().dumpRecorderOnce(STDERR_FILENO);
 
 #ifdef NDEBUG
     exit(EXIT_FAILURE);
@@ -227,6 +259,7 @@ int SystemService::run(std::unique_ptr<ServiceDispatcher> service)
     _active = true;
     bool result;
 
+    reloadLogFilter();
     LOGI(LOG_DOMAIN, "Initialization of the service");
     try
     {
@@ -363,6 +396,7 @@ void SystemService::handleSignal(int signum)
 
     case SIGHUP:
         _running = false;
+        reloadLogFilter();
         bool result;
         try
         {
@@ -386,6 +420,7 @@ void SystemService::handleSignal(int signum)
         break;
 
     case SIGSEGV:
+        softeq::common::logging::log().dumpRecorderOnce(STDERR_FILENO);
         finalActions();
         LOGE(LOG_DOMAIN, "Segmentation fault detected: %d - %s", signum, strsignal(signum));
         exit(signum);
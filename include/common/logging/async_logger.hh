@@ -0,0 +1,132 @@
+#ifndef SOFTEQ_COMMON_ASYNC_LOGGER_H_
+#define SOFTEQ_COMMON_ASYNC_LOGGER_H_
+
+#include <common/logging/logger_interface.hh>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+/*!
+  \brief Asynchronous logger.
+
+  Decorates another LoggerInterface implementation. Producers put pre-formatted records into a bounded
+  lock-free ring buffer and return immediately, a single background thread drains the buffer to the
+  wrapped logger in batches. The wrapped logger flushes by its own policy, it is flushed explicitly on
+  FATAL messages, flush() and shutdown only. Records have fixed size: domains longer than 63 characters and messages longer
+  than 1023 characters are cut and end with "...".
+*/
+class AsyncLogger final : public LoggerInterface
+{
+public:
+    /*!
+      Behaviour of the producer when the ring buffer is full
+    */
+    enum class OverflowPolicy
+    {
+        BLOCK,       /**< wait until the background thread frees a slot */
+        DROP_NEWEST, /**< discard the message being logged */
+        DROP_OLDEST, /**< discard the oldest queued message to make room for the new one */
+    };
+
+    struct settings_t
+    {
+        /*!
+          Number of records in the ring buffer, rounded up to the power of two
+        */
+        std::size_t capacity{1024};
+        /*!
+          Behaviour when the ring buffer is full
+        */
+        OverflowPolicy policy{OverflowPolicy::BLOCK};
+        /*!
+          Maximal number of records passed to the wrapped logger before blocked producers are released
+        */
+        std::size_t batchSize{64};
+    };
+
+    /*!
+      Constructs the logger with default settings and starts the background thread
+      \param[in] sink Logger the messages are delivered to
+    */
+    explicit AsyncLogger(LoggerInterface::UPtr &&sink);
+    /*!
+      Constructs the logger and starts the background thread
+      \param[in] sink Logger the messages are delivered to
+      \param[in] settings Queue settings
+    */
+    AsyncLogger(LoggerInterface::UPtr &&sink, const settings_t &settings);
+    /*!
+      Delivers all the queued messages and stops the background thread
+    */
+    ~AsyncLogger() override;
+
+    /*!
+        Puts the message into the ring buffer
+        \param[in] level Log level
+        \param[in] context Log context
+        \param[in] msg Char pointer to message
+      */
+    void log(LogLevel level, const LogContext &context, const char *msg) override;
+    /*!
+        Blocks until all the messages queued before the call are delivered to the wrapped logger and it is flushed
+      */
+    void flush() override;
+
+    /*!
+      Returns number of messages discarded due to the ring buffer overflow
+      \return dropped messages count
+    */
+    std::size_t dropped() const noexcept;
+
+    /*!
+      Converts a name from SC_LOG_ASYNC variable into overflow policy
+      \param[in] str "block", "drop_newest" or "drop_oldest"
+      \return Policy value, throws std::logic_error for unknown names
+    */
+    static OverflowPolicy overflowPolicyFromString(const std::string &str);
+
+private:
+    class RingBuffer;
+
+    void worker();
+    std::size_t drain();
+    void flushRequested();
+    void reportDropped();
+
+    LoggerInterface::UPtr _sink;
+    const settings_t _settings;
+    std::unique_ptr<RingBuffer> _queue;
+
+    std::atomic<std::size_t> _dropped{0};
+    std::atomic<std::size_t> _droppedTotal{0};
+    std::atomic<std::size_t> _written{0};
+    std::atomic<bool> _consumerIdle{false};
+    std::atomic<unsigned> _waiters{0};
+    std::atomic<bool> _stop{false};
+
+    std::mutex _mutex;
+    // guarded by the mutex
+    uint64_t _flushRequested{0};
+    uint64_t _flushed{0};
+    std::size_t _flushTarget{0};
+    std::condition_variable _dataAvailable;
+    std::condition_variable _progress;
+    std::thread _worker;
+};
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_ASYNC_LOGGER_H_
@@ -0,0 +1,382 @@
+#ifndef SOFTEQ_COMMON_DEFERRED_LOG_H_
+#define SOFTEQ_COMMON_DEFERRED_LOG_H_
+
+#include <common/logging/log.hh>
+#include <common/logging/log_formatter.hh>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+/*!
+  \brief Static description of a deferred log call site.
+
+  It is registered on the first call, after that every message refers to it by id
+  instead of carrying the format string.
+*/
+struct LogDescriptor final
+{
+    constexpr LogDescriptor(LogLevel level, const char *file, int line)
+        : level(level)
+        , file(file)
+        , line(line)
+    {
+    }
+
+    const LogLevel level;
+    const char *const file;
+    const int line;
+    // assigned once under the registry lock, published by the id
+    const char *format{nullptr};
+    const char *domain{nullptr};
+    std::atomic<uint32_t> id{0};
+};
+
+namespace deferred
+{
+/*!
+  Type tags of the arguments stored in a binary record
+*/
+enum class ArgumentType : uint8_t
+{
+    SIGNED,
+    UNSIGNED,
+    DOUBLE,
+    STRING,
+    POINTER,
+};
+
+// strings are truncated to keep records small comparing to thread buffers
+constexpr uint32_t cMaxStringLength = 1024;
+// length of the string argument which was a null pointer
+constexpr uint32_t cNullString = UINT32_MAX;
+
+inline uint32_t stringLength(const char *value)
+{
+    return value ? static_cast<uint32_t>(strnlen(value, cMaxStringLength)) : cNullString;
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value || std::is_floating_point<T>::value,
+                        std::size_t>::type
+argumentSize(const T &)
+{
+    return 1 + sizeof(uint64_t);
+}
+
+template <typename T>
+std::size_t argumentSize(const T *)
+{
+    return 1 + sizeof(uint64_t);
+}
+
+inline std::size_t argumentSize(const char *value)
+{
+    return 1 + sizeof(uint32_t) + (value ? stringLength(value) : 0);
+}
+
+inline void putTag(char *&buffer, ArgumentType type)
+{
+    *buffer++ = static_cast<char>(type);
+}
+
+template <typename V>
+void putValue(char *&buffer, ArgumentType type, V value)
+{
+    static_assert(sizeof(V) == sizeof(uint64_t), "arguments are stored as 64 bit values");
+    putTag(buffer, type);
+    std::memcpy(buffer, &value, sizeof(value));
+    buffer += sizeof(value);
+}
+
+template <typename T>
+typename std::enable_if<(std::is_integral<T>::value && std::is_signed<T>::value) || std::is_enum<T>::value>::type
+putArgument(char *&buffer, const T &value)
+{
+    putValue(buffer, ArgumentType::SIGNED, static_cast<int64_t>(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_signed<T>::value>::type putArgument(char *&buffer,
+                                                                                                  const T &value)
+{
+    putValue(buffer, ArgumentType::UNSIGNED, static_cast<uint64_t>(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_floating_point<T>::value>::type putArgument(char *&buffer, const T &value)
+{
+    putValue(buffer, ArgumentType::DOUBLE, static_cast<double>(value));
+}
+
+template <typename T>
+void putArgument(char *&buffer, const T *value)
+{
+    putValue(buffer, ArgumentType::POINTER, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(value)));
+}
+
+inline void putArgument(char *&buffer, const char *value)
+{
+    putTag(buffer, ArgumentType::STRING);
+    uint32_t length = stringLength(value);
+    std::memcpy(buffer, &length, sizeof(length));
+    buffer += sizeof(length);
+    if (value && length)
+    {
+        std::memcpy(buffer, value, length);
+        buffer += length;
+    }
+}
+
+inline std::size_t argumentsSize()
+{
+    return 0;
+}
+
+template <typename T, typename... Args>
+std::size_t argumentsSize(const T &first, const Args &... rest)
+{
+    return argumentSize(first) + argumentsSize(rest...);
+}
+
+inline void putArguments(char *&)
+{
+}
+
+template <typename T, typename... Args>
+void putArguments(char *&buffer, const T &first, const Args &... rest)
+{
+    putArgument(buffer, first);
+    putArguments(buffer, rest...);
+}
+
+/*!
+  Produces the text from the format string and the encoded arguments
+  \param[in] format C string with printf-like format
+  \param[in] args Encoded arguments
+  \param[in] length Size of encoded arguments
+  \return Formatted message
+*/
+std::string format(const char *format, const char *args, std::size_t length);
+
+} // namespace deferred
+
+/*!
+  \brief Deferred binary logger.
+
+  The hot path never formats the message. A call site registers its LogDescriptor once, after that
+  each message pushes the descriptor id, a timestamp and the raw argument bytes into a buffer owned
+  by the calling thread. A background thread either formats the records and passes them to the
+  installed LoggerInterface, or stores them into a binary file which is turned into text later by
+  the decoder tool (see DeferredLogReader).
+*/
+class DeferredLog final
+{
+public:
+    DeferredLog(const DeferredLog &) = delete;
+    DeferredLog &operator=(const DeferredLog &) = delete;
+    ~DeferredLog();
+
+    static DeferredLog &get();
+
+    /*!
+        Stores the message, formatting is done by the background thread
+        \param[in] descriptor Call site descriptor
+        \param[in] domain String prefix
+        \param[in] format C string that contains a format string that follows the same specifications
+         as format in printf (see  http://www.cplusplus.com/reference/cstdio/printf/ for details)
+        \param[in] args Arguments, only arithmetic types, enums, C strings and pointers are supported
+      */
+    template <typename... Args>
+    void write(LogDescriptor &descriptor, const char *domain, const char *format, const Args &... args)
+    {
+        if (!accept(descriptor, domain, format))
+        {
+            // the call site is used with different format strings, it can't be described statically
+            log().Message(descriptor.level, domain, format, args...);
+            return;
+        }
+
+        char *buffer = begin(descriptor, domain, deferred::argumentsSize(args...));
+        if (buffer)
+        {
+            deferred::putArguments(buffer, args...);
+            commit();
+        }
+        if (descriptor.level == LogLevel::FATAL)
+        {
+            flush();
+        }
+    }
+
+    /*!
+        Starts writing records into the binary file instead of formatting them
+        \param[in] path Path to the file
+        \return true if the file was opened
+      */
+    bool open(const std::string &path);
+    /*!
+        Stops writing into the binary file, records are formatted and passed to the Log again
+      */
+    void close();
+    /*!
+        Blocks until the records stored before the call are processed
+      */
+    void flush();
+
+private:
+    class ThreadBuffer;
+    struct ThreadLocal;
+
+    DeferredLog();
+
+    bool accept(LogDescriptor &descriptor, const char *domain, const char *format);
+    char *begin(const LogDescriptor &descriptor, const char *domain, std::size_t argsSize);
+    void commit();
+
+    ThreadBuffer *threadBuffer();
+    void worker();
+    bool consume(ThreadBuffer &buffer);
+    void writeRecord(ThreadBuffer &buffer, const char *record);
+
+    std::mutex _registryMutex;
+    std::vector<LogDescriptor *> _descriptors;
+    // buffers are shared with their threads, a thread marks its buffer retired on exit
+    std::vector<std::shared_ptr<ThreadBuffer>> _buffers;
+    uint32_t _buffersCreated{0};
+    static thread_local ThreadLocal _threadLocal;
+
+    std::mutex _fileMutex;
+    FILE *_file{nullptr};
+    std::vector<bool> _descriptorsWritten;
+    std::vector<bool> _threadsWritten;
+
+    std::mutex _mutex;
+    // a buffer has been filled past the wakeup threshold, guarded by _mutex
+    bool _pending{false};
+    std::condition_variable _wakeup;
+    std::condition_variable _progress;
+    std::atomic<bool> _stop{false};
+    std::thread _worker;
+};
+
+/*!
+  \brief Reader of binary files produced by DeferredLog
+*/
+class DeferredLogReader final
+{
+public:
+    /*!
+       Callback which receives decoded messages
+    */
+    using Handler = std::function<void(LogLevel level, const std::string &domain, const std::string &threadId,
+                                       std::time_t time, const std::string &message)>;
+
+    explicit DeferredLogReader(std::istream &stream);
+
+    /*!
+        Decodes all the records of the stream
+        \param[in] handler Callback called for every message
+        \return false if the stream is not a binary log or it is truncated
+      */
+    bool read(const Handler &handler);
+
+    /*!
+        Decodes all the records into text lines which are the same as ConsoleLogger prints
+        \param[in] output Stream for the text
+        \param[in] resolution Precision of the timestamps, see SC_LOG_TIME_RESOLUTION
+        \return false if the stream is not a binary log or it is truncated
+      */
+    bool decode(std::ostream &output, LogFormatter::TimeResolution resolution = LogFormatter::TimeResolution::SECONDS);
+
+private:
+    // the same as Handler, with the time in nanoseconds since the epoch
+    using RecordHandler = std::function<void(LogLevel level, const std::string &domain, const std::string &threadId,
+                                             uint64_t time, const std::string &message)>;
+
+    bool readRecords(const RecordHandler &handler);
+
+    struct Descriptor
+    {
+        LogLevel level;
+        std::string format;
+        std::string domain;
+    };
+
+    std::istream &_stream;
+    std::vector<Descriptor> _descriptors;
+    std::vector<std::string> _threads;
+};
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
+
+// clang-format off
+#define SC_LOG_DEFERRED_MESSAGE(level, domain, ...)                                                     \
+    do                                                                                                  \
+    {                                                                                                   \
+        if (static_cast<int>(softeq::common::logging::LogLevel::level) <= SC_LOG_MIN_LEVEL)             \
+        {                                                                                               \
+            static softeq::common::logging::LogSite scLogSite;                                          \
+            static softeq::common::logging::LogDescriptor scLogDescriptor(                              \
+                softeq::common::logging::LogLevel::level, __FILE__, __LINE__);                          \
+            const char *scLogDomain = (domain);                                                         \
+            if (softeq::common::logging::log().enabled(scLogSite, softeq::common::logging::LogLevel::level, \
+                                                       scLogDomain) &&                                  \
+                softeq::common::logging::log().admitted(scLogSite, softeq::common::logging::LogLevel::level, \
+                                                        scLogDomain))                                   \
+            {                                                                                           \
+                softeq::common::logging::DeferredLog::get().write(scLogDescriptor, scLogDomain,         \
+                                                                  __VA_ARGS__);                         \
+            }                                                                                           \
+        }                                                                                               \
+    } while (0)
+// clang-format on
+
+#define DLOGT(domain, ...) SC_LOG_DEFERRED_MESSAGE(TRACE, domain, __VA_ARGS__)
+#define DLOGD(domain, ...) SC_LOG_DEFERRED_MESSAGE(DEBUG, domain, __VA_ARGS__)
+#define DLOGI(domain, ...) SC_LOG_DEFERRED_MESSAGE(INFO, domain, __VA_ARGS__)
+#define DLOGW(domain, ...) SC_LOG_DEFERRED_MESSAGE(WARNING, domain, __VA_ARGS__)
+#define DLOGE(domain, ...) SC_LOG_DEFERRED_MESSAGE(ERROR, domain, __VA_ARGS__)
+#define DLOGC(domain, ...) SC_LOG_DEFERRED_MESSAGE(CRITICAL, domain, __VA_ARGS__)
+#define DLOGF(domain, ...) SC_LOG_DEFERRED_MESSAGE(FATAL, domain, __VA_ARGS__)
+
+/*
+  Building with SC_LOG_DEFERRED defined switches the regular LOGx macros to the deferred mode
+*/
+#ifdef SC_LOG_DEFERRED
+#undef LOGT
+#undef LOGD
+#undef LOGI
+#undef LOGW
+#undef LOGE
+#undef LOGC
+#undef LOGF
+#define LOGT DLOGT
+#define LOGD DLOGD
+#define LOGI DLOGI
+#define LOGW DLOGW
+#define LOGE DLOGE
+#define LOGC DLOGC
+#define LOGF DLOGF
+#endif
+
+#endif // SOFTEQ_COMMON_DEFERRED_LOG_H_
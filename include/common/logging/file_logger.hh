@@ -0,0 +1,146 @@
+#ifndef SOFTEQ_COMMON_FILE_LOGGER_H_
+#define SOFTEQ_COMMON_FILE_LOGGER_H_
+
+#include <common/logging/log_formatter.hh>
+#include <common/logging/logger_interface.hh>
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+/*!
+  \brief File logger with rotation.
+
+  Producers only append formatted lines to an in-memory batch. A writer thread appends whole batches to
+  the file opened with O_APPEND and rotates it by size or age, the rotated segment is renamed to
+  "<path>.<YYYYmmdd-HHMMSS>.<microseconds>" in UTC. A housekeeping thread compresses rotated segments with gzip
+  and removes the oldest ones beyond the retention limits.
+*/
+class FileLogger final : public LoggerInterface
+{
+public:
+    struct settings_t
+    {
+        /*!
+          Path to the active log file
+        */
+        std::string path;
+        /*!
+          Size of the batch which wakes the writer up before the flush period expires
+        */
+        std::size_t bufferSize{64 * 1024};
+        /*!
+          The longest time a line stays in memory
+        */
+        std::chrono::milliseconds flushPeriod{200};
+        /*!
+          Size of the file which triggers rotation, 0 disables it
+        */
+        std::size_t maxFileSize{0};
+        /*!
+          Age of the file which triggers rotation, 0 disables it
+        */
+        std::chrono::seconds rotationPeriod{0};
+        /*!
+          Compress rotated segments with gzip
+        */
+        bool compress{true};
+        /*!
+          Number of rotated segments to keep, 0 means unlimited
+        */
+        std::size_t maxFiles{0};
+        /*!
+          Total size of rotated segments to keep, 0 means unlimited
+        */
+        std::size_t maxBytes{0};
+        /*!
+          Precision of timestamps of the lines
+        */
+        LogFormatter::TimeResolution resolution{LogFormatter::TimeResolution::SECONDS};
+    };
+
+    /*!
+      Opens the file and starts the background threads, throws std::system_error if the file can't be opened
+      \param[in] settings File and rotation settings
+    */
+    explicit FileLogger(const settings_t &settings);
+    /*!
+      Writes out all the lines, finishes compression of rotated segments and stops the background threads
+    */
+    ~FileLogger() override;
+
+    /*!
+        Appends the line to the batch
+        \param[in] level Log level
+        \param[in] context Log context
+        \param[in] msg Char pointer to message
+      */
+    void log(LogLevel level, const LogContext &context, const char *msg) override;
+    /*!
+        Blocks until all the lines logged before the call are written to the file
+      */
+    void flush() override;
+    /*!
+        Rotates the file after writing the lines logged before the call, does not wait for it
+      */
+    void rotate();
+
+    /*!
+      Parses SC_LOG_FILE variable
+      \param[in] str "path[,size=<bytes>][,period=<seconds>][,files=<count>][,bytes=<bytes>][,compress=0|1]",
+       sizes accept K, M and G suffixes
+      \return Settings, throws std::logic_error for malformed values
+    */
+    static settings_t settingsFromString(const std::string &str);
+
+private:
+    void writer();
+    void housekeeper();
+    void openFile();
+    void writeBatch(const std::string &batch);
+    bool rotationRequired() const;
+    void rotateFile();
+    void compress(const std::string &path);
+    void enforceRetention();
+
+    const settings_t _settings;
+    const LogFormatter _formatter;
+
+    // owned by the writer thread
+    int _fd{-1};
+    std::size_t _fileSize{0};
+    std::chrono::steady_clock::time_point _opened;
+
+    std::mutex _mutex;
+    std::condition_variable _dataAvailable;
+    std::condition_variable _written;
+    std::string _pending;
+    uint64_t _flushRequested{0};
+    uint64_t _flushed{0};
+    bool _rotateRequested{false};
+    bool _stop{false};
+    std::thread _writer;
+
+    std::mutex _housekeepingMutex;
+    std::condition_variable _rotated;
+    std::deque<std::string> _segments;
+    bool _housekeepingStop{false};
+    std::thread _housekeeper;
+};
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_FILE_LOGGER_H_
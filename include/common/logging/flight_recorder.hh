@@ -0,0 +1,130 @@
+#ifndef SOFTEQ_COMMON_FLIGHT_RECORDER_H_
+#define SOFTEQ_COMMON_FLIGHT_RECORDER_H_
+
+#include <common/logging/log_formatter.hh>
+#include <common/logging/logger_interface.hh>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+/*!
+  \brief Ring of the most recent log lines kept in memory for post-mortem analysis.
+
+  Log passes every message up to the recorder level to it before the filters of the installed logger
+  and the sinks are applied, so the ring holds TRACE context even when only warnings are written.
+  Lines are stored pre-formatted in fixed size slots, a slot is claimed with one atomic increment
+  and guarded by a sequence number, so dump() copies consistent lines with plain write() calls and
+  may be called from a signal handler. The memory can be a memfd, then a supervisor which inherited
+  or duplicated the descriptor can read the ring of a process that died without dumping it.
+*/
+class FlightRecorder final : public LoggerInterface
+{
+public:
+    struct settings_t
+    {
+        /*!
+          Number of lines kept
+        */
+        std::size_t records{1024};
+        /*!
+          Size of a slot, longer lines are truncated
+        */
+        std::size_t recordSize{256};
+        /*!
+          The least severe level recorded
+        */
+        LogLevel level{LogLevel::TRACE};
+        /*!
+          Place the ring into a memfd instead of anonymous memory
+        */
+        bool memfd{false};
+        /*!
+          Dump the ring to stderr on SIGSEGV, SIGBUS, SIGILL, SIGFPE and SIGABRT
+        */
+        bool crashHandlers{true};
+        /*!
+          Precision of timestamps of the lines
+        */
+        LogFormatter::TimeResolution resolution{LogFormatter::TimeResolution::SECONDS};
+    };
+
+    /*!
+      Maps the ring, throws std::system_error if the memory can't be mapped
+      \param[in] settings Size of the ring and its placement
+    */
+    explicit FlightRecorder(const settings_t &settings);
+    ~FlightRecorder() override;
+
+    /*!
+        Stores the line into the ring overwriting the oldest one
+        \param[in] level Log level
+        \param[in] context Log context
+        \param[in] msg Char pointer to message
+      */
+    void log(LogLevel level, const LogContext &context, const char *msg) override;
+    /*!
+        Writes the lines from the oldest to the newest, it is async-signal-safe
+        \param[in] fd File descriptor to write to
+      */
+    void dump(int fd) const noexcept;
+    /*!
+        Writes the lines like dump() unless a crash has been dumped already, the crash handlers use it too,
+        so a crash reported by several handlers is dumped once; it is async-signal-safe
+        \param[in] fd File descriptor to write to
+        \return false if the process has dumped a recorder on a crash already
+      */
+    bool dumpOnce(int fd) const noexcept;
+
+    const settings_t &settings() const noexcept
+    {
+        return _settings;
+    }
+    /*!
+        \return Descriptor of the memfd or -1 if the ring is in anonymous memory
+      */
+    int fd() const noexcept
+    {
+        return _fd;
+    }
+
+    /*!
+        Installs the crash handlers on the first call and makes them dump the recorder, the previous
+        handlers are called after the dump
+        \param[in] recorder Recorder to dump, nullptr makes installed handlers do nothing but chaining
+      */
+    static void dumpOnCrash(const FlightRecorder *recorder);
+
+    /*!
+      Parses SC_LOG_RECORDER variable
+      \param[in] str "[records=<count>][,size=<bytes>][,level=<level>][,memfd=0|1][,handlers=0|1]"
+      \return Settings, throws std::logic_error or std::invalid_argument for malformed values
+    */
+    static settings_t settingsFromString(const std::string &str);
+
+private:
+    struct Header;
+    struct Slot;
+
+    Slot *slot(uint64_t index) const noexcept;
+
+    const settings_t _settings;
+    const LogFormatter _formatter;
+    int _fd{-1};
+    std::size_t _size{0};
+    void *_memory{nullptr};
+    Header *_header{nullptr};
+};
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_FLIGHT_RECORDER_H_
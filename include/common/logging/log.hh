@@ -1,11 +1,36 @@
 #ifndef SOFTEQ_COMMON_LOG_H_
 #define SOFTEQ_COMMON_LOG_H_
 
+#include <common/logging/async_logger.hh>
+#include <common/logging/flight_recorder.hh>
 #include <common/logging/logger_interface.hh>
+#include <common/stdutils/gcra.hh>
+#include <common/stdutils/hash.hh>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <map>
+#include <thread>
+#include <vector>
+
+/*!
+  Messages less severe than this level are removed at compile time, their arguments are not even evaluated.
+  Release builds keep INFO and more severe messages only, define the value explicitly to override it.
+*/
+#ifndef SC_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define SC_LOG_MIN_LEVEL 5 // LogLevel::INFO
+#else
+#define SC_LOG_MIN_LEVEL 7 // LogLevel::TRACE
+#endif
+#endif
 
 namespace softeq
 {
@@ -13,12 +38,245 @@ namespace common
 {
 namespace logging
 {
+/*!
+  \brief Lock-free token bucket of log messages.
+
+  Rejected messages are counted until the next accepted one reports them.
+*/
+class RateLimiter final
+{
+public:
+    /*!
+      Takes a token
+      \param[in] now Current time in nanoseconds
+      \param[in] interval Nanoseconds it takes to refill one token
+      \param[in] burst Capacity of the bucket
+      \return false if the bucket is empty
+    */
+    bool take(int64_t now, int64_t interval, int64_t burst) noexcept
+    {
+        if (_bucket.take(now, interval, stdutils::Gcra::tolerance(interval, burst)))
+        {
+            _suppressed.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    /*!
+      \return Number of rejected tokens since the previous call
+    */
+    uint32_t suppressed() noexcept
+    {
+        return _suppressed.load(std::memory_order_relaxed) ? _suppressed.exchange(0, std::memory_order_relaxed) : 0;
+    }
+
+private:
+    stdutils::Gcra _bucket;
+    std::atomic<uint32_t> _suppressed{0};
+};
+
+/*!
+  \brief Grace periods of lock-free readers of immutable snapshots.
+
+  A writer replaces the pointer to a snapshot and calls synchronize() before it frees the old one: the call
+  starts a new period and waits until the readers of the previous one have left. Readers only count themselves
+  in and out, the ones which come meanwhile belong to the new period and don't delay the writer.
+*/
+class GracePeriod final
+{
+public:
+    /*!
+      Reader of the snapshots, it is counted in the current period during its lifetime
+    */
+    class Reader final
+    {
+    public:
+        explicit Reader(GracePeriod &grace) noexcept
+            : _readers(grace.enter())
+        {
+        }
+
+        ~Reader()
+        {
+            _readers.fetch_sub(1, std::memory_order_release);
+        }
+
+        Reader(const Reader &) = delete;
+        Reader &operator=(const Reader &) = delete;
+
+    private:
+        std::atomic<unsigned> &_readers;
+    };
+
+    /*!
+      Waits until nobody reads a snapshot replaced before the call, a writer must not be a reader itself
+    */
+    void synchronize()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        const unsigned period = _period.load(std::memory_order_relaxed);
+        _period.store(period + 1);
+        while (_readers[period & 1].load())
+        {
+            std::this_thread::yield();
+        }
+    }
+
+private:
+    std::atomic<unsigned> &enter() noexcept
+    {
+        for (;;)
+        {
+            const unsigned period = _period.load();
+            std::atomic<unsigned> &readers = _readers[period & 1];
+            readers.fetch_add(1);
+            if (_period.load() == period)
+            {
+                return readers;
+            }
+            // the writer which has just started a new period may have missed this reader
+            readers.fetch_sub(1, std::memory_order_release);
+        }
+    }
+
+    std::atomic<unsigned> _period{0};
+    std::atomic<unsigned> _readers[2]{};
+    std::mutex _mutex; // serializes writers, the readers of the previous period are waited for then
+};
+
+/*!
+  \brief Per call site cache of the severity level configured for a domain.
+
+  It is a static object of every LOGx macro expansion so the domain filter is looked up once per call site
+  instead of once per message. The cache is tagged with the hash and the length of the domain name and
+  the filter generation, all validated by a sequence lock, so concurrent readers never block and writers
+  never wait. The name, not its address, is the key since a site may be given different names from the
+  same buffer.
+*/
+class LogSite final
+{
+public:
+    bool lookup(const char *domain, uint32_t generation, LogLevel &level) const noexcept
+    {
+        uint32_t seq = _seq.load(std::memory_order_acquire);
+        if (seq & 1)
+        {
+            return false;
+        }
+        uint64_t cachedHash = _hash.load(std::memory_order_relaxed);
+        std::size_t cachedLength = _length.load(std::memory_order_relaxed);
+        uint32_t cachedGeneration = _generation.load(std::memory_order_relaxed);
+        int cachedLevel = _level.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_seq.load(std::memory_order_relaxed) != seq || cachedGeneration != generation)
+        {
+            return false;
+        }
+        std::size_t length;
+        if (stdutils::fnv1a(domain, length) != cachedHash || length != cachedLength)
+        {
+            return false;
+        }
+        level = static_cast<LogLevel>(cachedLevel);
+        return true;
+    }
+
+    void store(const char *domain, uint32_t generation, LogLevel level) noexcept
+    {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+        if ((seq & 1) || !_seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed))
+        {
+            // somebody else is updating the cache, the caller has the value anyway
+            return;
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        std::size_t length;
+        _hash.store(stdutils::fnv1a(domain, length), std::memory_order_relaxed);
+        _length.store(length, std::memory_order_relaxed);
+        _generation.store(generation, std::memory_order_relaxed);
+        _level.store(static_cast<int>(level), std::memory_order_relaxed);
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    RateLimiter &limiter() noexcept
+    {
+        return _limiter;
+    }
+
+private:
+    std::atomic<uint32_t> _seq{0};
+    std::atomic<uint64_t> _hash{0};
+    std::atomic<std::size_t> _length{0};
+    std::atomic<uint32_t> _generation{0};
+    std::atomic<int> _level{0};
+    RateLimiter _limiter;
+};
+
 /*!
   \brief Logger.
 */
 class Log final
 {
 public:
+    using SinkId = unsigned;
+
+    struct sink_settings_t
+    {
+        /*!
+          The least severe level the sink accepts
+        */
+        LogLevel level{LogLevel::TRACE};
+        /*!
+          Levels of particular domains, override the level above
+        */
+        std::map<std::string, LogLevel> domains;
+        /*!
+          Deliver messages from a dedicated thread, so a slow sink doesn't stall the callers and other sinks
+        */
+        bool async{true};
+        /*!
+          Queue settings of the asynchronous sink
+        */
+        AsyncLogger::settings_t queue;
+    };
+
+    struct rate_limit_t
+    {
+        /*!
+          Messages per second a call site of the LOGx macros may write, 0 disables the limit
+        */
+        unsigned siteRate{0};
+        /*!
+          Messages a call site may write at once, 0 means the same as the rate
+        */
+        unsigned siteBurst{0};
+        /*!
+          Messages per second a domain may write, 0 disables the limit
+        */
+        unsigned domainRate{0};
+        /*!
+          Messages a domain may write at once, 0 means the same as the rate
+        */
+        unsigned domainBurst{0};
+        /*!
+          Collapse identical consecutive messages of a thread into "last message repeated N times"
+        */
+        bool collapse{false};
+    };
+
+    struct statistics_t
+    {
+        /*!
+          Messages dropped by the rate limits
+        */
+        uint64_t rateLimited;
+        /*!
+          Messages collapsed as repetitions of the previous one
+        */
+        uint64_t repeated;
+    };
+
     Log(Log &&) = delete;
     ~Log();
     static Log &get();
@@ -30,6 +288,42 @@ public:
          as format in printf (see  http://www.cplusplus.com/reference/cstdio/printf/ for details)
       */
     void Message(LogLevel level, const char *domain, const char *format, ...);
+    /*!
+        Writes the message which has been accepted by enabled() for the same call site
+        \param[in] site Call site cache
+        \param[in] level Log level
+        \param[in] domain String prefic
+        \param[in] format C string that contains a format string that follows the same specifications
+         as format in printf (see  http://www.cplusplus.com/reference/cstdio/printf/ for details)
+      */
+    void Message(LogSite &site, LogLevel level, const char *domain, const char *format, ...);
+    /*!
+        Checks whether the message would be written, so the caller can skip the formatting at all
+        \param[in] site Call site cache
+        \param[in] level Log level
+        \param[in] domain String prefic
+        \return true if the message passes the filters
+      */
+    bool enabled(LogSite &site, LogLevel level, const char *domain)
+    {
+        if (static_cast<int>(level) > _maxLevel.load(std::memory_order_relaxed))
+        {
+            return false;
+        }
+        return level <= levelOf(site, domain) || trapRequested(level) || recorded(level);
+    }
+    /*!
+        Applies the rate limits to the message accepted by enabled(), for callers which output the message
+        themselves, Message() applies them on its own
+        \param[in] site Call site cache
+        \param[in] level Log level
+        \param[in] domain String prefic
+        \return true if the message is not rate limited
+      */
+    bool admitted(LogSite &site, LogLevel level, const char *domain)
+    {
+        return admit(&site, level, domain);
+    }
     /*!
         Print system error
         \param[in] domain String prefic
@@ -48,6 +342,17 @@ public:
          va_list is a special type defined in \<cstdarg\>.
       */
     void MessageV(LogLevel level, const char *domain, const char *format, va_list args);
+    /*!
+        Passes the formatted message to the installed logger and the sinks whose filters accept it
+        \param[in] level Log level
+        \param[in] context Log context
+        \param[in] msg Char pointer to message
+      */
+    void Write(LogLevel level, const LogContext &context, const char *msg);
+    /*!
+       Writes out all the messages accepted by the installed logger so far
+    */
+    void flush();
     /*!
        Set log level
         \param[in] level Log level
@@ -55,8 +360,14 @@ public:
     void level(LogLevel level);
     LogLevel level()
     {
-        return _level;
+        return _filter.load(std::memory_order_acquire)->level;
     };
+    /*!
+       Replaces the level and the domain filters at runtime, it is safe to call while other threads log
+        \param[in] filter String of SC_LOG_FILTER format: "level,domain:level,..."
+        throws std::logic_error or std::invalid_argument if the string is malformed, the filter is not changed then
+    */
+    void filter(const std::string &filter);
     /*!
        Set iface
         \param[in] iface Pointer to LoggerInterface class
@@ -65,16 +376,174 @@ public:
     {
         _logger = std::move(iface);
     }
+    /*!
+       Adds a sink which receives messages in addition to the logger installed by set(), every message
+       is formatted once for all of them
+        \param[in] sink Logger the messages are delivered to
+        \param[in] settings Filter of the sink and its isolation
+        \return Id of the sink to remove it later
+    */
+    SinkId addSink(LoggerInterface::UPtr &&sink, const sink_settings_t &settings);
+    /*!
+       Adds a sink with default settings: all messages, delivered asynchronously
+        \param[in] sink Logger the messages are delivered to
+        \return Id of the sink to remove it later
+    */
+    SinkId addSink(LoggerInterface::UPtr &&sink);
+    /*!
+       Removes the sink, it is destroyed once the messages being delivered to it are done
+        \param[in] id Id returned by addSink()
+        \return false if there is no such sink
+    */
+    bool removeSink(SinkId id);
+    /*!
+       Sets flood protection, FATAL messages are never limited. A call site or a domain that resumes after
+       being limited writes the number of messages it has lost first
+        \param[in] settings Rates and duplicate collapsing
+    */
+    void rateLimit(const rate_limit_t &settings);
+    rate_limit_t rateLimit() const;
+    /*!
+       Counters of suppressed messages, they only grow so they can be polled for alerting
+    */
+    statistics_t statistics() const
+    {
+        return statistics_t{_rateLimited.load(std::memory_order_relaxed), _repeated.load(std::memory_order_relaxed)};
+    }
+    /*!
+      Parses SC_LOG_RATE_LIMIT variable
+      \param[in] str "[site=<rate>[/<burst>]][,domain=<rate>[/<burst>]][,collapse]"
+      \return Settings, throws std::logic_error or std::invalid_argument for malformed values
+    */
+    static rate_limit_t rateLimitFromString(const std::string &str);
+    /*!
+       Starts keeping recent messages in a flight recorder, they are recorded before any filtering.
+       A running recorder is replaced
+        \param[in] settings Size of the ring, its level and placement
+        throws std::system_error if the ring can't be allocated
+    */
+    void startRecorder(const FlightRecorder::settings_t &settings);
+    /*!
+       Stops recording messages
+    */
+    void stopRecorder();
+    /*!
+       Writes the lines of the flight recorder if it runs, it is async-signal-safe
+        \param[in] fd File descriptor to write to
+    */
+    void dumpRecorder(int fd) const noexcept
+    {
+        const FlightRecorder *recorder = _recorder.load(std::memory_order_acquire);
+        if (recorder)
+        {
+            recorder->dump(fd);
+        }
+    }
+    /*!
+       Writes the lines of the flight recorder if it runs and no crash has been dumped yet, see
+       FlightRecorder::dumpOnce(); crash paths use it, it is async-signal-safe
+        \param[in] fd File descriptor to write to
+    */
+    void dumpRecorderOnce(int fd) const noexcept
+    {
+        const FlightRecorder *recorder = _recorder.load(std::memory_order_acquire);
+        if (recorder)
+        {
+            recorder->dumpOnce(fd);
+        }
+    }
 
 private:
+    struct Sink
+    {
+        SinkId id;
+        LogLevel level;
+        std::map<std::string, LogLevel> domains;
+        std::shared_ptr<LoggerInterface> logger;
+    };
+    using Sinks = std::vector<Sink>;
+
+    struct Filter
+    {
+        LogLevel level;
+        std::map<std::string, LogLevel> domains; // filtering of different domain messages by severity level
+    };
+
+    struct LastMessage;
+
     Log();
+    static Filter parseFilter(const std::string &filter, LogLevel level);
+    void publish(std::unique_ptr<Filter> &&filter); // called with _filterMutex locked
+    void publish(std::unique_ptr<const Sinks> &&sinks); // called with _sinksMutex locked
+    static LogLevel levelOf(const std::map<std::string, LogLevel> &filter, LogLevel level, const char *domain);
+    LogLevel levelOf(const char *domain) const;
+    LogLevel levelOf(LogSite &site, const char *domain) const
+    {
+        const uint32_t generation = _generation.load(std::memory_order_acquire);
+        LogLevel level;
+        if (!site.lookup(domain, generation, level))
+        {
+            level = levelOf(domain);
+            site.store(domain, generation, level);
+        }
+        return level;
+    }
+    bool trapRequested(LogLevel level) const
+    {
+        return (_raise_sigtrap_on_error && level == LogLevel::ERROR) ||
+               (_raise_sigtrap_on_warning && level == LogLevel::WARNING);
+    }
+    bool recorded(LogLevel level) const
+    {
+        return static_cast<int>(level) <= _recorderLevel.load(std::memory_order_relaxed);
+    }
+    bool admit(LogSite *site, LogLevel level, const char *domain);
+    void output(LogLevel level, const char *domain, bool write, const char *format, va_list args);
+    bool collapsed(LogLevel level, const char *domain, const char *msg);
+    void filterChanged();
+
     std::string identity_;
 
     LoggerInterface::UPtr _logger;
-    LogLevel _level = LogLevel::DEBUG;
+    // the most verbose level any message can pass with, lets callers reject messages without a lookup
+    std::atomic<int> _maxLevel{static_cast<int>(LogLevel::DEBUG)};
+    // changed each time filters are changed, invalidates call site caches
+    std::atomic<uint32_t> _generation{1};
     bool _raise_sigtrap_on_error = false;
     bool _raise_sigtrap_on_warning = false;
-    std::map<std::string, LogLevel> _domain_filter; // filtering of different domain messages by severity level
+
+    // readers of _filter and _sinks, a replaced snapshot is freed once they have left
+    mutable GracePeriod _grace;
+
+    // immutable snapshot, a change publishes a new copy so readers never lock
+    std::atomic<const Filter *> _filter{nullptr};
+    std::mutex _filterMutex; // serializes writers of _filter
+
+    // immutable list replaced as a whole like _filter, the removed sinks are freed with the replaced list
+    std::atomic<const Sinks *> _sinks{new Sinks()};
+    std::mutex _sinksMutex; // serializes writers of _sinks
+    SinkId _lastSinkId{0};
+
+    // flood protection, nanoseconds per token of 0 disables a limit
+    static constexpr std::size_t cDomainLimiters = 64;
+    std::atomic<bool> _limited{false};
+    std::atomic<int64_t> _siteInterval{0};
+    std::atomic<int64_t> _siteBurst{0};
+    std::atomic<int64_t> _domainInterval{0};
+    std::atomic<int64_t> _domainBurst{0};
+    std::atomic<bool> _collapse{false};
+    RateLimiter _domainLimiters[cDomainLimiters]; // domains are hashed, colliding ones share the budget
+    rate_limit_t _rateLimit;
+    mutable std::mutex _rateLimitMutex; // serializes writers of the settings
+    std::atomic<uint64_t> _rateLimited{0};
+    std::atomic<uint64_t> _repeated{0};
+    static thread_local LastMessage _lastMessage;
+
+    // bypasses the filters, replaced recorders are kept since writers and signal handlers may still use them
+    std::atomic<FlightRecorder *> _recorder{nullptr};
+    std::atomic<int> _recorderLevel{static_cast<int>(LogLevel::NONE)};
+    std::vector<std::unique_ptr<FlightRecorder>> _recorders;
+    std::mutex _recorderMutex; // serializes writers of _recorder
 };
 
 inline Log &log()
@@ -86,13 +555,35 @@ inline Log &log()
 } // namespace common
 } // namespace softeq
 
-#define LOGT(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::TRACE, domain, __VA_ARGS__)
-#define LOGD(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::DEBUG, domain, __VA_ARGS__)
-#define LOGI(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::INFO, domain, __VA_ARGS__)
-#define LOGW(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::WARNING, domain, __VA_ARGS__)
-#define LOGE(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::ERROR, domain, __VA_ARGS__)
-#define LOGC(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::CRITICAL, domain, __VA_ARGS__)
-#define LOGF(domain, ...) softeq::common::logging::log().Message(softeq::common::logging::LogLevel::FATAL, domain, __VA_ARGS__)
+// clang-format off
+#define SC_LOG_MESSAGE(level, domain, ...)                                                              \
+    do                                                                                                  \
+    {                                                                                                   \
+        if (static_cast<int>(softeq::common::logging::LogLevel::level) <= SC_LOG_MIN_LEVEL)             \
+        {                                                                                               \
+            static softeq::common::logging::LogSite scLogSite;                                          \
+            softeq::common::logging::Log &scLog = softeq::common::logging::log();                       \
+            const char *scLogDomain = (domain);                                                         \
+            if (scLog.enabled(scLogSite, softeq::common::logging::LogLevel::level, scLogDomain))        \
+            {                                                                                           \
+                scLog.Message(scLogSite, softeq::common::logging::LogLevel::level, scLogDomain,         \
+                              __VA_ARGS__);                                                             \
+            }                                                                                           \
+        }                                                                                               \
+    } while (0)
+// clang-format on
+
+#define LOGT(domain, ...) SC_LOG_MESSAGE(TRACE, domain, __VA_ARGS__)
+#define LOGD(domain, ...) SC_LOG_MESSAGE(DEBUG, domain, __VA_ARGS__)
+#define LOGI(domain, ...) SC_LOG_MESSAGE(INFO, domain, __VA_ARGS__)
+#define LOGW(domain, ...) SC_LOG_MESSAGE(WARNING, domain, __VA_ARGS__)
+#define LOGE(domain, ...) SC_LOG_MESSAGE(ERROR, domain, __VA_ARGS__)
+#define LOGC(domain, ...) SC_LOG_MESSAGE(CRITICAL, domain, __VA_ARGS__)
+#define LOGF(domain, ...) SC_LOG_MESSAGE(FATAL, domain, __VA_ARGS__)
 #define LOGSYS(domain, ...) softeq::common::logging::log().SystemError(domain, __VA_ARGS__)
 
+#ifdef SC_LOG_DEFERRED
+#include <common/logging/deferred_log.hh>
+#endif
+
 #endif // SOFTEQ_COMMON_LOG_H_
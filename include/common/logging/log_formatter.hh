@@ -0,0 +1,66 @@
+#ifndef SOFTEQ_COMMON_LOG_FORMATTER_H_
+#define SOFTEQ_COMMON_LOG_FORMATTER_H_
+
+#include <common/logging/logger_interface.hh>
+
+#include <string>
+
+namespace softeq
+{
+namespace common
+{
+namespace logging
+{
+/*!
+  \brief Text layout of log lines shared by LoggerInterface implementations.
+
+  Produces "<time> <thread id> [<level>] <domain>: <message>\n". The thread id strings and the timestamp
+  text are cached in thread local storage, the line is assembled in a reusable thread local buffer,
+  so a line costs a few appends in the common case.
+*/
+class LogFormatter final
+{
+public:
+    /*!
+      Precision of the timestamp
+    */
+    enum class TimeResolution
+    {
+        SECONDS,      /**< seconds since the epoch */
+        MILLISECONDS, /**< seconds since the epoch with milliseconds after the dot */
+    };
+
+    explicit LogFormatter(TimeResolution resolution = TimeResolution::SECONDS);
+
+    /*!
+        Builds the line of the message
+        \param[in] level Log level
+        \param[in] context Log context
+        \param[in] msg Char pointer to message
+        \return Line terminated by '\n', valid until the next call from the same thread
+      */
+    const std::string &format(LogLevel level, const LogContext &context, const char *msg) const;
+
+    /*!
+        Converts the thread id into text like "0x7F12AB34C700"
+        \param[in] id Thread id
+        \return Cached text, valid until the next call from the same thread
+      */
+    static const std::string &threadId(const std::thread::id &id);
+
+    /*!
+        Converts SC_LOG_TIME_RESOLUTION value into the resolution
+        \param[in] str "s" or "ms"
+        \return Resolution value, throws std::logic_error for unknown names
+      */
+    static TimeResolution timeResolutionFromString(const std::string &str);
+
+private:
+    const TimeResolution _resolution;
+};
+
+} // namespace logging
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_LOG_FORMATTER_H_
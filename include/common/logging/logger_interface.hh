@@ -1,6 +1,8 @@
 #ifndef SOFTEQ_COMMON_LOGGER_INTERFACE_H
 #define SOFTEQ_COMMON_LOGGER_INTERFACE_H
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <thread>
 
@@ -40,14 +42,18 @@ char logLevelToChar(LogLevel level);
 
 struct LogContext final
 {
-    LogContext(const std::string &name, const std::thread::id &threadId)
+    using Clock = std::chrono::system_clock;
+
+    LogContext(const std::string &name, const std::thread::id &threadId, const Clock::time_point &time = Clock::now())
         : _name(name)
         , _threadId(threadId)
+        , _time(time)
     {
     }
 
     std::string _name;
     std::thread::id _threadId;
+    Clock::time_point _time; // the moment the message was produced, may differ from the moment it is written
 };
 
 class LoggerInterface
@@ -62,6 +68,12 @@ public:
        \param[in] msg Char pointer to message
     */
     virtual void log(LogLevel level, const LogContext &context, const char *msg) = 0;
+    /*!
+       Writes out all the messages accepted by the logger so far. Called on FATAL messages and on shutdown
+    */
+    virtual void flush()
+    {
+    }
 };
 
 } // namespace logging
@@ -7,7 +7,12 @@
  */
 
 #include <common/net/http/http_session.hh>
+#include <common/net/http/http_stream.hh>
 
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
 #include <string>
 
 namespace softeq
@@ -25,11 +30,81 @@ enum class Method
     PUT,
     OPTIONS,
     DELETE,
+    HEAD,
+};
+
+/*!
+  Non-owning reference to request data, it stays valid while the request is being handled.
+  DataView{} is an empty view
+*/
+struct DataView
+{
+    const char *data;
+    std::size_t size;
+
+    bool empty() const noexcept
+    {
+        return size == 0;
+    }
+
+    std::string str() const
+    {
+        return data ? std::string(data, size) : std::string();
+    }
+};
+
+/*!
+  Piece of a field of a form (multipart/form-data or application/x-www-form-urlencoded) as it arrives,
+  a field may come in several pieces
+*/
+struct FormChunk
+{
+    const char *name;
+    const char *filename;    // nullptr if the field is not a file
+    const char *contentType; // nullptr if it is not given
+    uint64_t offset;         // of the data in the field
+    DataView data;
+};
+
+class IHttpConnection;
+
+/*!
+  Completion of a request which handler has returned before the response is ready. In the THREAD_POOL and
+  EXTERNAL modes the connection is suspended meanwhile, so it takes no thread of the server
+*/
+class IHttpCompletion
+{
+public:
+    using SPtr = std::shared_ptr<IHttpCompletion>;
+
+    /*!
+      Dropping the completion before complete() is called answers the request with 500 Internal Server Error
+    */
+    virtual ~IHttpCompletion() = default;
+
+    /*!
+       Writes the response and sends it, it may be called from any thread
+       \param[in] respond Function writing the response to the connection, it is not called if the request
+       is over (e.g. the server has stopped)
+       \return false if the request is over or it has been completed already
+    */
+    virtual bool complete(const std::function<void(IHttpConnection &connection)> &respond) = 0;
 };
 
 class IHttpConnection
 {
 public:
+    /*!
+      Receives the body of a request as it arrives
+      \return false to abort the request, the connection is closed then
+    */
+    using BodyConsumer = std::function<bool(DataView chunk)>;
+    /*!
+      Receives the fields of a form as they arrive
+      \return false to abort the request, the connection is closed then
+    */
+    using FormConsumer = std::function<bool(const FormChunk &chunk)>;
+
     virtual ~IHttpConnection() = default;
 
     /*!
@@ -38,6 +113,12 @@ public:
        \return String value of header
      */
     virtual std::string header(const std::string &name) const = 0;
+    /*!
+       Returns value of HTTP-header in the request without copying it
+       \param[in] name Name of header to return
+       \return View of the value, it is empty if the header is absent
+     */
+    virtual DataView headerView(const char *name) const = 0;
     /*!
        Method check a header exists in the request
        \param[in] name Name of header to check
@@ -66,16 +147,44 @@ public:
        \return String, containing request
     */
     virtual std::string get() const = 0;
+    /*!
+       Method to retrive GET-request (i.e. URI + query string) without copying it
+       \return View of the request
+    */
+    virtual DataView getView() const = 0;
     /*!
        Method to retrieve body of POST/PUT requests
        \return String, containing body of POST/PUT request
     */
     virtual std::string body() const = 0;
+    /*!
+       Takes the body over: it is passed to the consumer while it arrives instead of being collected, so
+       body() stays empty. It is called from IHttpConnectionDispatcher::prepare()
+       \param[in] consumer Consumer of the chunks of the body
+    */
+    virtual void consumeBody(BodyConsumer consumer) = 0;
+    /*!
+       Takes the body of a form over, it is parsed while it arrives and body() stays empty. It is called
+       from IHttpConnectionDispatcher::prepare()
+       \param[in] consumer Consumer of the fields
+       \return false if the body is not multipart/form-data or application/x-www-form-urlencoded
+    */
+    virtual bool consumeForm(FormConsumer consumer) = 0;
+    /*!
+       Method to retrieve body of POST/PUT requests without copying it
+       \return View of the body
+    */
+    virtual DataView bodyView() const = 0;
     /*!
        Method to retrieve URI-part of request
        \return String, containing request URI
     */
     virtual std::string path() const = 0;
+    /*!
+       Method to retrieve URI-part of request without copying it
+       \return View of the request URI
+    */
+    virtual DataView pathView() const = 0;
     /*!
        Method to retrieve value of the variable from query string in GET-request (and in POST request as well).
        \param[in] name Name of the variable to return
@@ -126,11 +235,46 @@ public:
        \return Reference to current instance of HttpConnection
     */
     virtual IHttpConnection &operator<<(const std::string &output) = 0;
+    /*!
+       Takes the string over as the response if nothing has been sent yet, so large serialized data
+       reaches the client without being copied. Otherwise it is appended
+       \param[in] output String, which needed to send
+       \return Reference to current instance of HttpConnection
+    */
+    virtual IHttpConnection &operator<<(std::string &&output) = 0;
+    /*!
+       Reserves memory of the response to avoid reallocations while it is being built
+       \param[in] size Expected size of the response
+    */
+    virtual void reserveResponse(std::size_t size) = 0;
     /*!
       Method to send file to client
       \param[in] filepath Path to file, which needed to send
     */
     virtual void sendFile(const std::string &filepath) = 0;
+    /*!
+      Sends the response with chunked transfer encoding while the body is being produced, instead of the
+      collected output. What has been written to the connection is sent first
+      \param[in] producer Function called by the server each time the stream runs out of data, it may be
+      empty when another thread writes to the stream. When it writes nothing the response waits until the
+      stream is written to or closed
+      \param[in] bufferSize Bytes queued before writers wait for the client
+      \return Stream to write the body to
+    */
+    virtual IHttpStream::SPtr startStream(IHttpStream::Producer producer = nullptr,
+                                          std::size_t bufferSize = 64 * 1024) = 0;
+    /*!
+      Starts a stream of Server-Sent Events (text/event-stream), events are written with
+      IHttpStream::sendEvent() by another thread
+      \return Stream to send the events to
+    */
+    virtual IHttpStream::SPtr startEventStream() = 0;
+    /*!
+      Defers the response: once the handler returns true, the request waits without holding a thread of the
+      server until the returned completion is used, e.g. by a worker waiting for a slow backend
+      \return Completion of the request
+    */
+    virtual IHttpCompletion::SPtr defer() = 0;
     /*!
       Method to get inforation about connected client
       \return description of the client
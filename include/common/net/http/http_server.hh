@@ -8,6 +8,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include <common/net/http/http_connection.hh>
 
 namespace softeq
@@ -28,6 +29,7 @@ enum HttpStatusCode
     STATUS_NOT_FOUND = 404,
     STATUS_NOT_ALLOWED = 405,
     STATUS_NOT_ACCEPTABLE = 406,
+    STATUS_PAYLOAD_TOO_LARGE = 413,
     STATUS_TOO_MANY_REQUESTS = 429,
     STATUS_INTERNAL_ERROR = 500,
     STATUS_SERVICE_UNAVAILABLE = 503,
@@ -45,6 +47,18 @@ struct IHttpConnectionDispatcher
        \return        true if request was handled by dispatcher
     */
     virtual bool handle(IHttpConnection &connection) = 0;
+
+    /*!
+       Called when the headers of a request have arrived, before its body. The dispatcher may take the body
+       over here with IHttpConnection::consumeBody() or consumeForm(), handle() is called once it is received
+       \param[in,out] connection Request, the error set on it is sent if the request is refused
+       \return        false to refuse the request, with 400 Bad Request unless another error is set
+    */
+    virtual bool prepare(IHttpConnection &connection)
+    {
+        (void)connection;
+        return true;
+    }
 };
 
 class IHttpServer
@@ -63,17 +77,53 @@ public:
     */
     virtual void stop() = 0;
 
+    /*!
+      How connections are mapped onto threads
+    */
+    enum class ThreadingMode
+    {
+        THREAD_PER_CONNECTION, /**< every connection has its own thread, simple but expensive for idle clients */
+        THREAD_POOL,           /**< a fixed pool of threads serves all connections with epoll */
+        EXTERNAL,              /**< the application drives the server from its own event loop, see HttpServer::run() */
+    };
+
     struct settings_t
     {
         /*!
-          Address to bind the server
+          Address to bind the server: IPv4 address, IPv6 one (the unspecified "::" accepts IPv4 clients too),
+          "unix:<path>" of a Unix domain socket or "unix:@<name>" of an abstract one. Empty means all IPv4
+          interfaces
         */
         std::string address;
+
+        /*!
+          More addresses served by the server in the same format, every one has its own daemon and threads
+        */
+        std::vector<std::string> extraAddresses;
         /*!
           Port for http/https connection
         */
         uint16_t port{80};
 
+        /*!
+          Listening socket to serve instead of opening one, e.g. inherited from the previous instance of the
+          process, -1 means none. The address and the port are ignored then, the socket is never closed by
+          the server, so it keeps queueing new connections while the server restarts
+        */
+        int listenSocket{-1};
+
+        /*!
+          Should the server serve the first socket passed by systemd socket activation (LISTEN_FDS), it opens
+          its own socket if there is none
+        */
+        bool socketActivation{false};
+
+        /*!
+          Can several processes listen on the port (SO_REUSEPORT), the kernel balances new connections
+          between them
+        */
+        bool reusePort{true};
+
         /*!
           Should the server use HTTPS
         */
@@ -85,12 +135,157 @@ public:
         std::string keyFilePath;
 
         /*!
-          Path to the certificate file
+          Path to the certificate file, it may hold the whole chain with the server's certificate first
         */
         std::string certFilePath;
+
+        /*!
+          Should the certificate and the key be loaded again when a file changes, the connections are kept
+        */
+        bool reloadChangedCertificate{true};
+
+        /*!
+          Should HTTPS clients get session tickets to resume their sessions with a short handshake
+        */
+        bool tlsSessionTickets{true};
+
+        /*!
+          Threading model of the server
+        */
+        ThreadingMode threading{ThreadingMode::THREAD_PER_CONNECTION};
+
+        /*!
+          Number of threads of the THREAD_POOL mode, 0 means the number of available CPUs
+        */
+        unsigned threadPoolSize{0};
+
+        /*!
+          Number of connections served at the same time
+        */
+        unsigned maxConnections{50};
+
+        /*!
+          Connections accepted beyond maxConnections only to be answered with 503 Service Unavailable,
+          when they are used up too new connections are not accepted
+        */
+        unsigned overloadConnections{16};
+
+        /*!
+          Number of connections from one IP address, 0 means no limit
+        */
+        unsigned maxConnectionsPerIp{25};
+
+        /*!
+          Seconds a connection may stay idle before it is closed, 0 means connections are never closed
+        */
+        unsigned connectionTimeout{60};
+
+        /*!
+          Memory of a connection for the request line and headers, requests with larger headers are refused,
+          0 means the default of libmicrohttpd (32 KiB)
+        */
+        std::size_t maxHeaderSize{0};
+
+        /*!
+          Length of the queue of not accepted connections, 0 means SOMAXCONN
+        */
+        unsigned listenBacklog{0};
+
+        /*!
+          Value of Retry-After header of 503 responses sent on overload, in seconds
+        */
+        unsigned overloadRetryAfter{1};
+
+        /*!
+          Requests per second a client address may send on average, more are refused with 429 Too Many
+          Requests before they reach the dispatcher, 0 means no limit
+        */
+        unsigned rateLimit{0};
+
+        /*!
+          Requests a client address may send at once beyond the average rate
+        */
+        unsigned rateLimitBurst{20};
+
+        /*!
+          Should every path of a client be limited separately
+        */
+        bool rateLimitPerPath{false};
+
+        /*!
+          Number of the token buckets of the clients, clients hashed to the same bucket share the limit
+        */
+        std::size_t rateLimitBuckets{16384};
+
+        /*!
+          Queueing delay of requests in milliseconds the server keeps under overload, 0 disables the shedding.
+          When the delay stays above the target for an interval, new requests waiting more than twice the target
+          are refused with 503 Service Unavailable. The delay is measured from the connection accept to the start
+          of its first request, later requests of a kept-alive connection are not measured
+        */
+        unsigned shedTargetDelay{0};
+
+        /*!
+          Interval of the shedding in milliseconds
+        */
+        unsigned shedInterval{100};
+
+        /*!
+          Bytes of sent files kept in memory, 0 means files are always read from the disk
+        */
+        std::size_t fileCacheSize{8 * 1024 * 1024};
+
+        /*!
+          Files larger than that are never kept in memory
+        */
+        std::size_t fileCacheMaxFileSize{256 * 1024};
+
+        /*!
+          Level of compression of responses from 1 (fastest) to 9 (smallest), 0 disables it.
+          Responses are compressed with gzip or deflate accepted by the client, except partial ones and
+          the ones which have Content-Encoding or a compressed media type
+        */
+        unsigned compressionLevel{0};
+
+        /*!
+          Smaller responses are not compressed
+        */
+        std::size_t compressionMinSize{1024};
+
+        /*!
+          A file is sent gzip-encoded from its sibling with ".gz" suffix if the client accepts gzip and
+          the sibling is not older than the file
+        */
+        bool precompressedFiles{true};
+
+        /*!
+          Bytes of a request body, larger requests are refused with 413 Payload Too Large (the connection is
+          closed if the size is not known in advance), 0 means no limit
+        */
+        std::size_t maxBodySize{0};
+
+        /*!
+          Request bodies larger than that are kept in a temporary file instead of memory, 0 keeps them in memory
+        */
+        std::size_t bodySpoolThreshold{1024 * 1024};
+
+        /*!
+          Directory of the temporary files of request bodies
+        */
+        std::string bodySpoolDirectory{"/tmp"};
     };
 };
 
+/*!
+  Load shedding of the server
+*/
+struct HttpLoadStats
+{
+    bool overloaded{false};   /**< the queueing delay has stayed above the target for the last interval */
+    double shedRate{0};       /**< share of the measured requests refused in the last interval */
+    uint64_t shedRequests{0}; /**< requests refused since the server was started */
+};
+
 class HttpServerImpl;
 
 class HttpServer : IHttpServer
@@ -108,10 +303,41 @@ public:
     bool start() override;
 
     /*!
-        Stops http server
+        Stops http server. It may be called from any thread but not from a request handler, in the EXTERNAL
+        mode it completes the pending requests itself and run() does nothing from then on
     */
     void stop() override;
 
+    /*!
+        Descriptor the application waits on for reading in the EXTERNAL threading mode, it becomes readable
+        when the server has some work to do
+        \return  Descriptor or -1 if the server is not started in the EXTERNAL mode
+    */
+    int pollDescriptor() const;
+
+    /*!
+        Longest time the application may wait on the descriptor before calling run()
+        \return  Milliseconds or -1 if the server doesn't need to be called until the descriptor is readable
+    */
+    long pollTimeout() const;
+
+    /*!
+        Handles pending network events without blocking, used in the EXTERNAL threading mode only
+        \return  false if the server is not started in the EXTERNAL mode, is stopping or it has failed
+    */
+    bool run();
+
+    /*!
+        \return  State of the load shedding, see settings_t::shedTargetDelay
+    */
+    HttpLoadStats loadStats() const;
+
+    /*!
+        Loads the certificate and the key of HTTPS again, new handshakes use them while the connections are kept
+        \return  false if the server doesn't use HTTPS or the files can't be loaded, the old ones are used then
+    */
+    bool reloadCertificate();
+
 private:
     std::unique_ptr<HttpServerImpl> _impl;
 };
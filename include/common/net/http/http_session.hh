@@ -6,6 +6,7 @@
  \brief Definition of class of HTTP session
  */
 
+#include <atomic>
 #include <ctime>
 #include <memory>
 #include <string>
@@ -83,8 +84,9 @@ public:
     virtual void onExpire() = 0;
 
 private:
-    time_t _lastActivity{0};
-    time_t _expiration{0};
+    // requests of the session and the expiration check run in different threads
+    std::atomic<time_t> _lastActivity{0};
+    std::atomic<time_t> _expiration{0};
     std::string _id;
 };
 
@@ -0,0 +1,78 @@
+#ifndef SOFTEQ_COMMON_HTTP_STREAM_H
+#define SOFTEQ_COMMON_HTTP_STREAM_H
+
+/*!
+ \file
+ \brief Definition of class of streamed HTTP response
+ */
+
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace softeq
+{
+namespace common
+{
+namespace net
+{
+namespace http
+{
+/*!
+  Body of a response which is sent while it is being produced, with chunked transfer encoding.
+
+  Data is written by a producer thread, which waits while the buffer is full until the client takes
+  the data, or by the producer function, which the server calls each time the buffer runs out of data.
+  Writes made before the handler has returned are only buffered.
+*/
+class IHttpStream
+{
+public:
+    using SPtr = std::shared_ptr<IHttpStream>;
+    /*!
+      Writes the next part of the body
+      \return false when the body is complete
+    */
+    using Producer = std::function<bool(IHttpStream &stream)>;
+
+    virtual ~IHttpStream() = default;
+
+    /*!
+       Queues data to send
+       \param[in] data Data, it is taken over without being copied
+       \return false if the stream is closed or the client has gone
+    */
+    virtual bool write(std::string &&data) = 0;
+    /*!
+       Queues data to send
+       \param[in] data Data
+       \param[in] size Size of the data
+       \return false if the stream is closed or the client has gone
+    */
+    virtual bool write(const char *data, std::size_t size) = 0;
+    /*!
+       Queues an event of Server-Sent Events
+       \param[in] data Data of the event, each of its lines is sent as a "data" field
+       \param[in] event Type of the event, it is not sent if it is empty
+       \param[in] id Id of the event, it is not sent if it is empty
+       \return false if the stream is closed or the client has gone
+    */
+    virtual bool sendEvent(const std::string &data, const std::string &event = std::string(),
+                           const std::string &id = std::string()) = 0;
+    /*!
+       Ends the response once the queued data is sent
+    */
+    virtual void close() = 0;
+    /*!
+       \return false if the stream is closed, the client has gone or the server is going to stop
+    */
+    virtual bool isOpen() const = 0;
+};
+
+} // namespace http
+} // namespace net
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_HTTP_STREAM_H
@@ -0,0 +1,66 @@
+#ifndef SOFTEQ_COMMON_GCRA_H_
+#define SOFTEQ_COMMON_GCRA_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+namespace softeq
+{
+namespace common
+{
+namespace stdutils
+{
+/*!
+  \brief Lock-free token bucket of the generic cell rate algorithm (GCRA).
+
+  The only state is the theoretical arrival time of the next token, the time the bucket is full again,
+  so taking a token is a single compare-and-swap and a bucket with the time in the past is full. The unit
+  of time is up to the caller.
+*/
+class Gcra final
+{
+public:
+    /*!
+      Takes a token
+      \param[in] now Current time
+      \param[in] interval Time it takes to refill one token
+      \param[in] tolerance Time the caller may be ahead of the rate, see tolerance()
+      \return Zero if the token is taken, otherwise the time until it would be
+    */
+    int64_t take(int64_t now, int64_t interval, int64_t tolerance) noexcept
+    {
+        int64_t full = _full.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            const int64_t base = std::max(full, now);
+            if (base - now > tolerance)
+            {
+                return base - now - tolerance;
+            }
+            if (_full.compare_exchange_weak(full, base + interval, std::memory_order_relaxed))
+            {
+                return 0;
+            }
+        }
+    }
+
+    /*!
+      \param[in] interval Time it takes to refill one token
+      \param[in] burst Capacity of the bucket, at least 1
+      \return Tolerance of take() for the bucket
+    */
+    static int64_t tolerance(int64_t interval, int64_t burst) noexcept
+    {
+        return interval * (std::max<int64_t>(burst, 1) - 1);
+    }
+
+private:
+    std::atomic<int64_t> _full{0};
+};
+
+} // namespace stdutils
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_GCRA_H_
@@ -0,0 +1,54 @@
+#ifndef SOFTEQ_COMMON_HASH_H_
+#define SOFTEQ_COMMON_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace softeq
+{
+namespace common
+{
+namespace stdutils
+{
+constexpr uint64_t cFnv1aSeed = 14695981039346656037ULL;
+
+/*!
+  FNV-1a hash, the previous result is given as the seed to combine several parts of a key
+  \param[in] data Bytes to hash
+  \param[in] size Number of the bytes
+  \param[in] seed Initial value
+  \return Hash value
+*/
+inline uint64_t fnv1a(const void *data, std::size_t size, uint64_t seed = cFnv1aSeed) noexcept
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        seed = (seed ^ bytes[i]) * 1099511628211ULL;
+    }
+    return seed;
+}
+
+/*!
+  FNV-1a hash of a C string, its length is found in the same pass
+  \param[in] str String, nullptr is hashed as an empty one
+  \param[out] length Length of the string
+  \return Hash value
+*/
+inline uint64_t fnv1a(const char *str, std::size_t &length) noexcept
+{
+    uint64_t result = cFnv1aSeed;
+    const char *end = str;
+    for (; end && *end; ++end)
+    {
+        result = (result ^ static_cast<unsigned char>(*end)) * 1099511628211ULL;
+    }
+    length = static_cast<std::size_t>(end - str);
+    return result;
+}
+
+} // namespace stdutils
+} // namespace common
+} // namespace softeq
+
+#endif // SOFTEQ_COMMON_HASH_H_